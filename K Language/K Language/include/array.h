@@ -0,0 +1,102 @@
+#pragma once
+
+#include "types.h"
+#include "tagged.h"
+
+namespace klang::type
+{
+	class IndexException : public KlangException
+	{
+	public:
+		IndexException(const Int64 index) noexcept;
+	};
+
+
+
+	/* Contiguous array with a backing store specialized by the kind of its elements:
+	   packed Int64, packed double, packed booleans (one byte each) or tagged values for
+	   anything else. An empty array takes the kind of its first element; a store that
+	   does not fit the current kind converts the elements once to Boxed, so integers and
+	   floats always read back with the type they were written with. Storing past the end
+	   fills the gap with undefined, which also makes the array Boxed. */
+	class Array : public Value
+	{
+	public:
+		enum class Kind : UInt8
+		{
+			Integer,
+			Double,
+			Boolean,
+			Boxed
+		};
+
+	private:
+		Kind _kind;
+		mutable bool _writing;
+		size_t _size;
+		size_t _reserved;
+		void* _data;
+
+	public:
+		Array();
+		Array(const size_t size, const Tagged fill);
+		~Array();
+
+	private:
+		static Kind KindOf(const Tagged value);
+		static size_t ElementSize(const Kind kind);
+
+		void reallocate(const size_t bytes);
+		void extend(const size_t size);
+		void generalize();
+		void store(const size_t index, const Tagged value);
+
+	public:
+		inline Kind kind() const { return _kind; }
+		inline size_t size() const { return _size; }
+		inline size_t capacity() const { return _reserved / ElementSize(_kind); }
+
+		/* Packed elements, only valid for the matching kind. */
+		inline Int64* integers() const { return reinterpret_cast<Int64*>(_data); }
+		inline double* doubles() const { return reinterpret_cast<double*>(_data); }
+		inline UInt8* booleans() const { return reinterpret_cast<UInt8*>(_data); }
+		inline const Tagged* values() const { return reinterpret_cast<const Tagged*>(_data); }
+
+		/* Element at index, undefined past the end. Only Int64 elements outside the inline
+		   integer range allocate. */
+		Tagged get(const size_t index) const;
+		void set(const size_t index, const Tagged value);
+		inline void push(const Tagged value) { set(_size, value); }
+
+		void reserve(const size_t capacity);
+
+		/* Drops the elements from size on, and the unused memory once less than half of
+		   it stays in use. */
+		void truncate(const size_t size);
+
+		/* Array of size elements of the given kind for kernels writing them directly,
+		   left uninitialized unless the kind is Boxed. */
+		static Array* allocate(const Kind kind, const size_t size);
+
+	public: //To c++ conversions
+		/* Numbers convert to the length, booleans test for emptiness. */
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+		operator std::wstring() const override;
+		operator ValueVector() const override;
+		void writeTo(TextSink& sink) const override;
+
+	public: //Array/List operators
+		Value* klang_operatorArrayGet(Value* index) override;
+		void klang_operatorArraySet(Value* index, Value* value) override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+	inline Array* newArray() { return heap::create<Array>(); }
+	inline Array* newArray(const size_t size, const Tagged fill = Tagged::undefined()) { return heap::create<Array>(size, fill); }
+}
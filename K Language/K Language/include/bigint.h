@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+
+namespace klang::type
+{
+	/* Sign and magnitude integer used by the BigInt kernels. Limbs are base 2^32, least
+	   significant first, without leading zero limbs; zero has no limbs. */
+	struct BigNumber
+	{
+		std::vector<UInt32> limbs;
+		bool negative = false;
+
+		BigNumber() = default;
+		BigNumber(const Int64 value);
+
+		static BigNumber parse(const std::wstring& digits);
+
+		inline bool isZero() const { return limbs.empty(); }
+		bool fitsInt64() const;
+		Int64 toInt64() const;
+		double toDouble() const;
+		std::wstring toString() const;
+
+		BigNumber operator- () const;
+
+		static int compare(const BigNumber& left, const BigNumber& right);
+		static BigNumber add(const BigNumber& left, const BigNumber& right);
+		static BigNumber sub(const BigNumber& left, const BigNumber& right);
+		static BigNumber mul(const BigNumber& left, const BigNumber& right);
+		static void divmod(const BigNumber& left, const BigNumber& right, BigNumber* const quotient, BigNumber* const remainder);
+	};
+
+
+
+	/* Arbitrary precision integer, a Klang integer like Integer and LongInteger. Only
+	   values that do not fit in Int64 are kept as BigInt, results are narrowed back. */
+	class BigInt : public Value
+	{
+	private:
+		UInt32* _limbs;
+		const size_t _size;
+		const bool _negative;
+
+	public:
+		BigInt(const BigNumber& value);
+		~BigInt();
+
+		BigNumber number() const;
+		inline bool negative() const { return _negative; }
+
+	public: //To c++ conversions
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+		operator std::wstring() const override;
+
+	public: //Common operators
+		Value* klang_operatorEquals(Value* value) override;
+		Value* klang_operatorNotEquals(Value* value) override;
+		Value* klang_operatorGreater(Value* value) override;
+		Value* klang_operatorLess(Value* value) override;
+		Value* klang_operatorGreaterEquals(Value* value) override;
+		Value* klang_operatorLessEquals(Value* value) override;
+		Value* klang_operatorNot() override;
+
+	public: //Math operators
+		Value* klang_operatorPlus(Value* value) override;
+		Value* klang_operatorMinus(Value* value) override;
+		Value* klang_operatorMultiply(Value* value) override;
+		Value* klang_operatorDivide(Value* value) override;
+		Value* klang_operatorModule(Value* value) override;
+		Value* klang_operatorIncrease() override;
+		Value* klang_operatorDecrease() override;
+		Value* klang_operatorNegative() override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+	/* Narrowest integer Value holding the number: Integer, LongInteger or BigInt. */
+	Value* newIntegral(const BigNumber& value);
+}
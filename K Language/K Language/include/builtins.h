@@ -0,0 +1,58 @@
+#pragma once
+
+#include "array.h"
+#include "simd.h"
+
+/* Bulk operations over whole arrays. Integer and Double arrays are processed on their
+   packed elements by the simd numeric kernels. Other kinds, mixed operands and integer
+   overflows go element by element through the tagged operators, giving what the
+   equivalent interpreted loop would. Binary operations on two arrays expect equal sizes. */
+namespace klang::builtin
+{
+	/* Plain integer 0 for an empty array. Doubles are summed by the simd lanes, which
+	   may round differently from a left to right loop. */
+	type::Tagged sum(const type::Array& array);
+	type::Tagged dot(const type::Array& left, const type::Array& right);
+
+	/* Undefined for an empty array. */
+	type::Tagged min(const type::Array& array);
+	type::Tagged max(const type::Array& array);
+
+	/* New array of left[i] op right[i], or of left[i] op right for a single value. */
+	type::Array* apply(const simd::Arithmetic op, const type::Array& left, const type::Array& right);
+	type::Array* apply(const simd::Arithmetic op, const type::Array& left, const type::Tagged right);
+
+	/* New array of the comparison results, a Boolean one for numeric operands. */
+	type::Array* compare(const simd::Comparison op, const type::Array& left, const type::Array& right);
+	type::Array* compare(const simd::Comparison op, const type::Array& left, const type::Tagged right);
+
+	/* New array of the elements whose mask element is true. */
+	type::Array* filter(const type::Array& array, const type::Array& mask);
+
+
+
+	/* Strict weak ordering of two elements, replacing the Less operator. */
+	typedef bool (*Comparator)(const type::Tagged left, const type::Tagged right, void* const ctx);
+
+	/* Returned by binarySearch() when no element matches. */
+	constexpr size_t NotFound = static_cast<size_t>(-1);
+
+	/* Ascending sort in place. Without a comparator, Integer and Double arrays are radix
+	   sorted (doubles in IEEE total order: -0 before 0, NaNs at the end of their sign),
+	   Boolean arrays counted and arrays of strings radix sorted on their first characters;
+	   large ones are split across the thread pool and merged in parallel. These orders are
+	   stable. Any other array, or any comparator, goes through a stable merge sort on the
+	   calling thread, which stays in bounds even when the comparator is not a strict weak
+	   ordering (the order is then unspecified). The comparator must not modify the array. */
+	void sort(type::Array& array, Comparator less = nullptr, void* const ctx = nullptr);
+	void stableSort(type::Array& array, Comparator less = nullptr, void* const ctx = nullptr);
+
+	/* Drops every element equal to the one before it, returns the new size. */
+	size_t unique(type::Array& array);
+
+	/* On an array sorted for the same ordering: index of the first element not before
+	   value, of the first one after value, and of one equivalent to value. */
+	size_t lowerBound(const type::Array& array, const type::Tagged value, Comparator less = nullptr, void* const ctx = nullptr);
+	size_t upperBound(const type::Array& array, const type::Tagged value, Comparator less = nullptr, void* const ctx = nullptr);
+	size_t binarySearch(const type::Array& array, const type::Tagged value, Comparator less = nullptr, void* const ctx = nullptr);
+}
@@ -7,44 +7,125 @@ extern "C" {
 
 	#include <stdlib.h>
 
+	#define HEAP_SIZE_CLASS_COUNT 8
+	#define HEAP_SLAB_SIZE 4096
+	#define HEAP_CHUNK_SIZE (1024 * 1024)
+	#define HEAP_LARGE_OBJECT_SIZE (64 * 1024)
+
+	#define HF_FREE 0x1
+	#define HF_OBJECT 0x2
+	#define HF_FORWARDED 0x4
+	#define HF_STATIC 0x8
+	#define HF_ZCT 0x10
+	#define HF_ROOTED 0x20
+	#define HF_LARGE 0x40
+	#define HF_REMEMBERED 0x80
+
+	#define HEAP_MAX_REFS 0xFFFFFF
+
+	/* One word per block: GC flags, block size (header included) in 8 byte words and the
+	   reference counter. Blocks are walked in address order, free cells keep their free
+	   list link in the first payload word. */
 	typedef struct __private_heap_header {
 
-		struct __private_heap_header* next;
-		struct __private_heap_header* prev;
-		size_t size;
-		unsigned int refs;
+		unsigned long long flags : 8;
+		unsigned long long words : 32;
+		unsigned long long refs : 24;
 
 	} __private_heap_header;
 
+	/* Large objects get their own page mapping, linked in a list per heap. The standard
+	   header stays right before the payload, so counters and flags work as usual. Size is
+	   the committed part of the mapping, reserved its whole address range. */
+	typedef struct __private_heap_large {
+
+		struct __private_heap_large* prev;
+		struct __private_heap_large* next;
+		size_t size;
+		size_t reserved;
+		__private_heap_header header;
+
+	} __private_heap_large;
+
 	typedef struct {
 
 		int is_static;
+		int is_sealed;
 		size_t capacity;
+		size_t soft_limit;
+		size_t limit;
+		size_t reserved;
 		size_t used;
-		__private_heap_header* last;
+		size_t top;
+		__private_heap_header* free_classes[HEAP_SIZE_CLASS_COUNT];
+		__private_heap_header* free_large;
+		__private_heap_large* large_objects;
+		__private_heap_large** large_index;
+		size_t large_count;
+		size_t large_capacity;
+		size_t large_used;
 		void* data;
 
 	} __private_heap;
 
+	typedef struct {
+
+		size_t capacity;
+		size_t top;
+		void* data;
+
+	} __private_nursery;
+
+	typedef void (*klangh_SlotVisitor)(void** const slot, void* const ctx);
 
-	int klangh_CreateHeap(__private_heap* const heap, const size_t size, const int is_static);
+	typedef struct {
+
+		void (*finalize)(void* const ptr);
+		void (*trace)(void* const ptr, klangh_SlotVisitor visitor, void* const ctx);
+		void (*roots)(klangh_SlotVisitor visitor, void* const ctx);
+		void (*weak)(klangh_SlotVisitor visitor, void* const ctx); /* Updated on moves, never marked */
+
+	} __private_heap_gc_hooks;
+
+
+	int klangh_CreateHeap(__private_heap* const heap, const size_t size, const size_t limit, const int is_static);
 	int klangh_DestroyHeap(__private_heap* const heap);
 
+	int klangh_SetLimits(__private_heap* const heap, const size_t soft_limit, const size_t limit);
+	int klangh_Grow(__private_heap* const heap, const size_t size);
+	int klangh_Trim(__private_heap* const heap);
+	int klangh_Seal(__private_heap* const heap);
+	int klangh_IsInHeap(const __private_heap* const heap, const void* const ptr);
+
 	int klangh_Malloc(__private_heap* const heap, const size_t size, void** const ptr);
 	int klangh_Free(__private_heap* const heap, void* const ptr);
+	int klangh_Realloc(__private_heap* const heap, void** const ptr, const size_t size);
+
+	int klangh_MarkObject(void* const ptr);
 
 	int klangh_GetHeader(const void* const ptr, __private_heap_header** const header);
 	int klangh_IncreaseReferenceCounter(void* const ptr);
 	int klangh_DecreaseReferenceCounter(void* const ptr);
 
-	int klangh_RunGarbageCollector(__private_heap* const heap);
+	int klangh_RunGarbageCollector(__private_heap* const heap, const __private_heap_gc_hooks* const hooks);
+	int klangh_CollectCycles(__private_heap* const heap, const __private_heap_gc_hooks* const hooks);
+
+
+	int klangh_CreateNursery(__private_nursery* const nursery, const size_t size);
+	int klangh_DestroyNursery(__private_nursery* const nursery);
+
+	int klangh_NurseryMalloc(__private_nursery* const nursery, const size_t size, void** const ptr);
+	int klangh_IsInNursery(const __private_nursery* const nursery, const void* const ptr);
+
+	int klangh_MinorCollect(__private_nursery* const nursery, __private_heap* const heap, const __private_heap_gc_hooks* const hooks);
 
 
 	enum heap_status
 	{
 		HS_OK = 0,
 		HS_CANNOT_CREATE = -1,
-		HS_HEAP_OVERFLOW = -2
+		HS_HEAP_OVERFLOW = -2,
+		HS_OUT_OF_MEMORY = -3
 	};
 
 #ifdef __cplusplus
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "types.h"
+#include "tagged.h"
+#include "array.h"
+
+namespace klang::type
+{
+	/* Double ended sequence of tagged values. The first InlineCapacity elements live in
+	   the object itself, so a small list costs a single allocation. Past that they move to
+	   a ring of fixed size chunks on the Klang heap, indexed through a map of chunk
+	   pointers: pushes and pops at both ends are O(1) amortized and growth only copies the
+	   map. Up to SpareChunks chunks emptied by pops are kept for the next pushes. */
+	class List : public Value
+	{
+	public:
+		static constexpr size_t InlineCapacity = 4;
+		static constexpr size_t ChunkCapacity = 64;
+		static constexpr size_t MinChunks = 4;
+		static constexpr size_t SpareChunks = 2;
+
+	private:
+		mutable bool _writing;
+		size_t _size;
+
+		/* Ring position of the first element, below _chunks * ChunkCapacity. */
+		size_t _start;
+
+		/* Map entries (a power of two) and chunks allocated in it. */
+		size_t _chunks;
+		size_t _allocated;
+		Tagged** _map;
+
+		Tagged _inline[InlineCapacity];
+
+	public:
+		List();
+		~List();
+
+	private:
+		static Tagged* allocateChunk();
+		static void releaseChunk(Tagged* const chunk);
+
+		Tagged* slot(const size_t index) const;
+		Tagged* reserveSlot(const size_t position);
+		size_t usedChunks() const;
+
+		void spill();
+		void growMap();
+		void dropChunk(const size_t position);
+
+		void retain(const Tagged value);
+
+	public:
+		inline size_t size() const { return _size; }
+		inline bool empty() const { return !_size; }
+
+		/* Element at index, undefined past the end. */
+		Tagged get(const size_t index) const;
+
+		/* Storing past the end fills the gap with undefined. */
+		void set(const size_t index, const Tagged value);
+
+		void pushBack(const Tagged value);
+		void pushFront(const Tagged value);
+
+		/* Removed element, undefined when empty. The list no longer counts it: the caller
+		   must store or root it before the next safepoint. */
+		Tagged popBack();
+		Tagged popFront();
+
+		inline Tagged front() const { return get(0); }
+		inline Tagged back() const { return _size ? get(_size - 1) : Tagged::undefined(); }
+
+		/* Drops every element and the chunks, back to the inline storage. */
+		void clear();
+
+	public: //To c++ conversions
+		/* Numbers convert to the length, booleans test for emptiness. */
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+		operator std::wstring() const override;
+		operator ValueVector() const override;
+		void writeTo(TextSink& sink) const override;
+
+	public: //Array/List operators
+		Value* klang_operatorArrayGet(Value* index) override;
+		void klang_operatorArraySet(Value* index, Value* value) override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+	inline List* newList() { return heap::create<List>(); }
+}
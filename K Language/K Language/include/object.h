@@ -0,0 +1,211 @@
+#pragma once
+
+#include "types.h"
+#include "tagged.h"
+
+namespace klang::type
+{
+	/* Ordered property names shared along a chain of shapes: a shape sees the first
+	   size() names of its table. Only the shape holding every name of the table (the last
+	   one of the chain) appends to it, a shape branching off earlier copies its prefix.
+	   Past ScanMaxCount names a hash index on the string hash finds them. */
+	class ShapeTable : public Value
+	{
+	public:
+		static constexpr size_t ScanMaxCount = 8;
+
+	private:
+		size_t _count;
+		size_t _capacity;
+		String** _names;
+		size_t _indexSize;
+		UInt32* _index;
+
+	public:
+		ShapeTable();
+		ShapeTable(const ShapeTable* const table, const size_t count);
+		~ShapeTable();
+
+	private:
+		static size_t IndexSize(const size_t capacity);
+
+		void reserve(const size_t capacity);
+		void buildIndex(const size_t size);
+		void insert(const size_t slot);
+
+	public:
+		inline size_t size() const { return _count; }
+		inline String* name(const size_t slot) const { return _names[slot]; }
+
+		/* Slot of an interned name among the first count ones, Shape::NotFound if absent. */
+		size_t find(const String* const name, const size_t count) const;
+
+		void append(String* const name);
+
+	public: //To c++ conversions
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+
+
+	/* Hidden class of objects: the ordered property names of every object built by adding
+	   the same names in the same order. Shapes form a transition tree from the root shape
+	   of the isolate, so objects built alike share one shape and find a property at the
+	   same slot. Names are interned strings, compared by address, kept in a table shared
+	   along the chain. An object growing past DictionaryMinCount properties leaves the
+	   tree for a dictionary shape of its own, which takes further names in place.
+	   Shapes are heap values for the collector only, they never reach scripts. Tree shapes
+	   live as long as the isolate, dictionary shapes as long as their object. */
+	class Shape : public Value
+	{
+	public:
+		static constexpr size_t NotFound = static_cast<size_t>(-1);
+		static constexpr size_t DictionaryMinCount = 64;
+
+	private:
+		struct Transition
+		{
+			String* name;
+			Shape* shape;
+		};
+
+		const UInt32 _id;
+		size_t _count;
+		const bool _dictionary;
+		Shape* _parent;
+		ShapeTable* _table;
+		size_t _transitionCount;
+		size_t _transitionCapacity;
+		Transition* _transitions;
+
+	public:
+		Shape();
+		Shape(Shape* const parent, String* const name);
+
+		/* Dictionary shape with a private copy of the names of another shape. */
+		explicit Shape(const Shape* const shape);
+		~Shape();
+
+	private:
+		static ShapeTable* TableFor(const Shape* const shape);
+
+	public:
+		/* Unique for the process and kept when the collector moves the shape, unlike its
+		   address: caches key on it. A dictionary shape keeps its id while it grows, the
+		   slots it had stay valid. */
+		inline UInt32 id() const { return _id; }
+		inline size_t size() const { return _count; }
+		inline bool dictionary() const { return _dictionary; }
+		inline Shape* parent() const { return _parent; }
+		inline String* name(const size_t slot) const { return _table->name(slot); }
+
+		/* Slot of an interned name, NotFound if this shape has none. */
+		inline size_t find(const String* const name) const { return _table ? _table->find(name, _count) : NotFound; }
+
+		/* Shape of the objects of this one given one more property, created once. A
+		   dictionary shape belongs to a single object and takes the name in place. */
+		Shape* with(String* const name);
+
+		/* Empty shape of the current isolate, every object starts from it. */
+		static Shape* root();
+
+	public: //To c++ conversions
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+
+
+	/* Memo of one property access site: the shape last seen there and the slot of the
+	   property in it. Zero initialized means empty, no shape has id 0. */
+	struct PropertyCache
+	{
+		UInt32 shape = 0;
+		UInt32 slot = 0;
+	};
+
+	/* Object with properties in slots laid out by its shape: the first InlineSlots in the
+	   object itself, the others in a heap buffer. A lookup returns a slot valid for every
+	   object of the same shape, which a PropertyCache keeps so that repeated accesses only
+	   compare the shape id before reading the slot. Past Shape::DictionaryMinCount
+	   properties the object gets a dictionary shape of its own, caches keep working on it.
+	   Properties cannot be removed. */
+	class Object : public Value
+	{
+	public:
+		static constexpr size_t InlineSlots = 4;
+
+	private:
+		mutable bool _writing;
+		Shape* _shape;
+		size_t _capacity;
+		Tagged* _overflow;
+		Tagged _inline[InlineSlots];
+
+	public:
+		Object();
+		~Object();
+
+	private:
+		inline Tagged* slot(const size_t index) const { return index < InlineSlots ? const_cast<Tagged*>(_inline) + index : _overflow + (index - InlineSlots); }
+
+		void retain(const Tagged value);
+
+		/* Slot the value was stored at, adding the property when missing. */
+		size_t store(String* const name, const Tagged value);
+		Tagged getMissed(const String* const name, PropertyCache& cache) const;
+
+	public:
+		inline const Shape& shape() const { return *_shape; }
+		inline size_t size() const { return _shape->size(); }
+
+		/* Slot of the property named by an interned string, Shape::NotFound if absent. */
+		inline size_t lookup(const String* const name) const { return _shape->find(name); }
+		inline Tagged getSlot(const size_t index) const { return *slot(index); }
+		void setSlot(const size_t index, const Tagged value);
+
+		/* Undefined for a missing property. The name must be interned. */
+		Tagged get(const String* const name) const;
+		inline Tagged get(const String* const name, PropertyCache& cache) const
+		{
+			return cache.shape == _shape->id() ? *slot(cache.slot) : getMissed(name, cache);
+		}
+
+		/* Adds the property when missing. The name is interned first. */
+		void set(String* const name, const Tagged value);
+		void set(String* const name, const Tagged value, PropertyCache& cache);
+
+	public: //To c++ conversions
+		/* Numbers convert to the property count, booleans test for emptiness. */
+		operator Int32() const override;
+		operator Int64() const override;
+		operator float() const override;
+		operator double() const override;
+		operator bool() const override;
+		operator std::wstring() const override;
+		operator ValueMap() const override;
+		void writeTo(TextSink& sink) const override;
+
+	public: //Object operators
+		Value* klang_operatorGetProperty(const std::string& name) override;
+		void klang_operatorGetProperty(const std::string& name, Value* value) override;
+
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+	};
+
+	inline Object* newObject() { return heap::create<Object>(); }
+}
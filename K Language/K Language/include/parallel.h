@@ -0,0 +1,25 @@
+#pragma once
+
+#include "utils.h"
+
+/* Process wide pool of worker threads for data parallel builtins, started on first use.
+   Tasks work on native buffers only: they must not throw nor touch the Klang heap, which
+   belongs to the isolate of the calling thread. */
+namespace klang::parallel
+{
+	typedef void (*Task)(const size_t index, void* const ctx);
+
+	/* Threads taking part in run(), the calling one included. */
+	size_t concurrency();
+
+	/* Runs task(i, ctx) for every i below count and returns once all are done. The calling
+	   thread takes part. A call made from a task, or while another thread is running a
+	   job, runs all of its tasks on the calling thread. */
+	void run(const size_t count, Task task, void* const ctx);
+
+	template<typename _Function>
+	inline void run(const size_t count, const _Function& function)
+	{
+		run(count, [](const size_t index, void* const ctx) { (*reinterpret_cast<const _Function*>(ctx))(index); }, const_cast<_Function*>(&function));
+	}
+}
@@ -3,38 +3,222 @@
 #include <vcruntime.h>
 #include <type_traits>
 
+#include "utils.h"
+
+namespace klang::type { class Value; }
+
 namespace klang::heap
 {
+	typedef void (*SlotVisitor)(void** const slot, void* const ctx);
+
 	void* malloc(const size_t size);
 	void free(void* const ptr);
+	void* realloc(void* const ptr, const size_t size);
 	void gc();
+	void gc_cycles();
+
+	void mark_object(void* const ptr);
 
 	void incref(void* const ptr);
 	void decref(void* const ptr);
+	void release(const void* const ptr);
+	void reclaim();
 
+	/* Immortal read-only region for constants: objects in it are recognized by address
+	   and never see reference counting. s_reserve() sizes it ahead of a constant pool,
+	   s_seal() write protects it once startup is done and disables s_malloc(). */
 	void* s_malloc(const size_t size);
+	bool s_reserve(const size_t size);
+	bool s_seal();
+	bool is_immortal(const void* const ptr);
+
+	void* y_malloc(const size_t size);
+	bool is_young(const void* const ptr);
+	void write_barrier(const void* const owner, const void* const value);
+	void minor_gc();
+
+	/* Runs the collections allocation only marks as due: a minor collection once the
+	   nursery is full, a reclaim of the zero count table, cycle collection. Young objects
+	   move and unrooted ones with no count are freed, so callers hold no raw pointer that
+	   is not rooted. Stack register writes and the Ref operators are safepoints. */
+	void safepoint();
+
+	/* Interned objects of the current isolate (see type::String::intern), looked up by
+	   hash and an equality callback. The table holds them weakly: an object lives as long
+	   as it is referenced, its finalizer removes its entry, compaction updates the entry
+	   in place. Young objects cannot be interned. */
+	typedef bool (*InternMatcher)(const void* const object, const void* const key);
+	void* find_interned(const size_t hash, InternMatcher matches, const void* const key);
+	void add_interned(const size_t hash, void* const object);
+	void remove_interned(const size_t hash, const void* const object);
+
+	/* Empty object shape of the current isolate (see type::Shape::root), null until it is
+	   first needed. A collector root, it keeps every shape of the tree alive. */
+	void* root_shape();
+	void set_root_shape(void* const shape);
+
+	bool set_limits(const size_t softLimit, const size_t hardLimit);
 
 	size_t capacity();
 	size_t used();
 
+	/* Tagged values (see type::Tagged) hold heap pointers untouched, with the upper 16 bits
+	   clear and above the small immediate constants. */
+	inline bool is_tagged_pointer(const UInt64 bits) { return !(bits >> 48) && bits > 0x0F; }
+
+
+
+	class HeapOverflowException : public KlangException
+	{
+	public:
+		HeapOverflowException(const size_t size) noexcept;
+	};
+
+
+
+	/* Independent interpreter memory: default heap, nursery, roots and collector state.
+	   Only the immortal region is shared. The heap functions above work on the isolate
+	   entered by the calling thread (see Isolate::Scope), or on the main isolate when the
+	   thread entered none. An isolate must only be entered by one thread at a time, which
+	   also makes its nursery an uncontended per-thread allocation buffer. */
+	class Isolate
+	{
+	public:
+		struct State;
+
+	private:
+		State* const _state;
+
+	public:
+		Isolate();
+		~Isolate();
+
+		Isolate(const Isolate&) = delete;
+		Isolate& operator= (const Isolate&) = delete;
+
+		inline State* state() const { return _state; }
+
+		static Isolate& main();
+		static Isolate& current();
+
+	public:
+		class Scope
+		{
+		private:
+			State* const _previous;
+
+		public:
+			explicit Scope(Isolate& isolate) noexcept;
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator= (const Scope&) = delete;
+		};
+	};
+
+
+
+	/* Pointer slots living outside the heap (Ref values, stack registers). The moving
+	   collector rewrites every registered slot after compaction. Storing a young value
+	   must go through barrier() so the minor collection finds the slot. Root slots do not
+	   count as references: a value they drop must be passed to release() instead.
+	   Slots may also be tagged values, only those holding a pointer are visited.
+	   Root sets belong to the isolate current at construction and must be destroyed
+	   within it. */
+	class RootSet
+	{
+		friend struct Isolate::State;
 
+	private:
+		RootSet* _prev;
+		RootSet* _next;
+		void** const _slots;
+		const size_t _count;
+		const bool _tagged;
+		size_t _remembered;
+
+		RootSet() noexcept;
+
+	public:
+		RootSet(void** const slots, const size_t count) noexcept;
+		RootSet(UInt64* const slots, const size_t count) noexcept;
+		~RootSet();
+
+		RootSet(const RootSet&) = delete;
+		RootSet& operator= (const RootSet&) = delete;
+
+		inline void barrier(const void* const value)
+		{
+			if (!_remembered && is_young(value))
+				remember();
+		}
+
+		void visit(SlotVisitor visitor, void* const ctx);
+
+	private:
+		void remember();
+
+	public:
+		static void visitAll(SlotVisitor visitor, void* const ctx);
+		static void visitRemembered(SlotVisitor visitor, void* const ctx);
+		static void forgetRemembered();
+	};
+
+
+
+	/* Values are flagged as heap objects only once fully constructed, so a collection
+	   triggered from inside a constructor never traces a half built object. */
+	template<class _Ty>
+	inline _Ty* created(_Ty* const ptr)
+	{
+		if constexpr (std::is_base_of<klang::type::Value, _Ty>::value)
+			klang::heap::mark_object(ptr);
+		return ptr;
+	}
 
 	template<class _Ty>
 	inline _Ty* create()
 	{
 		_Ty* ptr = reinterpret_cast<_Ty*>(klang::heap::malloc(sizeof(_Ty)));
-		if (ptr)
-			::new(ptr) _Ty();
-		return ptr;
+		if (!ptr)
+			throw HeapOverflowException{ sizeof(_Ty) };
+
+		::new(ptr) _Ty();
+		return created(ptr);
 	}
 
 	template<class _Ty, typename _Arg0>
 	inline _Ty* create(const _Arg0& arg0)
 	{
 		_Ty* ptr = reinterpret_cast<_Ty*>(klang::heap::malloc(sizeof(_Ty)));
-		if (ptr)
-			::new(ptr) _Ty(arg0);
-		return ptr;
+		if (!ptr)
+			throw HeapOverflowException{ sizeof(_Ty) };
+
+		::new(ptr) _Ty(arg0);
+		return created(ptr);
+	}
+
+	template<class _Ty, typename _Arg0, typename _Arg1>
+	inline _Ty* create(const _Arg0& arg0, const _Arg1& arg1)
+	{
+		_Ty* ptr = reinterpret_cast<_Ty*>(klang::heap::malloc(sizeof(_Ty)));
+		if (!ptr)
+			throw HeapOverflowException{ sizeof(_Ty) };
+
+		::new(ptr) _Ty(arg0, arg1);
+		return created(ptr);
+	}
+
+	/* Young allocation for short lived values without native resources (numbers). */
+	template<class _Ty, typename _Arg0>
+	inline _Ty* create_young(const _Arg0& arg0)
+	{
+		_Ty* ptr = reinterpret_cast<_Ty*>(klang::heap::y_malloc(sizeof(_Ty)));
+		if (!ptr)
+			throw HeapOverflowException{ sizeof(_Ty) };
+
+		::new(ptr) _Ty(arg0);
+		return created(ptr);
 	}
 
 	template<class _Ty>
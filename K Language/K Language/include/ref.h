@@ -1,28 +1,34 @@
 #pragma once
 
 #include "types.h"
+#include "tagged.h"
 
 namespace klang
 {
 	class Ref
 	{
 	private:
-		klang::type::Value* _value;
+		klang::type::Tagged _value;
+		heap::RootSet _root{ reinterpret_cast<UInt64*>(&_value), 1 };
 
 	public:
-		constexpr Ref() noexcept : _value{ type::constant::Undefined } {}
+		Ref() noexcept : _value{} {}
+		Ref(const klang::type::Tagged value) noexcept;
 		Ref(klang::type::Value* value) noexcept;
 		Ref(const klang::type::Value* value) noexcept;
 		Ref(const Ref& ref) noexcept;
 		Ref(Ref&& ref) noexcept;
 		~Ref();
 
+		Ref& operator= (const klang::type::Tagged value) noexcept;
 		Ref& operator= (klang::type::Value* value) noexcept;
 		Ref& operator= (const Ref& ref) noexcept;
 		Ref& operator= (Ref&& ref) noexcept;
 
 		klang::type::Value::Type type() const;
 
+		inline klang::type::Tagged tagged() const { return _value; }
+
 		operator klang::type::Value* () const;
 		operator const klang::type::Value* () const;
 
@@ -36,22 +42,16 @@ namespace klang
 		class ArrayAccessor
 		{
 		private:
-			klang::type::Value* const _value;
-			klang::type::Value* const _index;
+			const klang::type::Tagged _container;
+			const klang::type::Tagged _index;
 
 		public:
-			constexpr ArrayAccessor(klang::type::Value* const value, klang::type::Value* const index) :
-				_value{ value ? value : klang::type::constant::Undefined },
-				_index{ index ? index : klang::type::constant::Undefined }
-			{}
-			constexpr ArrayAccessor(const klang::type::Value* const value, const klang::type::Value* const index) :
-				ArrayAccessor{ const_cast<klang::type::Value*>(value), const_cast<klang::type::Value*>(index) }
-			{}
-			inline ArrayAccessor(klang::type::Value* const value, const size_t index) :
-				ArrayAccessor{ value, klang::type::newLongInteger(static_cast<Int64>(index)) }
+			constexpr ArrayAccessor(const klang::type::Tagged container, const klang::type::Tagged index) noexcept :
+				_container{ container },
+				_index{ index }
 			{}
-			inline ArrayAccessor(const klang::type::Value* const value, const size_t index) :
-				ArrayAccessor{ const_cast<klang::type::Value*>(value), klang::type::newLongInteger(static_cast<Int64>(index)) }
+			inline ArrayAccessor(const klang::type::Tagged container, const size_t index) :
+				ArrayAccessor{ container, klang::type::Tagged::fromInteger(static_cast<Int64>(index)) }
 			{}
 
 			ArrayAccessor(const ArrayAccessor&) = delete;
@@ -59,18 +59,18 @@ namespace klang
 
 			inline ArrayAccessor& operator= (klang::type::Value* const value)
 			{
-				return _value->klang_operatorArraySet(_index, value), *this;
+				return klang::type::klang_operatorArraySet(_container, _index, value), *this;
 			}
 			inline ArrayAccessor& operator= (Ref& value)
 			{
-				return _value->klang_operatorArraySet(_index, value), * this;
+				return klang::type::klang_operatorArraySet(_container, _index, value.tagged()), *this;
 			}
 			inline ArrayAccessor& operator= (Ref&& value)
 			{
-				return _value->klang_operatorArraySet(_index, value), * this;
+				return klang::type::klang_operatorArraySet(_container, _index, value.tagged()), *this;
 			}
 
-			inline operator Ref() const { return const_cast<klang::type::Value*>(_value)->klang_operatorArrayGet(_index); }
+			inline operator Ref() const { return klang::type::klang_operatorArrayGet(_container, _index); }
 		};
 
 		Ref::ArrayAccessor operator[] (const size_t index);
@@ -138,128 +138,137 @@ std::wostream& operator<< (std::wostream& os, const klang::Ref& ref);
 
 
 
+namespace klang
+{
+	/* Roots the result of an operator, then runs a safepoint (see heap::safepoint): the
+	   operators below are safepoints, their operands are Refs and stay valid. */
+	Ref operatorResult(const klang::type::Tagged result);
+}
+
+
+
 template<typename _Ty>
-inline klang::Ref operator== (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorEquals(klang::Ref{ value }); }
+inline klang::Ref operator== (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator== (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorEquals(klang::Ref{ value }); }
+inline klang::Ref operator== (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator== (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorEquals(klang::Ref{ value }); }
+inline klang::Ref operator== (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator== (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorEquals(klang::Ref{ value }); }
-inline klang::Ref operator== (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorEquals(ref1); }
+inline klang::Ref operator== (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator== (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorEquals(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator!= (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorNotEquals(klang::Ref{ value }); }
+inline klang::Ref operator!= (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorNotEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator!= (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorNotEquals(klang::Ref{ value }); }
+inline klang::Ref operator!= (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorNotEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator!= (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorNotEquals(klang::Ref{ value }); }
+inline klang::Ref operator!= (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorNotEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator!= (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorNotEquals(klang::Ref{ value }); }
-inline klang::Ref operator!= (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorNotEquals(ref1); }
+inline klang::Ref operator!= (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorNotEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator!= (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorNotEquals(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator> (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorGreater(klang::Ref{ value }); }
+inline klang::Ref operator> (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorGreater(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator> (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorGreater(klang::Ref{ value }); }
+inline klang::Ref operator> (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorGreater(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator> (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorGreater(klang::Ref{ value }); }
+inline klang::Ref operator> (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorGreater(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator> (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorGreater(klang::Ref{ value }); }
-inline klang::Ref operator> (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorGreater(ref1); }
+inline klang::Ref operator> (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorGreater(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator> (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorGreater(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator< (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorLess(klang::Ref{ value }); }
+inline klang::Ref operator< (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorLess(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator< (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorLess(klang::Ref{ value }); }
+inline klang::Ref operator< (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorLess(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator< (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorLess(klang::Ref{ value }); }
+inline klang::Ref operator< (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorLess(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator< (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorLess(klang::Ref{ value }); }
-inline klang::Ref operator< (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorLess(ref1); }
+inline klang::Ref operator< (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorLess(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator< (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorLess(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator>= (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorGreaterEquals(klang::Ref{ value }); }
+inline klang::Ref operator>= (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorGreaterEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator>= (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorGreaterEquals(klang::Ref{ value }); }
+inline klang::Ref operator>= (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorGreaterEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator>= (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorGreaterEquals(klang::Ref{ value }); }
+inline klang::Ref operator>= (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorGreaterEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator>= (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorGreaterEquals(klang::Ref{ value }); }
-inline klang::Ref operator>= (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorGreaterEquals(ref1); }
+inline klang::Ref operator>= (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorGreaterEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator>= (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorGreaterEquals(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator<= (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorLessEquals(klang::Ref{ value }); }
+inline klang::Ref operator<= (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorLessEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator<= (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorLessEquals(klang::Ref{ value }); }
+inline klang::Ref operator<= (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorLessEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator<= (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorLessEquals(klang::Ref{ value }); }
+inline klang::Ref operator<= (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorLessEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator<= (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorLessEquals(klang::Ref{ value }); }
-inline klang::Ref operator<= (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorLessEquals(ref1); }
+inline klang::Ref operator<= (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorLessEquals(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator<= (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorLessEquals(ref0.tagged(), ref1.tagged())); }
 
-inline klang::Ref operator! (klang::Ref& ref) { return ref->klang_operatorNot(); }
-inline klang::Ref operator! (klang::Ref&& ref) { return ref->klang_operatorNot(); }
+inline klang::Ref operator! (klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorNot(ref.tagged())); }
+inline klang::Ref operator! (klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorNot(ref.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator+ (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorPlus(klang::Ref{ value }); }
+inline klang::Ref operator+ (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorPlus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator+ (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorPlus(klang::Ref{ value }); }
+inline klang::Ref operator+ (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorPlus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator+ (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorPlus(klang::Ref{ value }); }
+inline klang::Ref operator+ (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorPlus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator+ (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorPlus(klang::Ref{ value }); }
-inline klang::Ref operator+ (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorPlus(ref1); }
+inline klang::Ref operator+ (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorPlus(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator+ (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorPlus(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator- (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorMinus(klang::Ref{ value }); }
+inline klang::Ref operator- (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorMinus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator- (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorMinus(klang::Ref{ value }); }
+inline klang::Ref operator- (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorMinus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator- (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorMinus(klang::Ref{ value }); }
+inline klang::Ref operator- (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorMinus(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator- (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorMinus(klang::Ref{ value }); }
-inline klang::Ref operator- (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorMinus(ref1); }
+inline klang::Ref operator- (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorMinus(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator- (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorMinus(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator* (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorMultiply(klang::Ref{ value }); }
+inline klang::Ref operator* (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorMultiply(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator* (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorMultiply(klang::Ref{ value }); }
+inline klang::Ref operator* (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorMultiply(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator* (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorMultiply(klang::Ref{ value }); }
+inline klang::Ref operator* (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorMultiply(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator* (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorMultiply(klang::Ref{ value }); }
-inline klang::Ref operator* (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorMultiply(ref1); }
+inline klang::Ref operator* (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorMultiply(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator* (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorMultiply(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator/ (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorDivide(klang::Ref{ value }); }
+inline klang::Ref operator/ (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorDivide(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator/ (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorDivide(klang::Ref{ value }); }
+inline klang::Ref operator/ (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorDivide(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator/ (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorDivide(klang::Ref{ value }); }
+inline klang::Ref operator/ (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorDivide(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator/ (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorDivide(klang::Ref{ value }); }
-inline klang::Ref operator/ (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorDivide(ref1); }
+inline klang::Ref operator/ (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorDivide(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator/ (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorDivide(ref0.tagged(), ref1.tagged())); }
 
 template<typename _Ty>
-inline klang::Ref operator% (klang::Ref& ref, const _Ty& value) { return ref->klang_operatorModule(klang::Ref{ value }); }
+inline klang::Ref operator% (klang::Ref& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorModule(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator% (klang::Ref&& ref, const _Ty& value) { return ref->klang_operatorModule(klang::Ref{ value }); }
+inline klang::Ref operator% (klang::Ref&& ref, const _Ty& value) { return klang::operatorResult(klang::type::klang_operatorModule(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator% (const _Ty& value, klang::Ref& ref) { return ref->klang_operatorModule(klang::Ref{ value }); }
+inline klang::Ref operator% (const _Ty& value, klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorModule(ref.tagged(), klang::Ref{ value }.tagged())); }
 template<typename _Ty>
-inline klang::Ref operator% (const _Ty& value, klang::Ref&& ref) { return ref->klang_operatorModule(klang::Ref{ value }); }
-inline klang::Ref operator% (klang::Ref& ref0, klang::Ref& ref1) { return ref0->klang_operatorModule(ref1); }
+inline klang::Ref operator% (const _Ty& value, klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorModule(ref.tagged(), klang::Ref{ value }.tagged())); }
+inline klang::Ref operator% (klang::Ref& ref0, klang::Ref& ref1) { return klang::operatorResult(klang::type::klang_operatorModule(ref0.tagged(), ref1.tagged())); }
 
-inline klang::Ref operator++ (klang::Ref& ref) { return ref = ref->klang_operatorIncrease(); }
-inline klang::Ref operator++ (klang::Ref&& ref) { return ref = ref->klang_operatorIncrease(); }
-inline klang::Ref operator++ (klang::Ref& ref, int) { klang::Ref res = ref; return ref = ref->klang_operatorIncrease(), res; }
-inline klang::Ref operator++ (klang::Ref&& ref, int) { klang::Ref res = ref; return ref = ref->klang_operatorIncrease(), res; }
+inline klang::Ref operator++ (klang::Ref& ref) { return ref = klang::operatorResult(klang::type::klang_operatorIncrease(ref.tagged())); }
+inline klang::Ref operator++ (klang::Ref&& ref) { return ref = klang::operatorResult(klang::type::klang_operatorIncrease(ref.tagged())); }
+inline klang::Ref operator++ (klang::Ref& ref, int) { klang::Ref res = ref; return ref = klang::operatorResult(klang::type::klang_operatorIncrease(ref.tagged())), res; }
+inline klang::Ref operator++ (klang::Ref&& ref, int) { klang::Ref res = ref; return ref = klang::operatorResult(klang::type::klang_operatorIncrease(ref.tagged())), res; }
 
-inline klang::Ref operator-- (klang::Ref& ref) { return ref = ref->klang_operatorDecrease(); }
-inline klang::Ref operator-- (klang::Ref&& ref) { return ref = ref->klang_operatorDecrease(); }
-inline klang::Ref operator-- (klang::Ref& ref, int) { klang::Ref res = ref; return ref = ref->klang_operatorDecrease(), res; }
-inline klang::Ref operator-- (klang::Ref&& ref, int) { klang::Ref res = ref; return ref = ref->klang_operatorDecrease(), res; }
+inline klang::Ref operator-- (klang::Ref& ref) { return ref = klang::operatorResult(klang::type::klang_operatorDecrease(ref.tagged())); }
+inline klang::Ref operator-- (klang::Ref&& ref) { return ref = klang::operatorResult(klang::type::klang_operatorDecrease(ref.tagged())); }
+inline klang::Ref operator-- (klang::Ref& ref, int) { klang::Ref res = ref; return ref = klang::operatorResult(klang::type::klang_operatorDecrease(ref.tagged())), res; }
+inline klang::Ref operator-- (klang::Ref&& ref, int) { klang::Ref res = ref; return ref = klang::operatorResult(klang::type::klang_operatorDecrease(ref.tagged())), res; }
 
-inline klang::Ref operator- (klang::Ref& ref) { return ref->klang_operatorNegative(); }
-inline klang::Ref operator- (klang::Ref&& ref) { return ref->klang_operatorNegative(); }
+inline klang::Ref operator- (klang::Ref& ref) { return klang::operatorResult(klang::type::klang_operatorNegative(ref.tagged())); }
+inline klang::Ref operator- (klang::Ref&& ref) { return klang::operatorResult(klang::type::klang_operatorNegative(ref.tagged())); }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "utils.h"
+
+/* Vector kernels over raw character units and packed numbers. Every kernel has a scalar
+   version; on x86 the SSE2 or AVX2 one is picked once at startup from the CPU features.
+   Results never depend on the level in use. */
+namespace klang::simd
+{
+	enum class Level : UInt8
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	/* Returned by the search kernels when nothing matches. */
+	constexpr size_t NotFound = static_cast<size_t>(-1);
+
+	/* Best level supported by this CPU, and the one currently used. */
+	Level supported();
+	Level level();
+
+	/* Uses at most the given level (never more than supported()), for benchmarks and
+	   tests. Not thread safe: call it before running scripts. */
+	void limit(const Level level);
+
+	const char* name(const Level level);
+
+	/* Index of the first differing unit, count if equal. */
+	size_t mismatch(const UInt8* const left, const UInt8* const right, const size_t count);
+	size_t mismatch(const char16_t* const left, const char16_t* const right, const size_t count);
+	inline bool equal(const void* const left, const void* const right, const size_t bytes)
+	{
+		return mismatch(reinterpret_cast<const UInt8*>(left), reinterpret_cast<const UInt8*>(right), bytes) == bytes;
+	}
+
+	/* Index of the first occurrence, NotFound if none. An empty needle matches at 0. */
+	size_t find(const UInt8* const haystack, const size_t count, const UInt8 unit);
+	size_t find(const char16_t* const haystack, const size_t count, const char16_t unit);
+	size_t find(const UInt8* const haystack, const size_t count, const UInt8* const needle, const size_t needleCount);
+	size_t find(const char16_t* const haystack, const size_t count, const char16_t* const needle, const size_t needleCount);
+
+	/* Character class scans: index of the first byte at or above 0x80, outside [low, high],
+	   of the first unit above limit, count if none. */
+	size_t findNonAscii(const UInt8* const units, const size_t count);
+	size_t findOutside(const UInt8* const units, const size_t count, const UInt8 low, const UInt8 high);
+	size_t findAbove(const char16_t* const units, const size_t count, const char16_t limit);
+
+	/* Transcoding between unit widths, narrow() expects units up to 0xFF. */
+	void widen(const UInt8* const in, const size_t count, char16_t* const out);
+	void widen(const UInt8* const in, const size_t count, char32_t* const out);
+	void widen(const char16_t* const in, const size_t count, char32_t* const out);
+	void narrow(const char16_t* const in, const size_t count, UInt8* const out);
+
+
+
+	/* Numeric kernels over packed Int64 and double elements. */
+	enum class Arithmetic : UInt8
+	{
+		Add,
+		Subtract,
+		Multiply,
+		Divide
+	};
+
+	enum class Comparison : UInt8
+	{
+		Equal,
+		NotEqual,
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual
+	};
+
+	/* Double reductions keep eight partial sums, element i going to sum i % 8, added up
+	   in a fixed order: they round the same way at every level. Integer kernels return
+	   false instead of wrapping when a partial result overflows. */
+	bool sum(const Int64* const values, const size_t count, Int64* const result);
+	double sum(const double* const values, const size_t count);
+	double dot(const double* const left, const double* const right, const size_t count);
+
+	/* Smallest and largest element, count above zero. A NaN anywhere gives NaN, of two
+	   zeros of different signs either may be returned. */
+	Int64 min(const Int64* const values, const size_t count);
+	Int64 max(const Int64* const values, const size_t count);
+	double min(const double* const values, const size_t count);
+	double max(const double* const values, const size_t count);
+
+	/* out[i] = left[i] op right[i], or left[i] op right for a single right operand. Integer
+	   division is not supported: like an overflow, it returns false with out unspecified. */
+	bool apply(const Arithmetic op, const Int64* const left, const Int64* const right, const size_t count, Int64* const out);
+	bool apply(const Arithmetic op, const Int64* const left, const Int64 right, const size_t count, Int64* const out);
+	void apply(const Arithmetic op, const double* const left, const double* const right, const size_t count, double* const out);
+	void apply(const Arithmetic op, const double* const left, const double right, const size_t count, double* const out);
+
+	/* mask[i] = 1 where left[i] op right[i] holds, 0 elsewhere. */
+	void compare(const Comparison op, const Int64* const left, const Int64* const right, const size_t count, UInt8* const mask);
+	void compare(const Comparison op, const Int64* const left, const Int64 right, const size_t count, UInt8* const mask);
+	void compare(const Comparison op, const double* const left, const double* const right, const size_t count, UInt8* const mask);
+	void compare(const Comparison op, const double* const left, const double right, const size_t count, UInt8* const mask);
+
+	/* Copies the 64 bit elements with a non zero mask byte to out in order and returns
+	   their count. out may be values. */
+	size_t compress(const UInt64* const values, const UInt8* const mask, const size_t count, UInt64* const out);
+}
@@ -2,6 +2,7 @@
 
 #include "utils.h"
 #include "types.h"
+#include "tagged.h"
 
 namespace klang { class Ref; }
 
@@ -13,7 +14,7 @@ namespace klang::stack
 	typedef UInt32		 Long;
 	typedef UInt64		 Quad;
 	typedef type::Value* Reference;
-	typedef Reference    Register;
+	typedef type::Tagged Register;
 
 
 
@@ -27,35 +28,43 @@ namespace klang::stack
 
 	};
 
+	/* Registers are collector roots. Pushing and setting a register is a safepoint (see
+	   heap::safepoint): a value popped or read from the stack must be stored back or
+	   rooted before the next push or set, the nursery may move it or reclaim free it. */
 	struct Stack
 	{
 		Register* const regs;
 		const Byte capacity;
 		Byte size;
+		heap::RootSet roots;
 
 		Stack(const Byte capacity);
 		~Stack();
 
+		void push_value(const type::Tagged value);
 		void push_value(type::Value* const value);
 		void push_value(const klang::Ref& value);
 
 		klang::type::Value* pop_value();
+		type::Tagged pop_tagged();
 
 		template<typename _Ty>
 		void push(const _Ty& value) {}
 
 
+		void set(const Byte index, const type::Tagged value);
 		void set(const Byte index, klang::type::Value* value);
 
 		klang::type::Value* get(const Byte index) const;
+		type::Tagged get_tagged(const Byte index) const;
 
 
 	public:
 		inline void push(type::Value* const value) { push_value(value); }
 		inline void push(const klang::Ref& value) { push_value(value); }
 
-		template<> void push<Int32>(const Int32& value) { push_value(type::newInteger(value)); }
-		template<> void push<UInt32>(const UInt32& value) { push_value(type::newInteger(static_cast<Int32>(value))); }
+		template<> void push<Int32>(const Int32& value) { push_value(type::Tagged::fromInteger(value)); }
+		template<> void push<UInt32>(const UInt32& value) { push_value(type::Tagged::fromInteger(static_cast<Int32>(value))); }
 
 	public:
 		template<Byte _Index>
@@ -63,7 +72,7 @@ namespace klang::stack
 		{
 			return _Index >= capacity
 				? type::constant::Undefined
-				: regs[_Index] ? regs[_Index] : type::constant::Undefined;
+				: regs[_Index].box();
 		}
 	};
 }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "types.h"
+
+namespace klang::type
+{
+	/* 64 bit value that keeps numbers, booleans and undefined inline and only points to
+	   heap Values for everything else:
+	     - pointers are stored untouched, upper 16 bits clear (heap slots stay GC visible)
+	     - 0x06 false, 0x07 true, 0x0A undefined (0 also reads as undefined)
+	     - doubles are stored with 2^49 added to their bits
+	     - integers fitting in 48 bits are stored under the 0xFFFF tag
+	   Integers out of that range are boxed as LongInteger, or as BigInt past 64 bits. */
+	class Tagged
+	{
+	private:
+		UInt64 _bits;
+
+		static constexpr UInt64 IntegerTag = 0xFFFF000000000000ULL;
+		static constexpr UInt64 DoubleOffset = 1ULL << 49;
+		static constexpr UInt64 FalseBits = 0x06;
+		static constexpr UInt64 TrueBits = 0x07;
+		static constexpr UInt64 UndefinedBits = 0x0A;
+
+		static constexpr Int64 MinInteger = -(1LL << 47);
+		static constexpr Int64 MaxInteger = (1LL << 47) - 1;
+
+		constexpr explicit Tagged(const UInt64 bits, int) noexcept : _bits{ bits } {}
+
+	public:
+		constexpr Tagged() noexcept : _bits{ UndefinedBits } {}
+		Tagged(Value* const value) noexcept;
+		Tagged(const Tagged&) noexcept = default;
+		Tagged& operator= (const Tagged&) noexcept = default;
+
+		static Tagged fromInteger(const Int64 value);
+		static Tagged fromDouble(const double value) noexcept;
+		static constexpr Tagged fromBoolean(const bool value) noexcept { return Tagged{ value ? TrueBits : FalseBits, 0 }; }
+		static constexpr Tagged undefined() noexcept { return Tagged{}; }
+
+	public: //Tag tests
+		inline bool isPointer() const { return heap::is_tagged_pointer(_bits); }
+		inline bool isInteger() const { return (_bits & IntegerTag) == IntegerTag; }
+		inline bool isDouble() const { return _bits >= DoubleOffset && !isInteger(); }
+		inline bool isNumber() const { return _bits >= DoubleOffset; }
+		inline bool isBoolean() const { return _bits == TrueBits || _bits == FalseBits; }
+		inline bool isUndefined() const { return _bits == UndefinedBits || !_bits; }
+
+		Value::Type type() const;
+
+	public: //Raw access, only valid after the matching tag test
+		inline Value* pointer() const { return isPointer() ? reinterpret_cast<Value*>(static_cast<uintptr_t>(_bits)) : nullptr; }
+		inline Int64 integer() const { return static_cast<Int64>(_bits << 16) >> 16; }
+		double number() const;
+		inline bool boolean() const { return _bits == TrueBits; }
+
+		inline UInt64 bits() const { return _bits; }
+		inline bool operator== (const Tagged& other) const { return _bits == other._bits; }
+		inline bool operator!= (const Tagged& other) const { return _bits != other._bits; }
+
+	public: //To c++ conversions
+		operator Int32() const;
+		operator Int64() const;
+		operator float() const;
+		operator double() const;
+		operator bool() const;
+		operator std::wstring() const;
+		void writeTo(TextSink& sink) const;
+
+		/* Heap Value for this value, allocating a young number for inline numbers. */
+		Value* box() const;
+	};
+
+
+
+	//Common operators
+	Tagged klang_operatorEquals(const Tagged left, const Tagged right);
+	Tagged klang_operatorNotEquals(const Tagged left, const Tagged right);
+	Tagged klang_operatorGreater(const Tagged left, const Tagged right);
+	Tagged klang_operatorLess(const Tagged left, const Tagged right);
+	Tagged klang_operatorGreaterEquals(const Tagged left, const Tagged right);
+	Tagged klang_operatorLessEquals(const Tagged left, const Tagged right);
+	Tagged klang_operatorNot(const Tagged value);
+
+	//Math operators
+	Tagged klang_operatorPlus(const Tagged left, const Tagged right);
+	Tagged klang_operatorMinus(const Tagged left, const Tagged right);
+	Tagged klang_operatorMultiply(const Tagged left, const Tagged right);
+	Tagged klang_operatorDivide(const Tagged left, const Tagged right);
+	Tagged klang_operatorModule(const Tagged left, const Tagged right);
+	Tagged klang_operatorIncrease(const Tagged value);
+	Tagged klang_operatorDecrease(const Tagged value);
+	Tagged klang_operatorNegative(const Tagged value);
+
+	//bit operators
+	Tagged klang_operatorBitwiseLeft(const Tagged left, const Tagged right);
+	Tagged klang_operatorBitwiseRight(const Tagged left, const Tagged right);
+	Tagged klang_operatorBitwiseAnd(const Tagged left, const Tagged right);
+	Tagged klang_operatorBitwiseOr(const Tagged left, const Tagged right);
+	Tagged klang_operatorBitwiseXor(const Tagged left, const Tagged right);
+	Tagged klang_operatorBitwiseNot(const Tagged value);
+
+	//Array/List operators
+	/* Arrays and strings indexed by an inline integer are served without boxing. */
+	Tagged klang_operatorArrayGet(const Tagged container, const Tagged index);
+	void klang_operatorArraySet(const Tagged container, const Tagged index, const Tagged value);
+}
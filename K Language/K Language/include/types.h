@@ -33,6 +33,43 @@ namespace klang::type
 
 
 
+	/* Destination of Value::writeTo(): takes the text of values in pieces, so printing
+	   does not build a std::wstring per value. Narrow text is Latin-1. */
+	class TextSink
+	{
+	public:
+		virtual ~TextSink() = default;
+
+		virtual void write(const char* const text, const size_t size) = 0;
+		virtual void write(const wchar_t* const text, const size_t size) = 0;
+	};
+
+	class WStreamSink : public TextSink
+	{
+	private:
+		std::wostream& _stream;
+
+	public:
+		WStreamSink(std::wostream& stream) : _stream{ stream } {}
+
+		void write(const char* const text, const size_t size) override;
+		void write(const wchar_t* const text, const size_t size) override;
+	};
+
+	class WStringSink : public TextSink
+	{
+	private:
+		std::wstring& _text;
+
+	public:
+		WStringSink(std::wstring& text) : _text{ text } {}
+
+		void write(const char* const text, const size_t size) override;
+		void write(const wchar_t* const text, const size_t size) override;
+	};
+
+
+
 	class Variadic
 	{
 	protected:
@@ -49,7 +86,7 @@ namespace klang::type
 	class Value : public Variadic
 	{
 	public:
-		enum class Type
+		enum class Type : UInt8
 		{
 			Undefined,
 
@@ -67,14 +104,22 @@ namespace klang::type
 
 			List,
 
-			Object
+			Object,
+
+			/* Runtime bookkeeping kept on the heap (object shapes), never seen by scripts. */
+			Internal
 		};
 
 	public:
 		const Type type;
+
+		/* Set by BigInt only, so integer arithmetic tells it apart by value. Fits with the
+		   type in the padding after the vtable pointer. */
+		const bool bigInt;
 		
 	protected:
-		constexpr Value(const Type type) noexcept : type{ type } {};
+		constexpr Value(const Type type) noexcept : type{ type }, bigInt{ false } {};
+		constexpr Value(const Type type, const bool bigInt) noexcept : type{ type }, bigInt{ bigInt } {};
 
 	public:
 		virtual ~Value() = default;
@@ -92,6 +137,9 @@ namespace klang::type
 		virtual operator ValueVector() const;
 		virtual operator ValueMap() const;
 
+		/* Same text as the std::wstring conversion. */
+		virtual void writeTo(TextSink& sink) const;
+
 	public: //Common operators
 		virtual Value* klang_operatorEquals(Value* value);
 		virtual Value* klang_operatorNotEquals(Value* value);
@@ -137,6 +185,9 @@ namespace klang::type
 		virtual Value* klang_operatorHasNext();
 		virtual Value* klang_operatorNext();
 
+	public: //Heap hooks
+		virtual void trace(heap::SlotVisitor visitor, void* const ctx);
+
 	public:
 		inline bool isUndefined() { return type == Type::Undefined; }
 		inline bool isInteger() { return type == Type::Integer; }
@@ -189,6 +240,7 @@ namespace klang::type
 		operator double() const override;
 		operator bool() const override;
 		operator std::wstring() const override;
+		void writeTo(TextSink& sink) const override;
 
 		Value* klang_operatorNot() override;
 
@@ -218,6 +270,7 @@ namespace klang::type
 		operator double() const override;
 		operator bool() const override;
 		operator std::wstring() const override;
+		void writeTo(TextSink& sink) const override;
 
 	public: //Common operators
 		Value* klang_operatorEquals(Value* value) override;
@@ -259,6 +312,23 @@ namespace klang::type
 
 
 
+	// INTEGER PROMOTION //
+	/* Integer + - * / % never wrap nor narrow: results take the smallest of Integer,
+	   LongInteger and BigInt (see bigint.h) holding them. Bitwise operators and shifts
+	   work on Int64 and wrap like it. */
+	Value* newIntegral(const Int64 value);
+	inline bool isBigInt(const Value* const value) { return value->bigInt; }
+	int integralCompare(const Int64 left, Value* const right);
+	Value* integralPlus(const Int64 left, const Int64 right);
+	Value* integralPlus(const Int64 left, Value* const right);
+	Value* integralMinus(const Int64 left, const Int64 right);
+	Value* integralMinus(const Int64 left, Value* const right);
+	Value* integralMultiply(const Int64 left, Value* const right);
+	Value* integralDivide(const Int64 left, Value* const right);
+	Value* integralModule(const Int64 left, Value* const right);
+
+
+
 	// GENERIC NUMBER //
 	namespace
 	{
@@ -268,31 +338,33 @@ namespace klang::type
 		template<Value::Type _ValueType, typename _NativeType>
 		__Number<_ValueType, _NativeType>* newnum(const _NativeType value)
 		{
-			return heap::create<__Number<_ValueType, _NativeType>>(value);
+			return heap::create_young<__Number<_ValueType, _NativeType>>(value);
 		}
 
 		template<Value::Type _ValueType, typename _NativeType>
 		__Number<_ValueType, _NativeType>* newnum(const Int32 value)
 		{
-			return heap::create<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
+			return heap::create_young<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
 		}
 
 		template<Value::Type _ValueType, typename _NativeType>
-		__Number<_ValueType, _NativeType>* newnum(const Int64 value)
+		Value* newnum(const Int64 value)
 		{
-			return heap::create<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
+			if constexpr (_ValueType == Value::Type::Integer)
+				return newIntegral(value);
+			else return heap::create_young<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
 		}
 
 		template<Value::Type _ValueType, typename _NativeType>
 		__Number<_ValueType, _NativeType>* newnum(const float value)
 		{
-			return heap::create<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
+			return heap::create_young<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
 		}
 
 		template<Value::Type _ValueType, typename _NativeType>
 		__Number<_ValueType, _NativeType>* newnum(const double value)
 		{
-			return heap::create<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
+			return heap::create_young<__Number<_ValueType, _NativeType>>(static_cast<_NativeType>(value));
 		}
 
 		template<Value::Type _ValueType, typename _NativeType>
@@ -316,7 +388,12 @@ namespace klang::type
 			operator float() const override { return static_cast<float>(_value); }
 			operator double() const override { return static_cast<double>(_value); }
 			operator bool() const override { return static_cast<bool>(_value); }
-			operator std::wstring() const override { return std::to_wstring(_value); }
+			operator std::wstring() const override { return numberToWString(_value); }
+			void writeTo(TextSink& sink) const override
+			{
+				char buffer[NumberTextSize];
+				sink.write(buffer, formatNumber(_value, buffer));
+			}
 
 		public: //Common operators
 			Value* klang_operatorEquals(Value* value) override
@@ -329,7 +406,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) == static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) == static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) == 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) == static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -344,7 +421,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) != static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) != static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) != 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) != static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -359,7 +436,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) > static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) > static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) > 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) > static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -374,7 +451,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) < static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) < static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) < 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) < static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -389,7 +466,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) >= static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) >= static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) >= 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) >= static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -404,7 +481,7 @@ namespace klang::type
 						case Type::Float:
 							return static_cast<double>(_value) <= static_cast<double>(*value) ? Boolean::True : Boolean::False;
 						case Type::Integer:
-							return static_cast<Int64>(_value) <= static_cast<Int64>(*value) ? Boolean::True : Boolean::False;
+							return integralCompare(static_cast<Int64>(_value), value) <= 0 ? Boolean::True : Boolean::False;
 					}
 				}
 				else return static_cast<double>(_value) <= static_cast<double>(*value) ? Boolean::True : Boolean::False;
@@ -422,7 +499,7 @@ namespace klang::type
 						case Type::Float:
 							return CREATE(static_cast<double>(_value) + static_cast<double>(*value));
 						case Type::Integer:
-							return CREATE(static_cast<Int64>(_value) + static_cast<Int64>(*value));
+							return integralPlus(static_cast<Int64>(_value), value);
 					}
 				}
 				else return CREATE(static_cast<double>(_value) + static_cast<double>(*value));
@@ -437,7 +514,7 @@ namespace klang::type
 					case Type::Float:
 						return CREATE(static_cast<double>(_value) - static_cast<double>(*value));
 					case Type::Integer:
-						return CREATE(static_cast<Int64>(_value) - static_cast<Int64>(*value));
+						return integralMinus(static_cast<Int64>(_value), value);
 					}
 				}
 				else return CREATE(static_cast<double>(_value) - static_cast<double>(*value));
@@ -452,7 +529,7 @@ namespace klang::type
 					case Type::Float:
 						return CREATE(static_cast<double>(_value) * static_cast<double>(*value));
 					case Type::Integer:
-						return CREATE(static_cast<Int64>(_value) * static_cast<Int64>(*value));
+						return integralMultiply(static_cast<Int64>(_value), value);
 					}
 				}
 				else return CREATE(static_cast<double>(_value) * static_cast<double>(*value));
@@ -467,26 +544,34 @@ namespace klang::type
 					case Type::Float:
 						return CREATE(static_cast<double>(_value) / static_cast<double>(*value));
 					case Type::Integer:
-						return CREATE(static_cast<Int64>(_value) / static_cast<Int64>(*value));
+						return integralDivide(static_cast<Int64>(_value), value);
 					}
 				}
 				else return CREATE(static_cast<double>(_value) / static_cast<double>(*value));
 			}
 			Value* klang_operatorModule(Value* value) override
 			{
-				return CREATE(static_cast<Int64>(_value) % static_cast<Int64>(*value));
+				if constexpr (_ValueType == Type::Integer)
+					return integralModule(static_cast<Int64>(_value), value);
+				else return CREATE(static_cast<Int64>(_value) % static_cast<Int64>(*value));
 			}
 			Value* klang_operatorIncrease() override
 			{
-				return CREATE(_value + 1);
+				if constexpr (_ValueType == Type::Integer)
+					return integralPlus(static_cast<Int64>(_value), 1);
+				else return CREATE(_value + 1);
 			}
 			Value* klang_operatorDecrease() override
 			{
-				return CREATE(_value - 1);
+				if constexpr (_ValueType == Type::Integer)
+					return integralMinus(static_cast<Int64>(_value), 1);
+				else return CREATE(_value - 1);
 			}
 			Value* klang_operatorNegative() override
 			{
-				return CREATE(-_value);
+				if constexpr (_ValueType == Type::Integer)
+					return integralMinus(0, static_cast<Int64>(_value));
+				else return CREATE(-_value);
 			}
 
 		public: //bit operators
@@ -531,23 +616,156 @@ namespace klang::type
 	typedef __Number<Value::Type::Float, float> Float;
 	typedef __Number<Value::Type::Float, double> Double;
 
-	inline Integer* newInteger(const Int32 value) { return heap::create<Integer>(value); }
-	inline LongInteger* newLongInteger(const Int64 value) { return heap::create<LongInteger>(value); }
-	inline Float* newFloat(const float value) { return heap::create<Float>(value); }
-	inline Double* newDouble(const double value) { return heap::create<Double>(value); }
+	inline Integer* newInteger(const Int32 value) { return heap::create_young<Integer>(value); }
+	inline LongInteger* newLongInteger(const Int64 value) { return heap::create_young<LongInteger>(value); }
+	inline Float* newFloat(const float value) { return heap::create_young<Float>(value); }
+	inline Double* newDouble(const double value) { return heap::create_young<Double>(value); }
 
 
 
+	/* Immutable string stored in the narrowest encoding holding all its characters: one
+	   byte (Latin-1), two bytes (UCS-2) or UTF-8 for characters past the BMP, the later
+	   with a sparse index for random access. Equal strings always get the same encoding,
+	   so equality is a byte compare, after the lengths and cached hashes. Interned strings
+	   are unique per isolate and compare by pointer. std::wstring conversions are kept as
+	   shims. */
 	class String : public Value
 	{
+	public:
+		enum class Encoding : UInt8
+		{
+			Latin1,
+			UCS2,
+			UTF8
+		};
+
+		/* Characters between two UTF-8 index entries. */
+		static constexpr size_t UTF8IndexStep = 64;
+
+		/* Shorter concatenations are copied, longer ones make a rope. */
+		static constexpr size_t RopeMinLength = 32;
+
+		/* Shorter substrings are copied, longer ones share their parent buffer. */
+		static constexpr size_t SliceMinLength = 16;
+
+		static constexpr size_t NotFound = static_cast<size_t>(-1);
+
+		/* Number found at the start of a string, see numeric(). */
+		enum class Numeric : UInt8
+		{
+			Unparsed,
+			None,
+			Integer,
+			Real
+		};
+
 	private:
-		wchar_t* const _value;
-		const size_t _size;
+		enum class Kind : UInt8
+		{
+			Flat,
+			Rope,
+			Slice
+		};
+
+		const Encoding _encoding;
+		bool _interned;
+		mutable Kind _kind;
+		mutable Numeric _numeric;
+		const size_t _length;
+		mutable size_t _bytes;
+		mutable size_t _hash;
+		union
+		{
+			mutable Int64 _integer;
+			mutable double _real;
+		};
+
+		/* A flat string owns the buffer in _data. A rope keeps its left part in _data and
+		   its right part in _right until the first access to its characters flattens it
+		   in place. A slice keeps its flat parent in _data and the byte offset of its
+		   first character in _offset. */
+		mutable void* _data;
+		union
+		{
+			mutable String* _right;
+			size_t _offset;
+		};
+
+		/* Immortal one character strings for the ASCII range. */
+		static String* const* const AsciiCharacters;
 
 	public:
 		String(const std::wstring& value);
 		~String();
 
+	private:
+		String(const Encoding encoding, const size_t length, const size_t bytes);
+		String(String* const left, String* const right);
+		String(String* const parent, const size_t offset, const size_t length);
+		String(void* const buffer, const UInt8 ascii);
+
+		/* Heap String with an uninitialized buffer, filled by the caller. */
+		static String* allocate(const Encoding encoding, const size_t length, const size_t bytes);
+		static String* const* createAsciiCharacters();
+		void buildIndex();
+
+		void flatten() const;
+		void* resolve() const;
+		inline void* chars() const { return _kind == Kind::Flat ? _data : resolve(); }
+
+		String* copy(const size_t start, const size_t length) const;
+
+	public:
+		inline Encoding encoding() const { return _encoding; }
+		inline size_t size() const { return _length; }
+		inline size_t bytes() const { chars(); return _bytes; }
+		inline bool interned() const { return _interned; }
+		inline bool rope() const { return _kind == Kind::Rope; }
+		inline bool sliced() const { return _kind == Kind::Slice; }
+
+		/* Hash of the character codes, computed once. */
+		size_t hash() const;
+
+		inline const UInt8* latin1() const { return reinterpret_cast<const UInt8*>(chars()); }
+		inline const char16_t* ucs2() const { return reinterpret_cast<const char16_t*>(chars()); }
+		inline const UInt8* utf8() const { return reinterpret_cast<const UInt8*>(chars()); }
+
+		/* Character code at index, index below size(). */
+		UInt32 at(const size_t index) const;
+
+		int compare(const String& other) const;
+		int compare(const std::wstring& other) const;
+		bool equals(const String& other) const;
+
+		/* Amortized O(1) for long strings: the result is a rope over both sides. */
+		String* concat(const String& other) const;
+
+		/* Characters [start, start + length), start + length at most size(). Long Latin-1
+		   and UCS-2 results share this string's buffer and keep it alive. */
+		String* slice(const size_t start, const size_t length) const;
+
+		/* Number at the start of the string after blanks, read like std::stod in the C
+		   locale but decimal only and without exceptions. Parsed once and cached. */
+		Numeric numeric() const;
+		bool toInteger(Int64* const value) const;
+		bool toReal(double* const value) const;
+
+		/* Index of the first occurrence of needle at or after from, NotFound if none. */
+		size_t indexOf(const String& needle, const size_t from = 0) const;
+		inline bool contains(const String& needle) const { return indexOf(needle) != NotFound; }
+
+		/* One character string, without allocating for ASCII. */
+		static String* character(const UInt32 code);
+
+		/* Unique string of the current isolate with these contents, this one if none was
+		   interned yet. The intern table does not keep strings alive: an unreferenced one
+		   is freed like any other and a later intern() creates it again. */
+		String* intern();
+		static String* intern(const std::wstring& value);
+
+		/* Interned string with these contents, nullptr if there is none. Never allocates. */
+		static String* findInterned(const std::wstring& value);
+
 	public: //To c++ conversions
 		operator Int32() const override;
 		operator Int64() const override;
@@ -555,6 +773,7 @@ namespace klang::type
 		operator double() const override;
 		operator bool() const override;
 		operator std::wstring() const override;
+		void writeTo(TextSink& sink) const override;
 
 	public: //Common operators
 		Value* klang_operatorEquals(Value* value) override;
@@ -571,6 +790,9 @@ namespace klang::type
 	public: //Array/List operators
 		virtual Value* klang_operatorArrayGet(Value* index) override;
 
+	public: //Heap hooks
+		void trace(heap::SlotVisitor visitor, void* const ctx) override;
+
 	public:
 		static void* operator new(size_t size) = delete;
 		static void* operator new(size_t size, const std::wstring& str);
@@ -578,14 +800,6 @@ namespace klang::type
 	};
 
 	inline String* newString(const std::wstring& value) { return heap::create<String>(value); }
-
-
-
-
-	/*class Array : public Value
-	{
-
-	};*/
 }
 
 
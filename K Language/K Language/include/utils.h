@@ -4,6 +4,10 @@
 #include <string>
 #include <exception>
 
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
 namespace klang
 {
 	typedef std::int8_t Int8;
@@ -22,6 +26,64 @@ namespace klang
 	typedef UInt64 Quad;
 }
 
+namespace klang
+{
+	/* Checked Int64 arithmetic: returns true when the exact result does not fit. */
+	inline bool addOverflow(const Int64 left, const Int64 right, Int64* const result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_add_overflow(left, right, result);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) + static_cast<UInt64>(right));
+		return ((left ^ *result) & (right ^ *result)) < 0;
+#endif
+	}
+
+	inline bool subOverflow(const Int64 left, const Int64 right, Int64* const result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_sub_overflow(left, right, result);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) - static_cast<UInt64>(right));
+		return ((left ^ right) & (left ^ *result)) < 0;
+#endif
+	}
+
+	inline bool mulOverflow(const Int64 left, const Int64 right, Int64* const result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_mul_overflow(left, right, result);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		Int64 high;
+		*result = _mul128(left, right, &high);
+		return high != (*result >> 63);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) * static_cast<UInt64>(right));
+		return left && ((left == -1 && right == INT64_MIN) || *result / left != right);
+#endif
+	}
+}
+
+namespace klang
+{
+	/* Number text for output: integers in decimal, reals as the shortest text reading
+	   back as the same value (std::to_chars, Ryu based), "nan" and "inf" included.
+	   formatNumber() writes to a buffer of NumberTextSize chars and returns the length. */
+	constexpr size_t NumberTextSize = 32;
+
+	size_t formatNumber(const Int32 value, char* const buffer);
+	size_t formatNumber(const Int64 value, char* const buffer);
+	size_t formatNumber(const float value, char* const buffer);
+	size_t formatNumber(const double value, char* const buffer);
+
+	template<typename _NumberType>
+	inline std::wstring numberToWString(const _NumberType value)
+	{
+		char buffer[NumberTextSize];
+		return std::wstring(buffer, buffer + formatNumber(value, buffer));
+	}
+}
+
 namespace klang
 {
 	class KlangException : public std::exception
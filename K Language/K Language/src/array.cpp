@@ -0,0 +1,311 @@
+#include "array.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace klang::type
+{
+	IndexException::IndexException(const Int64 index) noexcept :
+		KlangException{ "Klang array index " + std::to_string(index) + " is out of range." }
+	{}
+}
+
+
+
+// ARRAY //
+namespace klang::type
+{
+	typedef Array::Kind Kind;
+
+	Array::Array() :
+		Value{ Type::Array },
+		_kind{ Kind::Integer },
+		_writing{ false },
+		_size{ 0 },
+		_reserved{ 0 },
+		_data{ nullptr }
+	{}
+	Array::Array(const size_t size, const Tagged fill) :
+		Array{}
+	{
+		_kind = KindOf(fill);
+		if (!size)
+			return;
+
+		reallocate(size * ElementSize(_kind));
+		switch (_kind)
+		{
+			case Kind::Integer: std::fill_n(integers(), size, static_cast<Int64>(fill)); break;
+			case Kind::Double: std::fill_n(doubles(), size, fill.number()); break;
+			case Kind::Boolean: std::memset(_data, fill.boolean(), size); break;
+			case Kind::Boxed:
+				std::fill_n(reinterpret_cast<Tagged*>(_data), size, fill);
+				if (Value* const pointer = fill.pointer())
+				{
+					for (size_t i = 0; i < size; ++i)
+						heap::incref(pointer);
+					heap::write_barrier(this, pointer);
+				}
+				break;
+		}
+		_size = size;
+	}
+	Array::~Array()
+	{
+		if (_kind == Kind::Boxed)
+			for (size_t i = 0; i < _size; ++i)
+				if (Value* const pointer = values()[i].pointer())
+					heap::decref(pointer);
+
+		if (_data)
+		{
+			heap::decref(_data);
+			heap::free(_data);
+		}
+	}
+
+	/* Boxed integers that fit in Int64 are unboxed into integer arrays, only BigInts
+	   need the generic store. */
+	Kind Array::KindOf(const Tagged value)
+	{
+		if (value.isInteger())
+			return Kind::Integer;
+		if (value.isDouble())
+			return Kind::Double;
+		if (value.isBoolean())
+			return Kind::Boolean;
+		if (value.isPointer() && value.pointer()->type == Type::Integer && !isBigInt(value.pointer()))
+			return Kind::Integer;
+		return Kind::Boxed;
+	}
+
+	size_t Array::ElementSize(const Kind kind) { return kind == Kind::Boolean ? sizeof(UInt8) : sizeof(UInt64); }
+
+	void Array::reallocate(const size_t bytes)
+	{
+		void* const data = heap::realloc(_data, bytes);
+		if (!data)
+			throw heap::HeapOverflowException{ bytes };
+
+		if (!_data)
+			heap::incref(data);
+		_data = data;
+		_reserved = bytes;
+	}
+
+	/* Grows by half the capacity, so an array filled by push() ends close to its size. */
+	void Array::extend(const size_t size)
+	{
+		if (size > capacity())
+			reserve(std::max<size_t>(std::max<size_t>(size, capacity() + capacity() / 2), 8));
+
+		if (_kind == Kind::Boxed)
+			std::fill(reinterpret_cast<Tagged*>(_data) + _size, reinterpret_cast<Tagged*>(_data) + size, Tagged::undefined());
+		_size = size;
+	}
+
+	/* Integer and double elements are converted in place, booleans move to a buffer of
+	   tagged slots. Integers past the inline range get boxed, each counted like a store. */
+	void Array::generalize()
+	{
+		switch (_kind)
+		{
+			case Kind::Integer:
+				for (size_t i = 0; i < _size; ++i)
+				{
+					const Tagged value = Tagged::fromInteger(integers()[i]);
+					if (Value* const pointer = value.pointer())
+					{
+						heap::incref(pointer);
+						heap::write_barrier(this, pointer);
+					}
+					reinterpret_cast<Tagged*>(_data)[i] = value;
+				}
+				break;
+
+			case Kind::Double:
+				for (size_t i = 0; i < _size; ++i)
+					reinterpret_cast<Tagged*>(_data)[i] = Tagged::fromDouble(doubles()[i]);
+				break;
+
+			case Kind::Boolean: {
+				const size_t count = std::max<size_t>(_reserved, 1);
+				Tagged* const slots = reinterpret_cast<Tagged*>(heap::malloc(count * sizeof(Tagged)));
+				if (!slots)
+					throw heap::HeapOverflowException{ count * sizeof(Tagged) };
+
+				heap::incref(slots);
+				for (size_t i = 0; i < _size; ++i)
+					slots[i] = Tagged::fromBoolean(booleans()[i]);
+				if (_data)
+				{
+					heap::decref(_data);
+					heap::free(_data);
+				}
+				_data = slots;
+				_reserved = count * sizeof(Tagged);
+			} break;
+
+			case Kind::Boxed: return;
+		}
+		_kind = Kind::Boxed;
+	}
+
+	void Array::store(const size_t index, const Tagged value)
+	{
+		switch (_kind)
+		{
+			case Kind::Integer: integers()[index] = static_cast<Int64>(value); break;
+			case Kind::Double: doubles()[index] = value.number(); break;
+			case Kind::Boolean: booleans()[index] = value.boolean(); break;
+			case Kind::Boxed: {
+				Tagged& slot = reinterpret_cast<Tagged*>(_data)[index];
+				Value* const old = slot.pointer();
+				if (Value* const pointer = value.pointer())
+				{
+					heap::incref(pointer);
+					heap::write_barrier(this, pointer);
+				}
+				slot = value;
+				if (old)
+					heap::decref(old);
+			} break;
+		}
+	}
+
+	Tagged Array::get(const size_t index) const
+	{
+		if (index >= _size)
+			return Tagged::undefined();
+
+		switch (_kind)
+		{
+			case Kind::Integer: return Tagged::fromInteger(integers()[index]);
+			case Kind::Double: return Tagged::fromDouble(doubles()[index]);
+			case Kind::Boolean: return Tagged::fromBoolean(booleans()[index]);
+			default: return values()[index];
+		}
+	}
+
+	void Array::set(const size_t index, const Tagged value)
+	{
+		const Kind kind = KindOf(value);
+		if (kind != _kind || index > _size)
+		{
+			if (!_size && !index)
+				_kind = kind;
+			else generalize();
+		}
+
+		if (index >= _size)
+			extend(index + 1);
+		store(index, value);
+	}
+
+	void Array::reserve(const size_t capacity)
+	{
+		if (capacity > this->capacity())
+			reallocate(capacity * ElementSize(_kind));
+	}
+
+	void Array::truncate(const size_t size)
+	{
+		if (size >= _size)
+			return;
+
+		if (_kind == Kind::Boxed)
+			for (size_t i = size; i < _size; ++i)
+				if (Value* const pointer = values()[i].pointer())
+					heap::decref(pointer);
+		_size = size;
+
+		if (size < capacity() / 2)
+			reallocate(std::max<size_t>(size, 1) * ElementSize(_kind));
+	}
+
+	Array* Array::allocate(const Kind kind, const size_t size)
+	{
+		Array* const array = newArray();
+		array->_kind = kind;
+		if (!size)
+			return array;
+
+		array->reallocate(size * ElementSize(kind));
+		if (kind == Kind::Boxed)
+			std::fill_n(reinterpret_cast<Tagged*>(array->_data), size, Tagged::undefined());
+		array->_size = size;
+		return array;
+	}
+
+	Array::operator Int32() const { return static_cast<Int32>(_size); }
+	Array::operator Int64() const { return static_cast<Int64>(_size); }
+	Array::operator float() const { return static_cast<float>(_size); }
+	Array::operator double() const { return static_cast<double>(_size); }
+	Array::operator bool() const { return _size != 0; }
+	Array::operator std::wstring() const
+	{
+		std::wstring text;
+		WStringSink sink{ text };
+		writeTo(sink);
+		return text;
+	}
+	Array::operator ValueVector() const
+	{
+		ValueVector result;
+		result.reserve(_size);
+		for (size_t i = 0; i < _size; ++i)
+			result.push_back(get(i).box());
+		return result;
+	}
+
+	/* An array reached again while it is being written shows as [...]. */
+	void Array::writeTo(TextSink& sink) const
+	{
+		if (_writing)
+			return sink.write("[...]", 5);
+
+		_writing = true;
+		sink.write("[", 1);
+		char buffer[NumberTextSize];
+		for (size_t i = 0; i < _size; ++i)
+		{
+			if (i)
+				sink.write(", ", 2);
+			switch (_kind)
+			{
+				case Kind::Integer: sink.write(buffer, formatNumber(integers()[i], buffer)); break;
+				case Kind::Double: sink.write(buffer, formatNumber(doubles()[i], buffer)); break;
+				case Kind::Boolean: sink.write(booleans()[i] ? "true" : "false", booleans()[i] ? 4 : 5); break;
+				case Kind::Boxed: values()[i].writeTo(sink); break;
+			}
+		}
+		sink.write("]", 1);
+		_writing = false;
+	}
+
+	Value* Array::klang_operatorArrayGet(Value* index)
+	{
+		const Int64 idx = static_cast<Int64>(*index);
+		return idx < 0 ? constant::Undefined : get(static_cast<size_t>(idx)).box();
+	}
+	void Array::klang_operatorArraySet(Value* index, Value* value)
+	{
+		const Int64 idx = static_cast<Int64>(*index);
+		if (idx < 0)
+			throw IndexException{ idx };
+		set(static_cast<size_t>(idx), Tagged{ value });
+	}
+
+	/* Slots are visited before the buffer: compaction rewrites pointers while blocks are
+	   still in place, the buffer address must not change under the loop. */
+	void Array::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		if (_kind == Kind::Boxed)
+			for (size_t i = 0; i < _size; ++i)
+				if (values()[i].isPointer())
+					visitor(reinterpret_cast<void**>(reinterpret_cast<Tagged*>(_data) + i), ctx);
+		if (_data)
+			visitor(&_data, ctx);
+	}
+}
@@ -0,0 +1,670 @@
+#include "bigint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/* Operands shorter than this many limbs are multiplied with the schoolbook kernel. */
+#define KARATSUBA_THRESHOLD 32
+
+/* Decimal conversion works on chunks of 9 digits, the largest power of ten in a limb. */
+#define DECIMAL_CHUNK 1000000000U
+#define DECIMAL_CHUNK_DIGITS 9
+
+
+// Limb kernels //
+namespace klang::type
+{
+	typedef std::vector<UInt32> Limbs;
+
+	static inline void Trim(Limbs& limbs)
+	{
+		while (!limbs.empty() && !limbs.back())
+			limbs.pop_back();
+	}
+
+	static inline int LeadingZeros(UInt32 limb)
+	{
+		int count = 0;
+		for (; !(limb & 0x80000000U); limb <<= 1)
+			++count;
+		return count;
+	}
+
+	/* Both magnitudes without leading zero limbs. */
+	static int CompareMagnitude(const UInt32* const left, const size_t leftSize, const UInt32* const right, const size_t rightSize)
+	{
+		if (leftSize != rightSize)
+			return leftSize < rightSize ? -1 : 1;
+		for (size_t i = leftSize; i-- > 0;)
+			if (left[i] != right[i])
+				return left[i] < right[i] ? -1 : 1;
+		return 0;
+	}
+
+	static Limbs AddMagnitude(const UInt32* left, size_t leftSize, const UInt32* right, size_t rightSize)
+	{
+		if (leftSize < rightSize)
+		{
+			std::swap(left, right);
+			std::swap(leftSize, rightSize);
+		}
+
+		Limbs result(leftSize + 1);
+		UInt64 carry = 0;
+		for (size_t i = 0; i < leftSize; ++i)
+		{
+			carry += static_cast<UInt64>(left[i]) + (i < rightSize ? right[i] : 0);
+			result[i] = static_cast<UInt32>(carry);
+			carry >>= 32;
+		}
+		result[leftSize] = static_cast<UInt32>(carry);
+		Trim(result);
+		return result;
+	}
+
+	/* left - right, left being the larger magnitude. */
+	static Limbs SubMagnitude(const UInt32* const left, const size_t leftSize, const UInt32* const right, const size_t rightSize)
+	{
+		Limbs result(leftSize);
+		Int64 borrow = 0;
+		for (size_t i = 0; i < leftSize; ++i)
+		{
+			const Int64 difference = static_cast<Int64>(left[i]) - (i < rightSize ? right[i] : 0) - borrow;
+			borrow = difference < 0;
+			result[i] = static_cast<UInt32>(difference);
+		}
+		Trim(result);
+		return result;
+	}
+
+	/* value -= other, value not smaller than other (trimmed). */
+	static void SubtractInPlace(Limbs& value, const Limbs& other)
+	{
+		Int64 borrow = 0;
+		for (size_t i = 0; i < value.size() && (borrow || i < other.size()); ++i)
+		{
+			const Int64 difference = static_cast<Int64>(value[i]) - (i < other.size() ? other[i] : 0) - borrow;
+			borrow = difference < 0;
+			value[i] = static_cast<UInt32>(difference);
+		}
+		Trim(value);
+	}
+
+	/* result[0, size) += value, the sum being known to fit. */
+	static void AddInPlace(UInt32* const result, const size_t size, const Limbs& value)
+	{
+		UInt64 carry = 0;
+		for (size_t i = 0; i < size && (carry || i < value.size()); ++i)
+		{
+			carry += static_cast<UInt64>(result[i]) + (i < value.size() ? value[i] : 0);
+			result[i] = static_cast<UInt32>(carry);
+			carry >>= 32;
+		}
+	}
+
+	/* result[0, leftSize + rightSize) = left * right, result zeroed by the caller. */
+	static void MultiplySchoolbook(const UInt32* const left, const size_t leftSize, const UInt32* const right, const size_t rightSize, UInt32* const result)
+	{
+		for (size_t i = 0; i < leftSize; ++i)
+		{
+			const UInt64 limb = left[i];
+			if (!limb)
+				continue;
+
+			UInt64 carry = 0;
+			for (size_t j = 0; j < rightSize; ++j)
+			{
+				carry += limb * right[j] + result[i + j];
+				result[i + j] = static_cast<UInt32>(carry);
+				carry >>= 32;
+			}
+			result[i + rightSize] = static_cast<UInt32>(carry);
+		}
+	}
+
+	/* Karatsuba above the threshold: with x = x1*B^h + x0, x*y = z2*B^2h + z1*B^h + z0 where
+	   z1 = (x0 + x1)(y0 + y1) - z2 - z0, three half size products instead of four. Unbalanced
+	   operands are cut in slices as long as the shorter one. */
+	static void Multiply(const UInt32* left, size_t leftSize, const UInt32* right, size_t rightSize, UInt32* const result)
+	{
+		if (leftSize < rightSize)
+		{
+			std::swap(left, right);
+			std::swap(leftSize, rightSize);
+		}
+
+		if (rightSize < KARATSUBA_THRESHOLD)
+		{
+			MultiplySchoolbook(left, leftSize, right, rightSize, result);
+			return;
+		}
+
+		if (leftSize >= 2 * rightSize)
+		{
+			Limbs partial(2 * rightSize);
+			for (size_t offset = 0; offset < leftSize; offset += rightSize)
+			{
+				const size_t slice = std::min(rightSize, leftSize - offset);
+				std::fill(partial.begin(), partial.end(), 0);
+				Multiply(left + offset, slice, right, rightSize, partial.data());
+				partial.resize(slice + rightSize);
+				AddInPlace(result + offset, leftSize + rightSize - offset, partial);
+				partial.resize(2 * rightSize);
+			}
+			return;
+		}
+
+		const size_t half = leftSize / 2;
+		const Limbs leftSum = AddMagnitude(left, half, left + half, leftSize - half);
+		const Limbs rightSum = AddMagnitude(right, half, right + half, rightSize - half);
+
+		Limbs low(2 * half);
+		Limbs high(leftSize + rightSize - 2 * half);
+		Limbs middle(leftSum.size() + rightSum.size());
+		Multiply(left, half, right, half, low.data());
+		Multiply(left + half, leftSize - half, right + half, rightSize - half, high.data());
+		Multiply(leftSum.data(), leftSum.size(), rightSum.data(), rightSum.size(), middle.data());
+		Trim(low);
+		Trim(high);
+		Trim(middle);
+
+		SubtractInPlace(middle, low);
+		SubtractInPlace(middle, high);
+
+		const size_t size = leftSize + rightSize;
+		AddInPlace(result, size, low);
+		AddInPlace(result + half, size - half, middle);
+		AddInPlace(result + 2 * half, size - 2 * half, high);
+	}
+
+	/* value = value * factor + addend */
+	static void MultiplyAddSmall(Limbs& value, const UInt32 factor, const UInt32 addend)
+	{
+		UInt64 carry = addend;
+		for (UInt32& limb : value)
+		{
+			carry += static_cast<UInt64>(limb) * factor;
+			limb = static_cast<UInt32>(carry);
+			carry >>= 32;
+		}
+		if (carry)
+			value.push_back(static_cast<UInt32>(carry));
+	}
+
+	/* value /= divisor, returns the remainder. */
+	static UInt32 DivideSmall(Limbs& value, const UInt32 divisor)
+	{
+		UInt64 remainder = 0;
+		for (size_t i = value.size(); i-- > 0;)
+		{
+			const UInt64 current = (remainder << 32) | value[i];
+			value[i] = static_cast<UInt32>(current / divisor);
+			remainder = current % divisor;
+		}
+		Trim(value);
+		return static_cast<UInt32>(remainder);
+	}
+
+	/* Knuth's algorithm D on trimmed magnitudes, divisor of two limbs at least. Both
+	   operands are normalized so the top divisor limb has its high bit set, which keeps
+	   each estimated quotient limb at most two off. */
+	static void DivideMagnitude(const Limbs& dividend, const Limbs& divisor, Limbs& quotient, Limbs& remainder)
+	{
+		const size_t n = divisor.size();
+		const size_t m = dividend.size();
+		const int shift = LeadingZeros(divisor.back());
+
+		Limbs v(n);
+		Limbs u(m + 1);
+		for (size_t i = n; i-- > 1;)
+			v[i] = (divisor[i] << shift) | (shift ? divisor[i - 1] >> (32 - shift) : 0);
+		v[0] = divisor[0] << shift;
+		u[m] = shift ? dividend[m - 1] >> (32 - shift) : 0;
+		for (size_t i = m; i-- > 1;)
+			u[i] = (dividend[i] << shift) | (shift ? dividend[i - 1] >> (32 - shift) : 0);
+		u[0] = dividend[0] << shift;
+
+		quotient.assign(m - n + 1, 0);
+		for (size_t j = m - n + 1; j-- > 0;)
+		{
+			const UInt64 numerator = (static_cast<UInt64>(u[j + n]) << 32) | u[j + n - 1];
+			UInt64 estimate = numerator / v[n - 1];
+			UInt64 rest = numerator % v[n - 1];
+			while (estimate > 0xFFFFFFFFULL || estimate * v[n - 2] > ((rest << 32) | u[j + n - 2]))
+			{
+				--estimate;
+				rest += v[n - 1];
+				if (rest > 0xFFFFFFFFULL)
+					break;
+			}
+
+			Int64 borrow = 0;
+			Int64 difference;
+			for (size_t i = 0; i < n; ++i)
+			{
+				const UInt64 product = estimate * v[i];
+				difference = static_cast<Int64>(u[i + j]) - borrow - static_cast<Int64>(product & 0xFFFFFFFFULL);
+				u[i + j] = static_cast<UInt32>(difference);
+				borrow = static_cast<Int64>(product >> 32) - (difference >> 32);
+			}
+			difference = static_cast<Int64>(u[j + n]) - borrow;
+			u[j + n] = static_cast<UInt32>(difference);
+
+			if (difference < 0)
+			{
+				--estimate;
+				UInt64 carry = 0;
+				for (size_t i = 0; i < n; ++i)
+				{
+					carry += static_cast<UInt64>(u[i + j]) + v[i];
+					u[i + j] = static_cast<UInt32>(carry);
+					carry >>= 32;
+				}
+				u[j + n] += static_cast<UInt32>(carry);
+			}
+			quotient[j] = static_cast<UInt32>(estimate);
+		}
+
+		remainder.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			remainder[i] = (u[i] >> shift) | (shift ? u[i + 1] << (32 - shift) : 0);
+		Trim(quotient);
+		Trim(remainder);
+	}
+}
+
+
+
+// BigNumber //
+namespace klang::type
+{
+	BigNumber::BigNumber(const Int64 value) :
+		negative{ value < 0 }
+	{
+		UInt64 magnitude = value < 0 ? 0 - static_cast<UInt64>(value) : static_cast<UInt64>(value);
+		for (; magnitude; magnitude >>= 32)
+			limbs.push_back(static_cast<UInt32>(magnitude));
+	}
+
+	BigNumber BigNumber::parse(const std::wstring& digits)
+	{
+		static constexpr UInt32 Powers[] = { 1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, DECIMAL_CHUNK };
+
+		size_t first = 0;
+		const bool negative = !digits.empty() && digits[0] == L'-';
+		if (!digits.empty() && (digits[0] == L'-' || digits[0] == L'+'))
+			first = 1;
+
+		size_t last = first;
+		while (last < digits.size() && digits[last] >= L'0' && digits[last] <= L'9')
+			++last;
+		if (last == first)
+			throw std::invalid_argument{ "BigNumber::parse" };
+
+		BigNumber result;
+		size_t chunk = (last - first) % DECIMAL_CHUNK_DIGITS;
+		if (!chunk)
+			chunk = DECIMAL_CHUNK_DIGITS;
+		for (size_t i = first; i < last; i += chunk, chunk = DECIMAL_CHUNK_DIGITS)
+		{
+			UInt32 value = 0;
+			for (size_t j = i; j < i + chunk; ++j)
+				value = value * 10 + static_cast<UInt32>(digits[j] - L'0');
+			MultiplyAddSmall(result.limbs, Powers[chunk], value);
+		}
+		Trim(result.limbs);
+		result.negative = negative && !result.isZero();
+		return result;
+	}
+
+	bool BigNumber::fitsInt64() const
+	{
+		if (limbs.size() < 2)
+			return true;
+		if (limbs.size() > 2)
+			return false;
+		const UInt64 magnitude = (static_cast<UInt64>(limbs[1]) << 32) | limbs[0];
+		return magnitude <= static_cast<UInt64>(INT64_MAX) + (negative ? 1 : 0);
+	}
+
+	/* Low 64 bits in two's complement, exact when fitsInt64. */
+	Int64 BigNumber::toInt64() const
+	{
+		UInt64 magnitude = 0;
+		if (limbs.size() > 0)
+			magnitude = limbs[0];
+		if (limbs.size() > 1)
+			magnitude |= static_cast<UInt64>(limbs[1]) << 32;
+		return static_cast<Int64>(negative ? 0 - magnitude : magnitude);
+	}
+
+	/* The three top limbs hold every significant bit of a double. */
+	double BigNumber::toDouble() const
+	{
+		double result = 0;
+		const size_t low = limbs.size() > 3 ? limbs.size() - 3 : 0;
+		for (size_t i = limbs.size(); i-- > low;)
+			result = result * 4294967296.0 + limbs[i];
+		result = std::ldexp(result, static_cast<int>(32 * low));
+		return negative ? -result : result;
+	}
+
+	std::wstring BigNumber::toString() const
+	{
+		if (isZero())
+			return L"0";
+
+		Limbs magnitude = limbs;
+		std::vector<UInt32> chunks;
+		chunks.reserve(limbs.size() * 32 / 29 + 1);
+		while (!magnitude.empty())
+			chunks.push_back(DivideSmall(magnitude, DECIMAL_CHUNK));
+
+		std::wstring result;
+		result.reserve(chunks.size() * DECIMAL_CHUNK_DIGITS + 1);
+		if (negative)
+			result.push_back(L'-');
+		result.append(std::to_wstring(chunks.back()));
+
+		wchar_t buffer[DECIMAL_CHUNK_DIGITS];
+		for (size_t i = chunks.size() - 1; i-- > 0;)
+		{
+			UInt32 chunk = chunks[i];
+			for (size_t digit = DECIMAL_CHUNK_DIGITS; digit-- > 0; chunk /= 10)
+				buffer[digit] = static_cast<wchar_t>(L'0' + chunk % 10);
+			result.append(buffer, DECIMAL_CHUNK_DIGITS);
+		}
+		return result;
+	}
+
+	BigNumber BigNumber::operator- () const
+	{
+		BigNumber result{ *this };
+		result.negative = !negative && !isZero();
+		return result;
+	}
+
+	int BigNumber::compare(const BigNumber& left, const BigNumber& right)
+	{
+		if (left.negative != right.negative)
+			return left.negative ? -1 : 1;
+		const int magnitude = CompareMagnitude(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size());
+		return left.negative ? -magnitude : magnitude;
+	}
+
+	BigNumber BigNumber::add(const BigNumber& left, const BigNumber& right)
+	{
+		BigNumber result;
+		if (left.negative == right.negative)
+		{
+			result.limbs = AddMagnitude(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size());
+			result.negative = left.negative && !result.isZero();
+			return result;
+		}
+
+		const int magnitude = CompareMagnitude(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size());
+		if (!magnitude)
+			return result;
+		if (magnitude > 0)
+		{
+			result.limbs = SubMagnitude(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size());
+			result.negative = left.negative;
+		}
+		else
+		{
+			result.limbs = SubMagnitude(right.limbs.data(), right.limbs.size(), left.limbs.data(), left.limbs.size());
+			result.negative = right.negative;
+		}
+		return result;
+	}
+
+	BigNumber BigNumber::sub(const BigNumber& left, const BigNumber& right) { return add(left, -right); }
+
+	BigNumber BigNumber::mul(const BigNumber& left, const BigNumber& right)
+	{
+		BigNumber result;
+		if (left.isZero() || right.isZero())
+			return result;
+
+		result.limbs.resize(left.limbs.size() + right.limbs.size());
+		Multiply(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size(), result.limbs.data());
+		Trim(result.limbs);
+		result.negative = left.negative != right.negative;
+		return result;
+	}
+
+	/* Truncating division: the quotient rounds toward zero and the remainder takes the sign
+	   of the dividend, as the Int64 operators do. */
+	void BigNumber::divmod(const BigNumber& left, const BigNumber& right, BigNumber* const quotient, BigNumber* const remainder)
+	{
+		if (right.isZero())
+			throw KlangException{ "Klang integer division by zero." };
+
+		BigNumber q, r;
+		if (CompareMagnitude(left.limbs.data(), left.limbs.size(), right.limbs.data(), right.limbs.size()) < 0)
+			r.limbs = left.limbs;
+		else if (right.limbs.size() == 1)
+		{
+			q.limbs = left.limbs;
+			const UInt32 rest = DivideSmall(q.limbs, right.limbs[0]);
+			if (rest)
+				r.limbs.push_back(rest);
+		}
+		else DivideMagnitude(left.limbs, right.limbs, q.limbs, r.limbs);
+
+		q.negative = left.negative != right.negative && !q.isZero();
+		r.negative = left.negative && !r.isZero();
+		if (quotient)
+			*quotient = std::move(q);
+		if (remainder)
+			*remainder = std::move(r);
+	}
+}
+
+
+
+// BigInt //
+namespace klang::type
+{
+	BigInt::BigInt(const BigNumber& value) :
+		Value{ Type::Integer, true },
+		_limbs{ reinterpret_cast<UInt32*>(heap::malloc(sizeof(UInt32) * value.limbs.size())) },
+		_size{ value.limbs.size() },
+		_negative{ value.negative }
+	{
+		if (!_limbs)
+			throw heap::HeapOverflowException{ sizeof(UInt32) * _size };
+
+		heap::incref(_limbs);
+		std::memcpy(_limbs, value.limbs.data(), sizeof(UInt32) * _size);
+	}
+	BigInt::~BigInt()
+	{
+		heap::decref(_limbs);
+		heap::free(_limbs);
+	}
+
+	BigNumber BigInt::number() const
+	{
+		BigNumber result;
+		result.limbs.assign(_limbs, _limbs + _size);
+		result.negative = _negative;
+		return result;
+	}
+
+	/* Integer operands of any width as a BigNumber. */
+	static BigNumber ToBigNumber(Value* const value)
+	{
+		if (isBigInt(value))
+			return value->as<BigInt>().number();
+		return BigNumber{ static_cast<Int64>(*value) };
+	}
+
+	BigInt::operator Int32() const { return static_cast<Int32>(number().toInt64()); }
+	BigInt::operator Int64() const { return number().toInt64(); }
+	BigInt::operator float() const { return static_cast<float>(number().toDouble()); }
+	BigInt::operator double() const { return number().toDouble(); }
+	BigInt::operator bool() const { return true; }
+	BigInt::operator std::wstring() const { return number().toString(); }
+
+	/* BigInts never fit in Int64, so against other integers only the sign matters unless
+	   both sides are big. */
+	#define BIGINT_COMPARE(_Operator) \
+		if (value->type != Type::Integer) \
+			return static_cast<double>(*this) _Operator static_cast<double>(*value) ? constant::True : constant::False; \
+		if (!isBigInt(value)) \
+			return (_negative ? -1 : 1) _Operator 0 ? constant::True : constant::False; \
+		return BigNumber::compare(number(), value->as<BigInt>().number()) _Operator 0 ? constant::True : constant::False
+
+	Value* BigInt::klang_operatorEquals(Value* value) { BIGINT_COMPARE(==); }
+	Value* BigInt::klang_operatorNotEquals(Value* value) { BIGINT_COMPARE(!=); }
+	Value* BigInt::klang_operatorGreater(Value* value) { BIGINT_COMPARE(>); }
+	Value* BigInt::klang_operatorLess(Value* value) { BIGINT_COMPARE(<); }
+	Value* BigInt::klang_operatorGreaterEquals(Value* value) { BIGINT_COMPARE(>=); }
+	Value* BigInt::klang_operatorLessEquals(Value* value) { BIGINT_COMPARE(<=); }
+	Value* BigInt::klang_operatorNot() { return constant::False; }
+
+	#undef BIGINT_COMPARE
+
+	Value* BigInt::klang_operatorPlus(Value* value)
+	{
+		if (value->type != Type::Integer)
+			return newDouble(static_cast<double>(*this) + static_cast<double>(*value));
+		return newIntegral(BigNumber::add(number(), ToBigNumber(value)));
+	}
+	Value* BigInt::klang_operatorMinus(Value* value)
+	{
+		if (value->type != Type::Integer)
+			return newDouble(static_cast<double>(*this) - static_cast<double>(*value));
+		return newIntegral(BigNumber::sub(number(), ToBigNumber(value)));
+	}
+	Value* BigInt::klang_operatorMultiply(Value* value)
+	{
+		if (value->type != Type::Integer)
+			return newDouble(static_cast<double>(*this) * static_cast<double>(*value));
+		return newIntegral(BigNumber::mul(number(), ToBigNumber(value)));
+	}
+	Value* BigInt::klang_operatorDivide(Value* value)
+	{
+		if (value->type != Type::Integer)
+			return newDouble(static_cast<double>(*this) / static_cast<double>(*value));
+		BigNumber quotient;
+		BigNumber::divmod(number(), ToBigNumber(value), &quotient, nullptr);
+		return newIntegral(quotient);
+	}
+	Value* BigInt::klang_operatorModule(Value* value)
+	{
+		BigNumber remainder;
+		BigNumber::divmod(number(), ToBigNumber(value), nullptr, &remainder);
+		return newIntegral(remainder);
+	}
+	Value* BigInt::klang_operatorIncrease() { return newIntegral(BigNumber::add(number(), 1)); }
+	Value* BigInt::klang_operatorDecrease() { return newIntegral(BigNumber::sub(number(), 1)); }
+	Value* BigInt::klang_operatorNegative() { return newIntegral(-number()); }
+
+	void BigInt::trace(heap::SlotVisitor visitor, void* const ctx) { visitor(reinterpret_cast<void**>(&_limbs), ctx); }
+
+
+
+	Value* newIntegral(const BigNumber& value)
+	{
+		if (value.fitsInt64())
+			return newIntegral(value.toInt64());
+		return heap::create<BigInt>(value);
+	}
+}
+
+
+
+// INTEGER PROMOTION //
+namespace klang::type
+{
+	Value* newIntegral(const Int64 value)
+	{
+		if (value >= INT32_MIN && value <= INT32_MAX)
+			return newInteger(static_cast<Int32>(value));
+		return newLongInteger(value);
+	}
+
+	int integralCompare(const Int64 left, Value* const right)
+	{
+		if (isBigInt(right))
+			return right->as<BigInt>().negative() ? 1 : -1;
+		const Int64 value = static_cast<Int64>(*right);
+		return left < value ? -1 : left > value ? 1 : 0;
+	}
+
+	Value* integralPlus(const Int64 left, const Int64 right)
+	{
+		Int64 result;
+		if (addOverflow(left, right, &result))
+			return newIntegral(BigNumber::add(left, right));
+		return newIntegral(result);
+	}
+	Value* integralPlus(const Int64 left, Value* const right)
+	{
+		if (isBigInt(right))
+			return newIntegral(BigNumber::add(left, right->as<BigInt>().number()));
+		return integralPlus(left, static_cast<Int64>(*right));
+	}
+
+	Value* integralMinus(const Int64 left, const Int64 right)
+	{
+		Int64 result;
+		if (subOverflow(left, right, &result))
+			return newIntegral(BigNumber::sub(left, right));
+		return newIntegral(result);
+	}
+	Value* integralMinus(const Int64 left, Value* const right)
+	{
+		if (isBigInt(right))
+			return newIntegral(BigNumber::sub(left, right->as<BigInt>().number()));
+		return integralMinus(left, static_cast<Int64>(*right));
+	}
+
+	Value* integralMultiply(const Int64 left, Value* const right)
+	{
+		if (isBigInt(right))
+			return newIntegral(BigNumber::mul(left, right->as<BigInt>().number()));
+
+		const Int64 value = static_cast<Int64>(*right);
+		Int64 result;
+		if (mulOverflow(left, value, &result))
+			return newIntegral(BigNumber::mul(left, value));
+		return newIntegral(result);
+	}
+
+	Value* integralDivide(const Int64 left, Value* const right)
+	{
+		BigNumber quotient;
+		if (isBigInt(right))
+		{
+			BigNumber::divmod(left, right->as<BigInt>().number(), &quotient, nullptr);
+			return newIntegral(quotient);
+		}
+
+		const Int64 value = static_cast<Int64>(*right);
+		if (!value)
+			throw KlangException{ "Klang integer division by zero." };
+		if (value == -1)
+			return integralMinus(0, left);
+		return newIntegral(left / value);
+	}
+
+	Value* integralModule(const Int64 left, Value* const right)
+	{
+		BigNumber remainder;
+		if (isBigInt(right))
+		{
+			BigNumber::divmod(left, right->as<BigInt>().number(), nullptr, &remainder);
+			return newIntegral(remainder);
+		}
+
+		const Int64 value = static_cast<Int64>(*right);
+		if (!value)
+			throw KlangException{ "Klang integer division by zero." };
+		return newIntegral(value == -1 ? 0 : left % value);
+	}
+}
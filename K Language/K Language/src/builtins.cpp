@@ -0,0 +1,629 @@
+#include "builtins.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+
+// Generic path //
+namespace klang::builtin
+{
+	using namespace type;
+	typedef Array::Kind Kind;
+
+	static Tagged ApplyTagged(const simd::Arithmetic op, const Tagged left, const Tagged right)
+	{
+		switch (op)
+		{
+			case simd::Arithmetic::Add: return klang_operatorPlus(left, right);
+			case simd::Arithmetic::Subtract: return klang_operatorMinus(left, right);
+			case simd::Arithmetic::Multiply: return klang_operatorMultiply(left, right);
+			default: return klang_operatorDivide(left, right);
+		}
+	}
+
+	static Tagged CompareTagged(const simd::Comparison op, const Tagged left, const Tagged right)
+	{
+		switch (op)
+		{
+			case simd::Comparison::Equal: return klang_operatorEquals(left, right);
+			case simd::Comparison::NotEqual: return klang_operatorNotEquals(left, right);
+			case simd::Comparison::Less: return klang_operatorLess(left, right);
+			case simd::Comparison::LessEqual: return klang_operatorLessEquals(left, right);
+			case simd::Comparison::Greater: return klang_operatorGreater(left, right);
+			default: return klang_operatorGreaterEquals(left, right);
+		}
+	}
+
+	/* Right operand of element i: the matching element or the single value. */
+	static inline Tagged At(const Array& array, const size_t index) { return array.get(index); }
+	static inline Tagged At(const Tagged value, const size_t) { return value; }
+
+	template<typename _Operand>
+	static Array* ApplyEach(const simd::Arithmetic op, const Array& left, const _Operand& right)
+	{
+		Array* const result = newArray();
+		result->reserve(left.size());
+		for (size_t i = 0; i < left.size(); ++i)
+			result->push(ApplyTagged(op, left.get(i), At(right, i)));
+		return result;
+	}
+
+	template<typename _Operand>
+	static Array* CompareEach(const simd::Comparison op, const Array& left, const _Operand& right)
+	{
+		Array* const result = newArray();
+		result->reserve(left.size());
+		for (size_t i = 0; i < left.size(); ++i)
+			result->push(CompareTagged(op, left.get(i), At(right, i)));
+		return result;
+	}
+
+	static void CheckSizes(const Array& left, const Array& right)
+	{
+		if (left.size() != right.size())
+			throw IndexException{ static_cast<Int64>(std::min(left.size(), right.size())) };
+	}
+
+	/* Packed numeric elements as raw 64 bit words, for the kernels moving them around. */
+	static inline UInt64* Words(const Array& array)
+	{
+		return array.kind() == Kind::Integer ? reinterpret_cast<UInt64*>(array.integers()) : reinterpret_cast<UInt64*>(array.doubles());
+	}
+}
+
+
+
+// Builtins //
+namespace klang::builtin
+{
+	Tagged sum(const Array& array)
+	{
+		if (array.kind() == Kind::Integer)
+		{
+			Int64 result;
+			if (simd::sum(array.integers(), array.size(), &result))
+				return Tagged::fromInteger(result);
+		}
+		else if (array.kind() == Kind::Double && array.size())
+			return Tagged::fromDouble(simd::sum(array.doubles(), array.size()));
+
+		Tagged total = Tagged::fromInteger(0);
+		for (size_t i = 0; i < array.size(); ++i)
+			total = klang_operatorPlus(total, array.get(i));
+		return total;
+	}
+
+	Tagged dot(const Array& left, const Array& right)
+	{
+		CheckSizes(left, right);
+		const size_t count = left.size();
+		if (count && left.kind() == Kind::Double && right.kind() == Kind::Double)
+			return Tagged::fromDouble(simd::dot(left.doubles(), right.doubles(), count));
+
+		if (left.kind() == Kind::Integer && right.kind() == Kind::Integer)
+		{
+			Int64 total = 0;
+			size_t i = 0;
+			for (Int64 product; i < count; ++i)
+				if (mulOverflow(left.integers()[i], right.integers()[i], &product) || addOverflow(total, product, &total))
+					break;
+			if (i == count)
+				return Tagged::fromInteger(total);
+		}
+
+		Tagged total = Tagged::fromInteger(0);
+		for (size_t i = 0; i < count; ++i)
+			total = klang_operatorPlus(total, klang_operatorMultiply(left.get(i), right.get(i)));
+		return total;
+	}
+
+	template<bool _Max>
+	static Tagged Extreme(const Array& array)
+	{
+		const size_t count = array.size();
+		if (!count)
+			return Tagged::undefined();
+		if (array.kind() == Kind::Integer)
+			return Tagged::fromInteger(_Max ? simd::max(array.integers(), count) : simd::min(array.integers(), count));
+		if (array.kind() == Kind::Double)
+			return Tagged::fromDouble(_Max ? simd::max(array.doubles(), count) : simd::min(array.doubles(), count));
+
+		Tagged result = array.get(0);
+		for (size_t i = 1; i < count; ++i)
+		{
+			const Tagged value = array.get(i);
+			if (static_cast<bool>(_Max ? klang_operatorGreater(value, result) : klang_operatorLess(value, result)))
+				result = value;
+		}
+		return result;
+	}
+
+	Tagged min(const Array& array) { return Extreme<false>(array); }
+	Tagged max(const Array& array) { return Extreme<true>(array); }
+
+	/* An integer overflow drops the packed result, it is reclaimed like any temporary. */
+	Array* apply(const simd::Arithmetic op, const Array& left, const Array& right)
+	{
+		CheckSizes(left, right);
+		const size_t count = left.size();
+		if (count && left.kind() == Kind::Integer && right.kind() == Kind::Integer)
+		{
+			Array* const result = Array::allocate(Kind::Integer, count);
+			if (simd::apply(op, left.integers(), right.integers(), count, result->integers()))
+				return result;
+		}
+		else if (count && left.kind() == Kind::Double && right.kind() == Kind::Double)
+		{
+			Array* const result = Array::allocate(Kind::Double, count);
+			simd::apply(op, left.doubles(), right.doubles(), count, result->doubles());
+			return result;
+		}
+		return ApplyEach(op, left, right);
+	}
+	Array* apply(const simd::Arithmetic op, const Array& left, const Tagged right)
+	{
+		const size_t count = left.size();
+		if (count && left.kind() == Kind::Integer && right.isInteger())
+		{
+			Array* const result = Array::allocate(Kind::Integer, count);
+			if (simd::apply(op, left.integers(), right.integer(), count, result->integers()))
+				return result;
+		}
+		else if (count && left.kind() == Kind::Double && right.isNumber())
+		{
+			Array* const result = Array::allocate(Kind::Double, count);
+			simd::apply(op, left.doubles(), right.number(), count, result->doubles());
+			return result;
+		}
+		return ApplyEach(op, left, right);
+	}
+
+	Array* compare(const simd::Comparison op, const Array& left, const Array& right)
+	{
+		CheckSizes(left, right);
+		const size_t count = left.size();
+		if (count && left.kind() == right.kind() && (left.kind() == Kind::Integer || left.kind() == Kind::Double))
+		{
+			Array* const result = Array::allocate(Kind::Boolean, count);
+			if (left.kind() == Kind::Integer)
+				simd::compare(op, left.integers(), right.integers(), count, result->booleans());
+			else simd::compare(op, left.doubles(), right.doubles(), count, result->booleans());
+			return result;
+		}
+		return CompareEach(op, left, right);
+	}
+	Array* compare(const simd::Comparison op, const Array& left, const Tagged right)
+	{
+		const size_t count = left.size();
+		if (count && left.kind() == Kind::Integer && right.isInteger())
+		{
+			Array* const result = Array::allocate(Kind::Boolean, count);
+			simd::compare(op, left.integers(), right.integer(), count, result->booleans());
+			return result;
+		}
+		if (count && left.kind() == Kind::Double && right.isNumber())
+		{
+			Array* const result = Array::allocate(Kind::Boolean, count);
+			simd::compare(op, left.doubles(), right.number(), count, result->booleans());
+			return result;
+		}
+		return CompareEach(op, left, right);
+	}
+
+	Array* filter(const Array& array, const Array& mask)
+	{
+		CheckSizes(array, mask);
+		const size_t count = array.size();
+		if (count && mask.kind() == Kind::Boolean && (array.kind() == Kind::Integer || array.kind() == Kind::Double))
+		{
+			Array* const result = Array::allocate(array.kind(), count);
+			result->truncate(simd::compress(Words(array), mask.booleans(), count, Words(*result)));
+			return result;
+		}
+
+		Array* const result = newArray();
+		for (size_t i = 0; i < count; ++i)
+			if (static_cast<bool>(mask.get(i)))
+				result->push(array.get(i));
+		return result;
+	}
+}
+
+
+
+// Sorting //
+namespace klang::builtin
+{
+	/* Below this many elements the radix passes cost more than a comparison sort. */
+	static constexpr size_t RadixMinCount = 256;
+
+	/* Elements per thread below which sorting stays on the calling thread. */
+	static constexpr size_t ParallelMinCount = 1 << 16;
+
+	static constexpr UInt64 SignBit = 1ull << 63;
+
+	/* Unsigned keys ordered like the values: integers with the sign flipped, doubles in
+	   total order. Flipping the sign again restores an integer. */
+	static inline UInt64 IntegerKey(const UInt64 bits) { return bits ^ SignBit; }
+	static inline UInt64 DoubleKey(const UInt64 bits) { return bits & SignBit ? ~bits : bits | SignBit; }
+	static inline UInt64 DoubleBits(const UInt64 key) { return key & SignBit ? key ^ SignBit : ~key; }
+
+	/* String keyed by its first characters, each code + 1 in 21 bits so that a string keys
+	   before the longer ones it starts. Equal keys still need a full compare. */
+	struct StringEntry
+	{
+		UInt64 key;
+		String* string;
+	};
+	static constexpr size_t StringKeyCharacters = 3;
+
+	static inline UInt64 KeyOf(const UInt64 key) { return key; }
+	static inline UInt64 KeyOf(const StringEntry& entry) { return entry.key; }
+
+	static inline bool StringLess(const StringEntry& left, const StringEntry& right)
+	{
+		return left.key != right.key ? left.key < right.key : left.string->compare(*right.string) < 0;
+	}
+
+	/* Stable LSD radix sort on the bytes of key - smallest key, so that only the bytes
+	   spanned by the range of the keys are sorted on, and any of them shared by every
+	   key is skipped. */
+	template<typename _Item>
+	static void RadixSort(_Item* const items, _Item* const scratch, const size_t count)
+	{
+		UInt64 low = KeyOf(items[0]);
+		UInt64 high = low;
+		for (size_t i = 1; i < count; ++i)
+		{
+			const UInt64 key = KeyOf(items[i]);
+			low = std::min(low, key);
+			high = std::max(high, key);
+		}
+
+		size_t digits = 0;
+		while (digits < 8 && (high - low) >> (digits * 8))
+			++digits;
+
+		size_t counts[8][256] = {};
+		for (size_t i = 0; i < count; ++i)
+		{
+			const UInt64 key = KeyOf(items[i]) - low;
+			for (size_t d = 0; d < digits; ++d)
+				++counts[d][(key >> (d * 8)) & 0xFF];
+		}
+
+		_Item* from = items;
+		_Item* to = scratch;
+		for (size_t d = 0; d < digits; ++d)
+		{
+			size_t* const offsets = counts[d];
+			if (offsets[((KeyOf(items[0]) - low) >> (d * 8)) & 0xFF] == count)
+				continue;
+
+			for (size_t digit = 0, total = 0; digit < 256; ++digit)
+			{
+				const size_t size = offsets[digit];
+				offsets[digit] = total;
+				total += size;
+			}
+			for (size_t i = 0; i < count; ++i)
+				to[offsets[((KeyOf(from[i]) - low) >> (d * 8)) & 0xFF]++] = from[i];
+			std::swap(from, to);
+		}
+		if (from != items)
+			std::copy(from, from + count, items);
+	}
+
+	static void SortKeys(UInt64* const keys, UInt64* const scratch, const size_t count)
+	{
+		if (count < RadixMinCount)
+			std::sort(keys, keys + count);
+		else RadixSort(keys, scratch, count);
+	}
+
+	static void SortStrings(StringEntry* const entries, StringEntry* const scratch, const size_t count)
+	{
+		if (count < RadixMinCount)
+			return std::stable_sort(entries, entries + count, &StringLess);
+
+		RadixSort(entries, scratch, count);
+		for (size_t begin = 0, end; begin < count; begin = end)
+		{
+			for (end = begin + 1; end < count && entries[end].key == entries[begin].key; ++end) {}
+			if (end - begin > 1)
+				std::stable_sort(entries + begin, entries + end, &StringLess);
+		}
+	}
+
+	/* Calls function on [begin, end) ranges covering count elements, in parallel when large. */
+	template<typename _Function>
+	static void ForRanges(const size_t count, const _Function& function)
+	{
+		const size_t ranges = std::max<size_t>(std::min(parallel::concurrency(), count / ParallelMinCount), 1);
+		parallel::run(ranges, [&](const size_t range) { function(count * range / ranges, count * (range + 1) / ranges); });
+	}
+
+	/* Number of elements of a taken among the first k of the stable merge of a and b. */
+	template<typename _Item, typename _Less>
+	static size_t CoRank(const size_t k, const _Item* const a, const size_t aSize, const _Item* const b, const size_t bSize, const _Less& less)
+	{
+		size_t low = k > bSize ? k - bSize : 0;
+		size_t high = std::min(k, aSize);
+		while (low < high)
+		{
+			const size_t i = low + (high - low) / 2;
+			if (!less(b[k - i - 1], a[i]))
+				low = i + 1;
+			else high = i;
+		}
+		return low;
+	}
+
+	/* Sorts one run per thread, then merges neighbouring runs until one is left. Every
+	   merge is cut at co-ranks into pieces of about one run, so all threads stay busy up
+	   to the last round. Stable when sortRange is. */
+	template<typename _Item, typename _Less>
+	static void ParallelSort(_Item* const items, _Item* const scratch, const size_t count, void (*sortRange)(_Item* const, _Item* const, const size_t), const _Less& less)
+	{
+		const size_t runs = std::min(parallel::concurrency(), count / ParallelMinCount);
+		if (runs < 2)
+			return sortRange(items, scratch, count);
+
+		std::vector<size_t> bounds(runs + 1);
+		for (size_t run = 0; run <= runs; ++run)
+			bounds[run] = count * run / runs;
+		parallel::run(runs, [&](const size_t run) { sortRange(items + bounds[run], scratch + bounds[run], bounds[run + 1] - bounds[run]); });
+
+		struct Merge
+		{
+			size_t begin, middle, end;
+			size_t first, last;
+		};
+		std::vector<Merge> merges;
+		_Item* from = items;
+		_Item* to = scratch;
+		for (size_t width = 1; width < runs; width *= 2)
+		{
+			merges.clear();
+			for (size_t run = 0; run < runs; run += 2 * width)
+			{
+				const size_t begin = bounds[run];
+				const size_t middle = bounds[std::min(run + width, runs)];
+				const size_t end = bounds[std::min(run + 2 * width, runs)];
+				const size_t pieces = std::max<size_t>((end - begin) * runs / count, 1);
+				for (size_t piece = 0; piece < pieces; ++piece)
+					merges.push_back({ begin, middle, end, (end - begin) * piece / pieces, (end - begin) * (piece + 1) / pieces });
+			}
+
+			parallel::run(merges.size(), [&](const size_t index) {
+				const Merge& merge = merges[index];
+				const _Item* const a = from + merge.begin;
+				const _Item* const b = from + merge.middle;
+				const size_t aSize = merge.middle - merge.begin;
+				const size_t bSize = merge.end - merge.middle;
+				const size_t aFirst = CoRank(merge.first, a, aSize, b, bSize, less);
+				const size_t aLast = CoRank(merge.last, a, aSize, b, bSize, less);
+				std::merge(a + aFirst, a + aLast, b + (merge.first - aFirst), b + (merge.last - aLast), to + merge.begin + merge.first, less);
+			});
+			std::swap(from, to);
+		}
+
+		if (from != items)
+			parallel::run(runs, [&](const size_t run) { std::copy(from + bounds[run], from + bounds[run + 1], items + bounds[run]); });
+	}
+
+	static void SortPacked(Array& array)
+	{
+		const size_t count = array.size();
+		if (array.kind() == Kind::Boolean)
+		{
+			const size_t ones = static_cast<size_t>(std::count(array.booleans(), array.booleans() + count, 1));
+			std::memset(array.booleans(), 0, count - ones);
+			std::memset(array.booleans() + count - ones, 1, ones);
+			return;
+		}
+
+		std::vector<UInt64> scratch(count);
+		UInt64* const words = Words(array);
+		const bool doubles = array.kind() == Kind::Double;
+		ForRanges(count, [=](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				words[i] = doubles ? DoubleKey(words[i]) : IntegerKey(words[i]);
+		});
+		ParallelSort(words, scratch.data(), count, &SortKeys, std::less<UInt64>{});
+		ForRanges(count, [=](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				words[i] = doubles ? DoubleBits(words[i]) : IntegerKey(words[i]);
+		});
+	}
+
+	/* Only for arrays of strings. Ropes are flattened first, so the workers compare them
+	   without allocating. Reordering the slots keeps every count as it was. */
+	static bool SortStrings(Array& array)
+	{
+		const size_t count = array.size();
+		Tagged* const slots = const_cast<Tagged*>(array.values());
+		for (size_t i = 0; i < count; ++i)
+			if (!slots[i].isPointer() || slots[i].pointer()->type != Value::Type::String)
+				return false;
+
+		std::vector<StringEntry> entries(count);
+		std::vector<StringEntry> scratch(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			String* const string = static_cast<String*>(slots[i].pointer());
+			string->bytes();
+
+			UInt64 key = 0;
+			for (size_t c = 0; c < StringKeyCharacters; ++c)
+				key = key << 21 | (c < string->size() ? string->at(c) + 1 : 0);
+			entries[i] = { key, string };
+		}
+
+		ParallelSort(entries.data(), scratch.data(), count, &SortStrings, &StringLess);
+		for (size_t i = 0; i < count; ++i)
+			slots[i] = Tagged{ entries[i].string };
+		return true;
+	}
+
+	struct Ordering
+	{
+		Comparator less;
+		void* ctx;
+
+		inline bool operator()(const Tagged left, const Tagged right) const
+		{
+			return less ? less(left, right, ctx) : static_cast<bool>(klang_operatorLess(left, right));
+		}
+	};
+
+	/* Bottom-up merge sort relying only on each comparison result, never on the ordering
+	   being strict weak: script comparators written with <=, or klang_operatorLess over
+	   NaN and mixed types, make std::sort read out of bounds. Every index stays checked
+	   whatever the comparator answers, and the order is stable. */
+	static void MergeSort(std::vector<Tagged>& items, const Ordering& less)
+	{
+		constexpr size_t RunSize = 16;
+		const size_t count = items.size();
+		for (size_t begin = 0; begin < count; begin += RunSize)
+		{
+			const size_t end = std::min(begin + RunSize, count);
+			for (size_t i = begin + 1; i < end; ++i)
+			{
+				const Tagged item = items[i];
+				size_t j = i;
+				for (; j > begin && less(item, items[j - 1]); --j)
+					items[j] = items[j - 1];
+				items[j] = item;
+			}
+		}
+
+		std::vector<Tagged> merged(count);
+		for (size_t width = RunSize; width < count; width *= 2)
+		{
+			for (size_t begin = 0; begin < count; begin += 2 * width)
+			{
+				const size_t middle = std::min(begin + width, count);
+				const size_t end = std::min(begin + 2 * width, count);
+				size_t left = begin, right = middle, out = begin;
+				while (left < middle && right < end)
+					merged[out++] = less(items[right], items[left]) ? items[right++] : items[left++];
+				out = std::copy(items.begin() + left, items.begin() + middle, merged.begin() + out) - merged.begin();
+				std::copy(items.begin() + right, items.begin() + end, merged.begin() + out);
+			}
+			items.swap(merged);
+		}
+	}
+
+	/* Sorts a copy, so that an exception thrown by a comparison leaves the array as it was. */
+	static void SortGeneric(Array& array, const Ordering& ordering)
+	{
+		std::vector<Tagged> items(array.size());
+		for (size_t i = 0; i < items.size(); ++i)
+			items[i] = array.get(i);
+
+		MergeSort(items, ordering);
+
+		if (array.kind() == Kind::Boxed)
+			std::copy(items.begin(), items.end(), const_cast<Tagged*>(array.values()));
+		else for (size_t i = 0; i < items.size(); ++i)
+			array.set(i, items[i]);
+	}
+
+	/* Every path is stable, sort() and stableSort() only differ by the guarantee they make. */
+	static void Sort(Array& array, const Comparator less, void* const ctx)
+	{
+		if (array.size() < 2)
+			return;
+		if (!less)
+		{
+			if (array.kind() != Kind::Boxed)
+				return SortPacked(array);
+			if (SortStrings(array))
+				return;
+		}
+		SortGeneric(array, Ordering{ less, ctx });
+	}
+
+	void sort(Array& array, const Comparator less, void* const ctx) { Sort(array, less, ctx); }
+	void stableSort(Array& array, const Comparator less, void* const ctx) { Sort(array, less, ctx); }
+
+	template<typename _Element>
+	static size_t UniqueElements(_Element* const elements, const size_t count)
+	{
+		size_t kept = 1;
+		for (size_t i = 1; i < count; ++i)
+			if (!(elements[i] == elements[kept - 1]))
+				elements[kept++] = elements[i];
+		return kept;
+	}
+
+	/* Boxed duplicates are swapped to the end rather than overwritten, truncate() then
+	   drops each of them once. */
+	size_t unique(Array& array)
+	{
+		const size_t count = array.size();
+		if (count < 2)
+			return count;
+
+		size_t kept = 1;
+		switch (array.kind())
+		{
+			case Kind::Integer: kept = UniqueElements(array.integers(), count); break;
+			case Kind::Double: kept = UniqueElements(array.doubles(), count); break;
+			case Kind::Boolean: kept = UniqueElements(array.booleans(), count); break;
+			case Kind::Boxed: {
+				Tagged* const slots = const_cast<Tagged*>(array.values());
+				for (size_t i = 1; i < count; ++i)
+					if (!static_cast<bool>(klang_operatorEquals(slots[kept - 1], slots[i])))
+						std::swap(slots[kept++], slots[i]);
+			} break;
+		}
+		array.truncate(kept);
+		return kept;
+	}
+
+	template<bool _Upper, typename _Element>
+	static size_t BoundOf(const _Element* const elements, const size_t count, const _Element value)
+	{
+		return (_Upper ? std::upper_bound(elements, elements + count, value) : std::lower_bound(elements, elements + count, value)) - elements;
+	}
+
+	template<bool _Upper>
+	static size_t Bound(const Array& array, const Tagged value, const Ordering& ordering)
+	{
+		const size_t count = array.size();
+		if (!ordering.less)
+		{
+			if (array.kind() == Kind::Integer && value.isInteger())
+				return BoundOf<_Upper>(array.integers(), count, value.integer());
+			if (array.kind() == Kind::Double && value.isNumber())
+				return BoundOf<_Upper>(array.doubles(), count, value.number());
+		}
+
+		size_t low = 0;
+		size_t high = count;
+		while (low < high)
+		{
+			const size_t middle = low + (high - low) / 2;
+			const Tagged element = array.get(middle);
+			if (_Upper ? !ordering(value, element) : ordering(element, value))
+				low = middle + 1;
+			else high = middle;
+		}
+		return low;
+	}
+
+	size_t lowerBound(const Array& array, const Tagged value, const Comparator less, void* const ctx) { return Bound<false>(array, value, Ordering{ less, ctx }); }
+	size_t upperBound(const Array& array, const Tagged value, const Comparator less, void* const ctx) { return Bound<true>(array, value, Ordering{ less, ctx }); }
+
+	size_t binarySearch(const Array& array, const Tagged value, const Comparator less, void* const ctx)
+	{
+		const Ordering ordering{ less, ctx };
+		const size_t index = Bound<false>(array, value, ordering);
+		return index < array.size() && !ordering(value, array.get(index)) ? index : NotFound;
+	}
+}
@@ -1,59 +1,460 @@
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "heap.h"
 
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #define HEADER_SIZE sizeof(__private_heap_header)
+#define ALIGN_SIZE(_Size) (((_Size) + 7) & ~((size_t)7))
+
+#define BLOCK_SIZE(_Header) (((size_t)(_Header)->words) * 8)
+#define MAX_BLOCK_SIZE (0xFFFFFFFFULL * 8)
+#define FREE_NEXT(_Header) (*(__private_heap_header**)((_Header) + 1))
+
+#define MAX_CLASS_SIZE 256
+#define NO_CLASS (-1)
+
+#define PAGE_SIZE 4096
+#define ROUND_UP(_Size, _Align) ((((_Size) + (_Align) - 1) / (_Align)) * (_Align))
+
+#define LARGE_BLOCK(_Ptr) ((__private_heap_large*)(((char*)(_Ptr)) - sizeof(__private_heap_large)))
+#define LARGE_PAYLOAD_SIZE(_Block) ((_Block)->size - sizeof(__private_heap_large))
+
+
+/* The heap reserves its hard limit as address space once and commits chunks on
+   demand, so blocks never move when the heap grows and address order walks stay valid. */
+static void* reserve_pages(const size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+static int commit_pages(void* const ptr, const size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void decommit_pages(void* const ptr, const size_t size)
+{
+#ifdef _WIN32
+	VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+	madvise(ptr, size, MADV_DONTNEED);
+	mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+static int protect_pages(void* const ptr, const size_t size)
+{
+#ifdef _WIN32
+	DWORD old;
+	return VirtualProtect(ptr, size, PAGE_READONLY, &old) != 0;
+#else
+	return mprotect(ptr, size, PROT_READ) == 0;
+#endif
+}
+
+static void release_pages(void* const ptr, const size_t size)
+{
+#ifdef _WIN32
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, size);
+#endif
+}
+
+static void* map_pages(const size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+/* Address space reserved for a large block mapping of the given size. Windows cannot
+   resize a mapping, so room to grow in place is reserved upfront and committed on demand.
+   Elsewhere mremap moves the pages when they do not fit, nothing extra is reserved. */
+static size_t large_reservation(const size_t mapping)
+{
+#ifdef _WIN32
+	return mapping * 2;
+#else
+	return mapping;
+#endif
+}
+
+
+/* Payload sizes served by the segregated free lists. Covers Integer/Float (16),
+   LongInteger/Double (24), the String header (32) and short string buffers. */
+static const size_t size_classes[HEAP_SIZE_CLASS_COUNT] = { 16, 24, 32, 48, 64, 96, 128, 256 };
+
+/* Size class index by payload size in 8 byte words. */
+static const int class_by_words[(MAX_CLASS_SIZE / 8) + 1] = {
+	0, 0, 0, 1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+};
+
+static int find_size_class(const size_t size)
+{
+	return size > MAX_CLASS_SIZE ? NO_CLASS : class_by_words[(size + 7) / 8];
+}
+
+
+static int grow_heap(__private_heap* const heap, const size_t size, const size_t limit)
+{
+	size_t capacity = ROUND_UP(heap->top + size, HEAP_CHUNK_SIZE);
+	if (capacity > heap->limit)
+		capacity = heap->limit;
+	if (capacity <= heap->capacity || capacity > limit || heap->top + size > capacity)
+		return HS_HEAP_OVERFLOW;
+
+	if (!commit_pages(((char*)heap->data) + heap->capacity, capacity - heap->capacity))
+		return HS_CANNOT_CREATE;
+
+	heap->capacity = capacity;
+	return HS_OK;
+}
 
+static __private_heap_header* bump_block(__private_heap* const heap, const size_t block_size)
+{
+	if (heap->top + block_size > heap->capacity && grow_heap(heap, block_size, heap->soft_limit) != HS_OK)
+		return NULL;
+
+	__private_heap_header* header = (__private_heap_header*)(((char*)heap->data) + heap->top);
+	header->words = block_size / 8;
+	header->refs = 0;
+	header->flags = HF_FREE;
+	heap->top += block_size;
+
+	return header;
+}
+
+/* Carves a new slab of cells for the given size class at the bump pointer and threads
+   every cell onto the class free list. Near the end of the heap the slab shrinks to
+   the cells that still fit. */
+static int refill_size_class(__private_heap* const heap, const int size_class)
+{
+	const size_t cell_size = size_classes[size_class] + HEADER_SIZE;
+	size_t cells = HEAP_SLAB_SIZE / cell_size;
+
+	if (heap->top + cell_size > heap->capacity)
+		grow_heap(heap, cells * cell_size, heap->soft_limit);
+
+	const size_t available = (heap->capacity - heap->top) / cell_size;
+
+	if (available < cells)
+		cells = available;
+	if (!cells)
+		return HS_HEAP_OVERFLOW;
+
+	while (cells--)
+	{
+		__private_heap_header* cell = bump_block(heap, cell_size);
+		FREE_NEXT(cell) = heap->free_classes[size_class];
+		heap->free_classes[size_class] = cell;
+	}
+
+	return HS_OK;
+}
+
+static __private_heap_header* take_large_block(__private_heap* const heap, const size_t block_size)
+{
+	__private_heap_header** link = &heap->free_large;
+	while (*link)
+	{
+		__private_heap_header* header = *link;
+		if (BLOCK_SIZE(header) >= block_size && BLOCK_SIZE(header) - block_size <= block_size)
+		{
+			*link = FREE_NEXT(header);
+			return header;
+		}
+		link = &FREE_NEXT(header);
+	}
+
+	return bump_block(heap, block_size);
+}
+
+
+
+/* Large blocks by address, so interior pointers are resolved by binary search instead
+   of a list walk (root marking looks up every root that is not in the bump region). */
+static size_t large_block_position(const __private_heap* const heap, const void* const ptr)
+{
+	size_t low = 0, high = heap->large_count;
+	while (low < high)
+	{
+		const size_t mid = (low + high) / 2;
+		if ((const char*)heap->large_index[mid] <= (const char*)ptr)
+			low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+static int index_large_block(__private_heap* const heap, __private_heap_large* const block)
+{
+	if (heap->large_count == heap->large_capacity)
+	{
+		const size_t capacity = heap->large_capacity ? heap->large_capacity * 2 : 16;
+		__private_heap_large** const index = (__private_heap_large**)realloc(heap->large_index, capacity * sizeof(__private_heap_large*));
+		if (!index)
+			return HS_OUT_OF_MEMORY;
+
+		heap->large_index = index;
+		heap->large_capacity = capacity;
+	}
+
+	const size_t position = large_block_position(heap, block);
+	memmove(heap->large_index + position + 1, heap->large_index + position, (heap->large_count - position) * sizeof(__private_heap_large*));
+	heap->large_index[position] = block;
+	heap->large_count++;
+	return HS_OK;
+}
+
+/* Only compares addresses, the block may already be unmapped or moved. */
+static void unindex_large_block(__private_heap* const heap, const __private_heap_large* const block)
+{
+	const size_t position = large_block_position(heap, block) - 1;
+	memmove(heap->large_index + position, heap->large_index + position + 1, (heap->large_count - position - 1) * sizeof(__private_heap_large*));
+	heap->large_count--;
+}
 
-int klangh_CreateHeap(__private_heap* const heap, const size_t size, const int is_static)
+/* Objects above HEAP_LARGE_OBJECT_SIZE bypass the bump region: they never fragment it,
+   are never copied by compaction and go back to the OS as soon as they are freed. */
+static __private_heap_header* map_large_block(__private_heap* const heap, const size_t size)
 {
-	void* heap_data = malloc(size);
+	const size_t mapping = ROUND_UP(size + sizeof(__private_heap_large), PAGE_SIZE);
+	const size_t reserved = large_reservation(mapping);
+	if (heap->capacity + heap->large_used + mapping > heap->limit)
+		return NULL;
+
+	__private_heap_large* block = (__private_heap_large*)(reserved == mapping ? map_pages(mapping) : reserve_pages(reserved));
+	if (!block)
+		return NULL;
+	if ((reserved != mapping && !commit_pages(block, mapping)) || index_large_block(heap, block) != HS_OK)
+	{
+		release_pages(block, reserved);
+		return NULL;
+	}
+
+	block->prev = NULL;
+	block->next = heap->large_objects;
+	block->size = mapping;
+	block->reserved = reserved;
+	if (block->next)
+		block->next->prev = block;
+	heap->large_objects = block;
+	heap->large_used += mapping;
+
+	block->header.words = 0;
+	return &block->header;
+}
+
+static void unmap_large_block(__private_heap* const heap, __private_heap_large* const block)
+{
+	if (block->prev)
+		block->prev->next = block->next;
+	else heap->large_objects = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+
+	unindex_large_block(heap, block);
+	heap->large_used -= block->size;
+	release_pages(block, block->reserved);
+}
+
+/* Resizes the mapping of a large block in place, within its reservation on Windows, or
+   lets the kernel move its pages with mremap. Returns NULL when neither is possible,
+   the caller then copies the block. */
+static __private_heap_large* resize_large_block(__private_heap_large* const block, const size_t mapping)
+{
+#if defined(_WIN32)
+	if (mapping > block->reserved)
+		return NULL;
+	if (mapping > block->size)
+	{
+		if (!commit_pages(((char*)block) + block->size, mapping - block->size))
+			return NULL;
+	}
+	else decommit_pages(((char*)block) + mapping, block->size - mapping);
+	return block;
+#elif defined(MREMAP_MAYMOVE)
+	void* const moved = mremap(block, block->size, mapping, MREMAP_MAYMOVE);
+	if (moved == MAP_FAILED)
+		return NULL;
+
+	((__private_heap_large*)moved)->reserved = mapping;
+	return (__private_heap_large*)moved;
+#else
+	return NULL;
+#endif
+}
+
+static __private_heap_large* find_large_block(const __private_heap* const heap, const void* const ptr)
+{
+	const size_t position = large_block_position(heap, ptr);
+	if (!position)
+		return NULL;
+
+	__private_heap_large* const block = heap->large_index[position - 1];
+	if ((const char*)ptr >= (const char*)(block + 1) && (const char*)ptr < ((const char*)block) + block->size)
+		return block;
+	return NULL;
+}
+
+
+
+int klangh_CreateHeap(__private_heap* const heap, const size_t size, const size_t limit, const int is_static)
+{
+	const size_t reserved = ROUND_UP(limit > size ? limit : size, PAGE_SIZE);
+	const size_t committed = ROUND_UP(size, PAGE_SIZE);
+
+	memset(heap, 0, sizeof(__private_heap));
+
+	void* heap_data = reserve_pages(reserved);
 	if (!heap_data)
 		return HS_CANNOT_CREATE;
+	if (!commit_pages(heap_data, committed))
+	{
+		release_pages(heap_data, reserved);
+		return HS_CANNOT_CREATE;
+	}
 
 	heap->is_static = is_static ? 1 : 0;
-	heap->capacity = size;
-	heap->used = 0;
-	heap->last = NULL;
+	heap->capacity = committed;
+	heap->soft_limit = heap->limit = heap->reserved = reserved;
 	heap->data = heap_data;
 
 	return HS_OK;
 }
 int klangh_DestroyHeap(__private_heap* const heap)
 {
-	free(heap->data);
-	heap->is_static = 0;
-	heap->capacity = heap->used = 0;
-	heap->last = NULL;
-	heap->data = NULL;
+	while (heap->large_objects)
+		unmap_large_block(heap, heap->large_objects);
+	free(heap->large_index);
+	if (heap->data)
+		release_pages(heap->data, heap->reserved);
+	memset(heap, 0, sizeof(__private_heap));
 
 	return HS_OK;
 }
 
-int klangh_Malloc(__private_heap* const heap, const size_t size, void** const ptr)
+int klangh_SetLimits(__private_heap* const heap, const size_t soft_limit, const size_t limit)
 {
-	if (heap->used + size + HEADER_SIZE > heap->capacity)
+	/* The hard limit can only shrink the reservation made at creation time. */
+	if (limit < heap->capacity || limit > heap->reserved)
 		return HS_HEAP_OVERFLOW;
 
-	void* data = (void*)(((char*)heap->data) + heap->used);
+	heap->limit = limit;
+	heap->soft_limit = soft_limit < limit ? soft_limit : limit;
+	return HS_OK;
+}
 
-	__private_heap_header* header = (__private_heap_header*)data;
-	header->size = size + HEADER_SIZE;
-	header->refs = 0;
+/* Commits room for at least size more bytes, ignoring the soft limit. */
+int klangh_Grow(__private_heap* const heap, const size_t size)
+{
+	if (heap->is_sealed)
+		return HS_HEAP_OVERFLOW;
+	return grow_heap(heap, size + HEADER_SIZE + HEAP_SLAB_SIZE, heap->limit);
+}
+
+/* Hands the chunks above the bump pointer back to the OS. Meant to run after compaction,
+   when every free block has been squeezed out below the bump pointer. */
+int klangh_Trim(__private_heap* const heap)
+{
+	size_t capacity = ROUND_UP(heap->top, HEAP_CHUNK_SIZE);
+	if (capacity < HEAP_CHUNK_SIZE)
+		capacity = HEAP_CHUNK_SIZE;
+
+	if (heap->is_static || capacity >= heap->capacity)
+		return HS_OK;
+
+	decommit_pages(((char*)heap->data) + capacity, heap->capacity - capacity);
+	heap->capacity = capacity;
+	return HS_OK;
+}
 
-	if (!heap->last)
+/* Makes every committed page of a static heap read-only. Its blocks are immortal and
+   their counters are never written, so the heap can be shared between threads without
+   any further synchronization. A sealed heap cannot allocate nor grow anymore. */
+int klangh_Seal(__private_heap* const heap)
+{
+	if (!heap->is_static)
+		return HS_CANNOT_CREATE;
+	if (heap->is_sealed)
+		return HS_OK;
+
+	if (!protect_pages(heap->data, heap->capacity))
+		return HS_CANNOT_CREATE;
+
+	heap->is_sealed = 1;
+	return HS_OK;
+}
+
+int klangh_IsInHeap(const __private_heap* const heap, const void* const ptr)
+{
+	return (const char*)ptr >= (const char*)heap->data && (const char*)ptr < ((const char*)heap->data) + heap->top;
+}
+
+int klangh_Malloc(__private_heap* const heap, const size_t size, void** const ptr)
+{
+	__private_heap_header* header;
+	const int size_class = find_size_class(size);
+
+	if (heap->is_sealed)
+		return HS_HEAP_OVERFLOW;
+
+	if (size_class != NO_CLASS)
 	{
-		heap->last = header;
-		header->next = header->prev = NULL;
+		if (!heap->free_classes[size_class] && refill_size_class(heap, size_class) != HS_OK)
+			return HS_HEAP_OVERFLOW;
+
+		header = heap->free_classes[size_class];
+		heap->free_classes[size_class] = FREE_NEXT(header);
+	}
+	else if (size >= HEAP_LARGE_OBJECT_SIZE && !heap->is_static)
+	{
+		header = map_large_block(heap, size);
+		if (!header)
+			return HS_HEAP_OVERFLOW;
+
+		header->refs = 0;
+		header->flags = HF_LARGE;
+		*ptr = (void*)(header + 1);
+		return HS_OK;
 	}
 	else
 	{
-		heap->last->next = header;
-		header->prev = heap->last;
-		heap->last = header;
+		if ((unsigned long long)size > MAX_BLOCK_SIZE - HEADER_SIZE)
+			return HS_HEAP_OVERFLOW;
+
+		header = take_large_block(heap, ALIGN_SIZE(size) + HEADER_SIZE);
+		if (!header)
+			return HS_HEAP_OVERFLOW;
 	}
 
-	heap->used += header->size;
+	header->refs = 0;
+	header->flags = heap->is_static ? HF_STATIC : 0;
+
+	heap->used += BLOCK_SIZE(header);
 	*ptr = (void*)(header + 1);
 
 	return HS_OK;
@@ -64,96 +465,577 @@ int klangh_Free(__private_heap* const heap, void* const ptr)
 		return HS_OK;
 
 	__private_heap_header* header = ((__private_heap_header*)ptr) - 1;
-	if (header == heap->last)
+	if (header->flags & HF_LARGE)
 	{
-		if (heap->last->prev)
-			heap->last->prev->next = NULL;
-		heap->last = heap->last->prev;
+		unmap_large_block(heap, LARGE_BLOCK(ptr));
+		return HS_OK;
+	}
 
-		heap->capacity -= header->size;
+	heap->used -= BLOCK_SIZE(header);
+	header->flags = HF_FREE;
+
+	const int size_class = find_size_class(BLOCK_SIZE(header) - HEADER_SIZE);
+	if (size_class != NO_CLASS)
+	{
+		FREE_NEXT(header) = heap->free_classes[size_class];
+		heap->free_classes[size_class] = header;
 	}
 	else
 	{
-		if (header->prev)
-			header->prev->next = header->next;
-		if (header->next)
-			header->next->prev = header->prev;
+		FREE_NEXT(header) = heap->free_large;
+		heap->free_large = header;
 	}
 
 	return HS_OK;
 }
 
+/* Resizes a block keeping its contents, counter and flags. Large blocks are resized
+   in place or by remapping their pages where the system allows it (see
+   resize_large_block); anything else is copied into a new block. The block may
+   move: every other pointer to it is stale afterwards. */
+int klangh_Realloc(__private_heap* const heap, void** const ptr, const size_t size)
+{
+	__private_heap_header* header = ((__private_heap_header*)*ptr) - 1;
+	if (header->flags & HF_LARGE)
+	{
+		__private_heap_large* const block = LARGE_BLOCK(*ptr);
+		const size_t mapping = ROUND_UP(size + sizeof(__private_heap_large), PAGE_SIZE);
+		if (mapping == block->size)
+			return HS_OK;
+		if (heap->capacity + heap->large_used - block->size + mapping > heap->limit)
+			return HS_HEAP_OVERFLOW;
+
+		__private_heap_large* const moved = resize_large_block(block, mapping);
+		if (moved)
+		{
+			if (moved != block)
+			{
+				unindex_large_block(heap, block);
+				index_large_block(heap, moved);
+			}
+			if (moved->prev)
+				moved->prev->next = moved;
+			else heap->large_objects = moved;
+			if (moved->next)
+				moved->next->prev = moved;
+
+			heap->large_used = heap->large_used - moved->size + mapping;
+			moved->size = mapping;
+			*ptr = (void*)(moved + 1);
+			return HS_OK;
+		}
+	}
+	else if (BLOCK_SIZE(header) - HEADER_SIZE >= size)
+		return HS_OK;
+
+	const size_t old_size = (header->flags & HF_LARGE) ? LARGE_PAYLOAD_SIZE(LARGE_BLOCK(*ptr)) : BLOCK_SIZE(header) - HEADER_SIZE;
+	void* new_ptr;
+	const int status = klangh_Malloc(heap, size, &new_ptr);
+	if (status != HS_OK)
+		return status;
+
+	__private_heap_header* const new_header = ((__private_heap_header*)new_ptr) - 1;
+	memcpy(new_ptr, *ptr, old_size < size ? old_size : size);
+	new_header->refs = header->refs;
+	new_header->flags = (new_header->flags & HF_LARGE) | (header->flags & ~HF_LARGE);
+
+	klangh_Free(heap, *ptr);
+	*ptr = new_ptr;
+	return HS_OK;
+}
+
+int klangh_MarkObject(void* const ptr)
+{
+	(((__private_heap_header*)ptr) - 1)->flags |= HF_OBJECT;
+	return HS_OK;
+}
+
 int klangh_GetHeader(const void* const ptr, __private_heap_header** const header)
 {
 	*header = ((__private_heap_header*)ptr) - 1;
 	return HS_OK;
 }
+/* Static blocks are immutable and may be shared between isolates running on different
+   threads, their counters are never written. A counter that saturates sticks, the block
+   is then only reclaimed by the tracing collectors. */
 int klangh_IncreaseReferenceCounter(void* const ptr)
 {
-	(((__private_heap_header*)ptr) - 1)->refs++;
+	__private_heap_header* const header = ((__private_heap_header*)ptr) - 1;
+	if (!(header->flags & HF_STATIC) && header->refs < HEAP_MAX_REFS)
+		header->refs++;
 	return HS_OK;
 }
 int klangh_DecreaseReferenceCounter(void* const ptr)
 {
-	(((__private_heap_header*)ptr) - 1)->refs--;
+	__private_heap_header* const header = ((__private_heap_header*)ptr) - 1;
+	if (!(header->flags & HF_STATIC) && header->refs && header->refs < HEAP_MAX_REFS)
+		header->refs--;
 	return HS_OK;
 }
 
-int klangh_RunGarbageCollector(__private_heap* const heap)
+/* References from roots are not counted (deferred reference counting), so blocks
+   pointed to by a root are flagged before zero counters are taken as garbage. */
+static void mark_rooted_slot(void** const slot, void* const ctx)
 {
-	if (!heap->last || heap->is_static)
-		return HS_OK;
+	const __private_heap* const heap = (const __private_heap*)ctx;
+	const char* const ptr = (const char*)*slot;
+	if (ptr > (const char*)heap->data && ptr < ((const char*)heap->data) + heap->top)
+		(((__private_heap_header*)*slot) - 1)->flags |= HF_ROOTED;
+	else
+	{
+		__private_heap_large* const block = find_large_block(heap, ptr);
+		if (block)
+			block->header.flags |= HF_ROOTED;
+	}
+}
 
-	__private_heap_header* header = (__private_heap_header*)heap->data, *prev = NULL;
+/* Finalizes and frees every allocated block whose reference counter dropped to zero
+   and that no root points to. Finalizers may release further blocks, so the sweep
+   repeats until it is stable. */
+static void sweep_heap(__private_heap* const heap, const __private_heap_gc_hooks* const hooks)
+{
 	char* const base_ptr = (char*)heap->data;
-	size_t count = 0, used = 0;
-	while (header)
+	int released = 1;
+	while (released)
 	{
-		if (!header->refs)
+		released = 0;
+		for (size_t offset = 0; offset < heap->top;)
 		{
-			if (prev)
-				prev->next = header->next;
-			if (header->next)
-				header->next->prev = prev;
+			__private_heap_header* header = (__private_heap_header*)(base_ptr + offset);
+			offset += BLOCK_SIZE(header);
+
+			if ((header->flags & (HF_FREE | HF_ROOTED)) || header->refs)
+				continue;
+
+			if ((header->flags & HF_OBJECT) && hooks->finalize)
+				hooks->finalize((void*)(header + 1));
+			klangh_Free(heap, (void*)(header + 1));
+			released = 1;
 		}
-		else
+
+		/* A finalizer may unmap other large blocks, the list walk restarts after each one. */
+		for (__private_heap_large* block = heap->large_objects; block; block = block->next)
 		{
-			char* data_ptr = (char*)((void*)header);
-			if (!prev)
+			if (!(block->header.flags & HF_ROOTED) && !block->header.refs)
 			{
-				if (data_ptr - base_ptr > 0)
-				{
-					memcpy_s(base_ptr, header->size, data_ptr, header->size);
-					header = (__private_heap_header*)base_ptr;
-				}
-			}
-			else
-			{
-				char* last_ptr = (char*)((void*)prev) + prev->size;
-				if (data_ptr - last_ptr > 0)
-				{
-					memcpy_s(last_ptr, header->size, data_ptr, header->size);
-					header = (__private_heap_header*)base_ptr;
-				}
+				if ((block->header.flags & HF_OBJECT) && hooks->finalize)
+					hooks->finalize((void*)(block + 1));
+				klangh_Free(heap, (void*)(block + 1));
+				released = 1;
+				break;
 			}
+		}
+	}
+}
+
+
+typedef struct {
+
+	char* from;
+	char* to;
+	size_t size;
+
+} __private_heap_forward;
+
+typedef struct {
+
+	char* begin;
+	char* end;
+	__private_heap_forward* table;
+	size_t count;
+
+} __private_heap_forwarding;
+
+/* Maps any pointer into a live block (payload start or interior) to its post-compaction address. */
+static void forward_slot(void** const slot, void* const ctx)
+{
+	const __private_heap_forwarding* const fwd = (const __private_heap_forwarding*)ctx;
+	char* const ptr = (char*)*slot;
+	if (ptr < fwd->begin || ptr >= fwd->end)
+		return;
+
+	size_t low = 0, high = fwd->count;
+	while (low < high)
+	{
+		const size_t mid = (low + high) / 2;
+		if (fwd->table[mid].from <= ptr)
+			low = mid + 1;
+		else high = mid;
+	}
+
+	if (low > 0)
+	{
+		const __private_heap_forward* const entry = fwd->table + (low - 1);
+		if (ptr < entry->from + entry->size)
+			*slot = (void*)(entry->to + (ptr - entry->from));
+	}
+}
+
+int klangh_RunGarbageCollector(__private_heap* const heap, const __private_heap_gc_hooks* const hooks)
+{
+	if ((!heap->used && !heap->large_objects) || heap->is_static)
+		return HS_OK;
+
+	if (hooks->roots)
+		hooks->roots(&mark_rooted_slot, heap);
+	sweep_heap(heap, hooks);
+
+	char* const base_ptr = (char*)heap->data;
+	size_t count = 0, offset;
+	for (offset = 0; offset < heap->top; offset += BLOCK_SIZE((__private_heap_header*)(base_ptr + offset)))
+		if (!(((__private_heap_header*)(base_ptr + offset))->flags & HF_FREE))
 			count++;
-			used = header->size;
+
+	/* Lisp2 style sliding compaction: compute new addresses, rewrite every pointer
+	   while the objects are still in place, then slide the blocks down in address order. */
+	__private_heap_forwarding fwd = { base_ptr, base_ptr + heap->top, NULL, 0 };
+	if (count)
+	{
+		fwd.table = (__private_heap_forward*)malloc(sizeof(__private_heap_forward) * count);
+		if (!fwd.table)
+			return HS_OUT_OF_MEMORY;
+	}
+
+	size_t new_top = 0;
+	for (offset = 0; offset < heap->top;)
+	{
+		__private_heap_header* header = (__private_heap_header*)(base_ptr + offset);
+		if (!(header->flags & HF_FREE))
+		{
+			__private_heap_forward* entry = fwd.table + fwd.count++;
+			header->flags &= ~(HF_ROOTED | HF_ZCT);
+			entry->from = (char*)(header + 1);
+			entry->to = base_ptr + new_top + HEADER_SIZE;
+			entry->size = BLOCK_SIZE(header) - HEADER_SIZE;
+			new_top += BLOCK_SIZE(header);
 		}
+		offset += BLOCK_SIZE(header);
+	}
 
-		prev = header;
-		header = header->next;
+	if (hooks->roots)
+		hooks->roots(&forward_slot, &fwd);
+	if (hooks->weak)
+		hooks->weak(&forward_slot, &fwd);
+	if (hooks->trace)
+	{
+		for (size_t i = 0; i < fwd.count; i++)
+		{
+			__private_heap_header* header = ((__private_heap_header*)fwd.table[i].from) - 1;
+			if (header->flags & HF_OBJECT)
+				hooks->trace((void*)(header + 1), &forward_slot, &fwd);
+		}
 	}
 
-	if (count == 0)
+	/* Large blocks stay in place, only the pointers they hold are rewritten. */
+	for (__private_heap_large* block = heap->large_objects; block; block = block->next)
 	{
-		heap->last = NULL;
-		heap->used = 0;
+		block->header.flags &= ~(HF_ROOTED | HF_ZCT);
+		if ((block->header.flags & HF_OBJECT) && hooks->trace)
+			hooks->trace((void*)(block + 1), &forward_slot, &fwd);
 	}
-	else
+
+	for (size_t i = 0; i < fwd.count; i++)
+	{
+		const __private_heap_forward* const entry = fwd.table + i;
+		if (entry->from != entry->to)
+			memmove(entry->to - HEADER_SIZE, entry->from - HEADER_SIZE, entry->size + HEADER_SIZE);
+	}
+
+	free(fwd.table);
+
+	memset(heap->free_classes, 0, sizeof(heap->free_classes));
+	heap->free_large = NULL;
+	heap->top = heap->used = new_top;
+
+	return klangh_Trim(heap);
+}
+
+
+typedef struct {
+
+	__private_heap_header* header;
+	char* end;
+	long long gc_refs;
+	int marked;
+
+} __private_heap_cycle_entry;
+
+typedef struct {
+
+	char* begin;
+	char* end;
+	__private_heap_cycle_entry* table;
+	size_t count;
+	size_t* worklist;
+	size_t pending;
+
+} __private_heap_cycles;
+
+static int compare_cycle_entries(const void* const left, const void* const right)
+{
+	const char* const lhs = (const char*)((const __private_heap_cycle_entry*)left)->header;
+	const char* const rhs = (const char*)((const __private_heap_cycle_entry*)right)->header;
+	return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+static __private_heap_cycle_entry* find_cycle_entry(const __private_heap_cycles* const cycles, const void* const ptr)
+{
+	const char* const cptr = (const char*)ptr;
+	if (cptr < cycles->begin || cptr >= cycles->end)
+		return NULL;
+
+	size_t low = 0, high = cycles->count;
+	while (low < high)
+	{
+		const size_t mid = (low + high) / 2;
+		if ((const char*)(cycles->table[mid].header + 1) <= cptr)
+			low = mid + 1;
+		else high = mid;
+	}
+
+	if (low > 0)
+	{
+		__private_heap_cycle_entry* const entry = cycles->table + (low - 1);
+		if (cptr < entry->end)
+			return entry;
+	}
+	return NULL;
+}
+
+static void subtract_internal_ref(void** const slot, void* const ctx)
+{
+	__private_heap_cycle_entry* const entry = find_cycle_entry((const __private_heap_cycles*)ctx, *slot);
+	if (entry)
+		entry->gc_refs--;
+}
+
+static void mark_reachable(void** const slot, void* const ctx)
+{
+	__private_heap_cycles* const cycles = (__private_heap_cycles*)ctx;
+	__private_heap_cycle_entry* const entry = find_cycle_entry(cycles, *slot);
+	if (entry && !entry->marked)
 	{
-		heap->last = prev;
-		heap->used = used;
+		entry->marked = 1;
+		cycles->worklist[cycles->pending++] = (size_t)(entry - cycles->table);
 	}
+}
+
+/* Trial deletion over the whole heap: every reference that comes from another heap object
+   is subtracted from the counters, so whatever keeps a positive count is referenced from
+   outside the heap (native code). Together with the blocks the roots point to, they seed
+   a mark pass and the blocks it does not reach are cyclic garbage.
+   Blocks with a zero counter are left alone: they are either temporaries held by native
+   code or garbage that the regular collector reclaims. Large blocks waiting in the zero
+   count table are kept too, reclaim() still reads their headers and freeing would unmap them. */
+int klangh_CollectCycles(__private_heap* const heap, const __private_heap_gc_hooks* const hooks)
+{
+	if ((!heap->used && !heap->large_objects) || heap->is_static || !hooks->trace)
+		return HS_OK;
+
+	char* const base_ptr = (char*)heap->data;
+	size_t count = 0, offset, i;
+	__private_heap_large* block;
+	for (offset = 0; offset < heap->top; offset += BLOCK_SIZE((__private_heap_header*)(base_ptr + offset)))
+		if (!(((__private_heap_header*)(base_ptr + offset))->flags & HF_FREE))
+			count++;
+	for (block = heap->large_objects; block; block = block->next)
+		count++;
+	if (!count)
+		return HS_OK;
+
+	__private_heap_cycles cycles = { base_ptr, base_ptr + heap->top, NULL, 0, NULL, 0 };
+	cycles.table = (__private_heap_cycle_entry*)malloc(sizeof(__private_heap_cycle_entry) * count);
+	cycles.worklist = (size_t*)malloc(sizeof(size_t) * count);
+	if (!cycles.table || !cycles.worklist)
+	{
+		free(cycles.table);
+		free(cycles.worklist);
+		return HS_OUT_OF_MEMORY;
+	}
+
+	for (offset = 0; offset < heap->top;)
+	{
+		__private_heap_header* header = (__private_heap_header*)(base_ptr + offset);
+		if (!(header->flags & HF_FREE))
+		{
+			__private_heap_cycle_entry* entry = cycles.table + cycles.count++;
+			entry->header = header;
+			entry->end = ((char*)header) + BLOCK_SIZE(header);
+			entry->gc_refs = header->refs;
+			entry->marked = 0;
+		}
+		offset += BLOCK_SIZE(header);
+	}
+
+	/* Large blocks live in their own mappings, the table is sorted again by address
+	   so lookups still binary search a single range. */
+	if (heap->large_objects)
+	{
+		for (block = heap->large_objects; block; block = block->next)
+		{
+			__private_heap_cycle_entry* entry = cycles.table + cycles.count++;
+			entry->header = &block->header;
+			entry->end = ((char*)block) + block->size;
+			entry->gc_refs = block->header.refs;
+			entry->marked = 0;
+		}
+
+		qsort(cycles.table, cycles.count, sizeof(__private_heap_cycle_entry), &compare_cycle_entries);
+		cycles.begin = (char*)cycles.table[0].header;
+		cycles.end = cycles.table[cycles.count - 1].end;
+	}
+
+	for (i = 0; i < cycles.count; i++)
+		if (cycles.table[i].header->flags & HF_OBJECT)
+			hooks->trace((void*)(cycles.table[i].header + 1), &subtract_internal_ref, &cycles);
+
+	if (hooks->roots)
+		hooks->roots(&mark_reachable, &cycles);
+
+	for (i = 0; i < cycles.count; i++)
+	{
+		__private_heap_cycle_entry* entry = cycles.table + i;
+		if (!entry->marked && (entry->gc_refs > 0 || !entry->header->refs || (entry->header->flags & (HF_ZCT | HF_LARGE)) == (HF_ZCT | HF_LARGE)))
+		{
+			entry->marked = 1;
+			cycles.worklist[cycles.pending++] = i;
+		}
+	}
+
+	while (cycles.pending)
+	{
+		__private_heap_header* header = cycles.table[cycles.worklist[--cycles.pending]].header;
+		if (header->flags & HF_OBJECT)
+			hooks->trace((void*)(header + 1), &mark_reachable, &cycles);
+	}
+
+	/* Finalize every garbage object before releasing any of them, finalizers may still
+	   touch their children. Raw blocks are released by the finalizers of their owners,
+	   large ones are unmapped then, so garbage is picked before any finalizer runs. */
+	for (i = 0; i < cycles.count; i++)
+		if (!cycles.table[i].marked && (cycles.table[i].header->flags & HF_OBJECT))
+			cycles.table[i].marked = -1;
+
+	if (hooks->finalize)
+		for (i = 0; i < cycles.count; i++)
+			if (cycles.table[i].marked < 0)
+				hooks->finalize((void*)(cycles.table[i].header + 1));
+
+	for (i = 0; i < cycles.count; i++)
+		if (cycles.table[i].marked < 0)
+			klangh_Free(heap, (void*)(cycles.table[i].header + 1));
+
+	free(cycles.table);
+	free(cycles.worklist);
+
+	return HS_OK;
+}
+
+
+
+int klangh_CreateNursery(__private_nursery* const nursery, const size_t size)
+{
+	void* nursery_data = malloc(size);
+	if (!nursery_data)
+		return HS_CANNOT_CREATE;
+
+	nursery->capacity = size;
+	nursery->top = 0;
+	nursery->data = nursery_data;
+
+	return HS_OK;
+}
+int klangh_DestroyNursery(__private_nursery* const nursery)
+{
+	free(nursery->data);
+	memset(nursery, 0, sizeof(__private_nursery));
+
+	return HS_OK;
+}
+
+int klangh_NurseryMalloc(__private_nursery* const nursery, const size_t size, void** const ptr)
+{
+	const size_t block_size = ALIGN_SIZE(size) + HEADER_SIZE;
+	if (nursery->top + block_size > nursery->capacity)
+		return HS_HEAP_OVERFLOW;
+
+	__private_heap_header* header = (__private_heap_header*)(((char*)nursery->data) + nursery->top);
+	header->words = block_size / 8;
+	header->refs = 0;
+	header->flags = 0;
+
+	nursery->top += block_size;
+	*ptr = (void*)(header + 1);
+
+	return HS_OK;
+}
+int klangh_IsInNursery(const __private_nursery* const nursery, const void* const ptr)
+{
+	const char* const begin = (const char*)nursery->data;
+	return (const char*)ptr >= begin && (const char*)ptr < begin + nursery->top;
+}
+
+
+typedef struct {
+
+	__private_nursery* nursery;
+	__private_heap* heap;
+	const __private_heap_gc_hooks* hooks;
+	int status;
+
+} __private_nursery_promotion;
+
+/* Copies the young block referenced by the slot into the main heap (once, later slots
+   follow the forwarding pointer left in the old header) and rewrites the slot. */
+static void promote_slot(void** const slot, void* const ctx)
+{
+	__private_nursery_promotion* const promotion = (__private_nursery_promotion*)ctx;
+	if (!klangh_IsInNursery(promotion->nursery, *slot))
+		return;
+
+	__private_heap_header* header = ((__private_heap_header*)*slot) - 1;
+	if (header->flags & HF_FORWARDED)
+	{
+		*slot = *(void**)*slot;
+		return;
+	}
+
+	void* ptr;
+	if (klangh_Malloc(promotion->heap, BLOCK_SIZE(header) - HEADER_SIZE, &ptr) != HS_OK)
+	{
+		promotion->status = HS_HEAP_OVERFLOW;
+		return;
+	}
+
+	__private_heap_header* promoted = ((__private_heap_header*)ptr) - 1;
+	memcpy(ptr, *slot, BLOCK_SIZE(header) - HEADER_SIZE);
+	promoted->refs = header->refs;
+	promoted->flags = header->flags;
+
+	/* The young copy is dead now, its first payload word holds the forwarding pointer. */
+	header->flags |= HF_FORWARDED;
+	*(void**)*slot = ptr;
+	*slot = ptr;
+
+	if ((promoted->flags & HF_OBJECT) && promotion->hooks->trace)
+		promotion->hooks->trace(ptr, &promote_slot, ctx);
+}
+
+/* Promotes every young block reachable from the remembered set (reported through the
+   roots hook) into the main heap and reclaims the whole nursery at once. Young blocks
+   need no finalization: only values without native resources are allocated there. */
+int klangh_MinorCollect(__private_nursery* const nursery, __private_heap* const heap, const __private_heap_gc_hooks* const hooks)
+{
+	if (!nursery->top)
+		return HS_OK;
+
+	__private_nursery_promotion promotion = { nursery, heap, hooks, HS_OK };
+	if (hooks->roots)
+		hooks->roots(&promote_slot, &promotion);
+
+	if (promotion.status != HS_OK)
+		return promotion.status;
 
+	nursery->top = 0;
 	return HS_OK;
 }
@@ -0,0 +1,330 @@
+#include "list.h"
+
+#include <algorithm>
+
+// LIST //
+namespace klang::type
+{
+	List::List() :
+		Value{ Type::List },
+		_writing{ false },
+		_size{ 0 },
+		_start{ 0 },
+		_chunks{ 0 },
+		_allocated{ 0 },
+		_map{ nullptr },
+		_inline{}
+	{}
+	List::~List() { clear(); }
+
+	Tagged* List::allocateChunk()
+	{
+		Tagged* const chunk = reinterpret_cast<Tagged*>(heap::malloc(ChunkCapacity * sizeof(Tagged)));
+		if (!chunk)
+			throw heap::HeapOverflowException{ ChunkCapacity * sizeof(Tagged) };
+
+		heap::incref(chunk);
+		return chunk;
+	}
+	void List::releaseChunk(Tagged* const chunk)
+	{
+		heap::decref(chunk);
+		heap::free(chunk);
+	}
+
+	Tagged* List::slot(const size_t index) const
+	{
+		if (!_map)
+			return const_cast<Tagged*>(_inline) + index;
+
+		const size_t position = (_start + index) & (_chunks * ChunkCapacity - 1);
+		return _map[position / ChunkCapacity] + position % ChunkCapacity;
+	}
+
+	/* Slot at a ring position, allocating its chunk unless a previous pop left it. */
+	Tagged* List::reserveSlot(const size_t position)
+	{
+		Tagged*& chunk = _map[position / ChunkCapacity];
+		if (!chunk)
+		{
+			chunk = allocateChunk();
+			++_allocated;
+		}
+		return chunk + position % ChunkCapacity;
+	}
+
+	size_t List::usedChunks() const { return _size ? (_start % ChunkCapacity + _size - 1) / ChunkCapacity + 1 : 0; }
+
+	/* Moves the inline elements, counts included, to the first chunk of a new map. */
+	void List::spill()
+	{
+		Tagged* const chunk = allocateChunk();
+		Tagged** const map = reinterpret_cast<Tagged**>(heap::malloc(MinChunks * sizeof(Tagged*)));
+		if (!map)
+		{
+			releaseChunk(chunk);
+			throw heap::HeapOverflowException{ MinChunks * sizeof(Tagged*) };
+		}
+
+		heap::incref(map);
+		std::fill_n(map, MinChunks, nullptr);
+		map[0] = chunk;
+		std::copy(_inline, _inline + _size, chunk);
+		std::fill_n(_inline, InlineCapacity, Tagged::undefined());
+
+		_map = map;
+		_chunks = MinChunks;
+		_allocated = 1;
+		_start = 0;
+	}
+
+	/* Only called with every chunk in use. The new map lists them in ring order from the
+	   first one, the elements themselves stay where they are. */
+	void List::growMap()
+	{
+		const size_t chunks = _chunks * 2;
+		Tagged** const map = reinterpret_cast<Tagged**>(heap::malloc(chunks * sizeof(Tagged*)));
+		if (!map)
+			throw heap::HeapOverflowException{ chunks * sizeof(Tagged*) };
+
+		heap::incref(map);
+		const size_t first = _start / ChunkCapacity;
+		for (size_t i = 0; i < _chunks; ++i)
+			map[i] = _map[(first + i) & (_chunks - 1)];
+		std::fill(map + _chunks, map + chunks, nullptr);
+
+		heap::decref(_map);
+		heap::free(_map);
+		_map = map;
+		_chunks = chunks;
+		_start %= ChunkCapacity;
+	}
+
+	/* A chunk emptied by a pop stays in place for the next pushes while there are few
+	   spare chunks, a queue moving along the ring then reuses them without allocating. */
+	void List::dropChunk(const size_t position)
+	{
+		if (_allocated <= usedChunks() + SpareChunks)
+			return;
+
+		Tagged*& chunk = _map[position / ChunkCapacity];
+		releaseChunk(chunk);
+		chunk = nullptr;
+		--_allocated;
+	}
+
+	void List::retain(const Tagged value)
+	{
+		if (Value* const pointer = value.pointer())
+		{
+			heap::incref(pointer);
+			heap::write_barrier(this, pointer);
+		}
+	}
+
+	Tagged List::get(const size_t index) const { return index < _size ? *slot(index) : Tagged::undefined(); }
+
+	void List::set(const size_t index, const Tagged value)
+	{
+		if (index >= _size)
+		{
+			while (_size < index)
+				pushBack(Tagged::undefined());
+			return pushBack(value);
+		}
+
+		Tagged* const target = slot(index);
+		const Tagged old = *target;
+		retain(value);
+		*target = value;
+		if (Value* const pointer = old.pointer())
+			heap::decref(pointer);
+	}
+
+	void List::pushBack(const Tagged value)
+	{
+		if (!_map && _size < InlineCapacity)
+		{
+			retain(value);
+			_inline[_size++] = value;
+			return;
+		}
+
+		if (!_map)
+			spill();
+		if ((_start % ChunkCapacity + _size) / ChunkCapacity + 1 > _chunks)
+			growMap();
+
+		Tagged* const target = reserveSlot((_start + _size) & (_chunks * ChunkCapacity - 1));
+		retain(value);
+		*target = value;
+		++_size;
+	}
+
+	void List::pushFront(const Tagged value)
+	{
+		if (!_map && _size < InlineCapacity)
+		{
+			std::copy_backward(_inline, _inline + _size, _inline + _size + 1);
+			retain(value);
+			_inline[0] = value;
+			++_size;
+			return;
+		}
+
+		if (!_map)
+			spill();
+		if (((_start + ChunkCapacity - 1) % ChunkCapacity + _size) / ChunkCapacity + 1 > _chunks)
+			growMap();
+
+		const size_t start = (_start + _chunks * ChunkCapacity - 1) & (_chunks * ChunkCapacity - 1);
+		Tagged* const target = reserveSlot(start);
+		retain(value);
+		*target = value;
+		_start = start;
+		++_size;
+	}
+
+	Tagged List::popBack()
+	{
+		if (!_size)
+			return Tagged::undefined();
+
+		Tagged* const last = slot(_size - 1);
+		const Tagged value = *last;
+		*last = Tagged::undefined();
+		--_size;
+
+		const size_t position = (_start + _size) & (_chunks * ChunkCapacity - 1);
+		if (_map && (!_size || !(position % ChunkCapacity)))
+			dropChunk(position);
+
+		if (Value* const pointer = value.pointer())
+			heap::decref(pointer);
+		return value;
+	}
+
+	Tagged List::popFront()
+	{
+		if (!_size)
+			return Tagged::undefined();
+
+		Tagged value;
+		if (!_map)
+		{
+			value = _inline[0];
+			std::copy(_inline + 1, _inline + _size, _inline);
+			_inline[--_size] = Tagged::undefined();
+		}
+		else
+		{
+			const size_t position = _start;
+			Tagged* const first = slot(0);
+			value = *first;
+			*first = Tagged::undefined();
+			_start = (_start + 1) & (_chunks * ChunkCapacity - 1);
+			--_size;
+			if (!_size || !(_start % ChunkCapacity))
+				dropChunk(position);
+		}
+
+		if (Value* const pointer = value.pointer())
+			heap::decref(pointer);
+		return value;
+	}
+
+	void List::clear()
+	{
+		for (size_t i = 0; i < _size; ++i)
+			if (Value* const pointer = slot(i)->pointer())
+				heap::decref(pointer);
+
+		if (_map)
+		{
+			for (size_t i = 0; i < _chunks; ++i)
+				if (_map[i])
+					releaseChunk(_map[i]);
+			heap::decref(_map);
+			heap::free(_map);
+		}
+
+		std::fill_n(_inline, InlineCapacity, Tagged::undefined());
+		_map = nullptr;
+		_chunks = 0;
+		_allocated = 0;
+		_start = 0;
+		_size = 0;
+	}
+
+	List::operator Int32() const { return static_cast<Int32>(_size); }
+	List::operator Int64() const { return static_cast<Int64>(_size); }
+	List::operator float() const { return static_cast<float>(_size); }
+	List::operator double() const { return static_cast<double>(_size); }
+	List::operator bool() const { return _size != 0; }
+	List::operator std::wstring() const
+	{
+		std::wstring text;
+		WStringSink sink{ text };
+		writeTo(sink);
+		return text;
+	}
+	List::operator ValueVector() const
+	{
+		ValueVector result;
+		result.reserve(_size);
+		for (size_t i = 0; i < _size; ++i)
+			result.push_back(slot(i)->box());
+		return result;
+	}
+
+	/* A list reached again while it is being written shows as [...]. */
+	void List::writeTo(TextSink& sink) const
+	{
+		if (_writing)
+			return sink.write("[...]", 5);
+
+		_writing = true;
+		sink.write("[", 1);
+		for (size_t i = 0; i < _size; ++i)
+		{
+			if (i)
+				sink.write(", ", 2);
+			slot(i)->writeTo(sink);
+		}
+		sink.write("]", 1);
+		_writing = false;
+	}
+
+	Value* List::klang_operatorArrayGet(Value* index)
+	{
+		const Int64 idx = static_cast<Int64>(*index);
+		return idx < 0 ? constant::Undefined : get(static_cast<size_t>(idx)).box();
+	}
+	void List::klang_operatorArraySet(Value* index, Value* value)
+	{
+		const Int64 idx = static_cast<Int64>(*index);
+		if (idx < 0)
+			throw IndexException{ idx };
+		set(static_cast<size_t>(idx), Tagged{ value });
+	}
+
+	/* Element slots first, then the chunks and the map holding them: compaction rewrites
+	   pointers while blocks are still in place. */
+	void List::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		for (size_t i = 0; i < _size; ++i)
+		{
+			Tagged* const element = slot(i);
+			if (element->isPointer())
+				visitor(reinterpret_cast<void**>(element), ctx);
+		}
+
+		if (_map)
+		{
+			for (size_t i = 0; i < _chunks; ++i)
+				if (_map[i])
+					visitor(reinterpret_cast<void**>(_map + i), ctx);
+			visitor(reinterpret_cast<void**>(&_map), ctx);
+		}
+	}
+}
@@ -1,17 +1,189 @@
 #include "rawmem.h"
 #include "types.h"
 #include "ref.h"
+#include "array.h"
+#include "builtins.h"
 
 #include "stacks.h"
 
 #include <iostream>
+#include <chrono>
+#include <string>
 
 using namespace klang::type;
 using klang::Ref;
 
+
+/* Compares the boxed __Number path (virtual operator, virtual conversion, young
+   allocation) against the tagged dispatch table on the same integer and float loops. */
+static void BenchmarkOperators()
+{
+	constexpr int Iterations = 10000000;
+	using Clock = std::chrono::steady_clock;
+	const auto report = [](const char* const name, const Clock::time_point start, const double result) {
+		const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Iterations;
+		std::cout << name << ": " << ns << " ns/op (" << result << ")" << std::endl;
+	};
+
+	{
+		Value* slots[2] = { newInteger(0), newInteger(1) };
+		klang::heap::RootSet roots{ reinterpret_cast<void**>(slots), 2 };
+		roots.barrier(slots[0]);
+		const auto start = Clock::now();
+		for (int i = 0; i < Iterations; i++)
+		{
+			slots[0] = slots[0]->klang_operatorPlus(slots[1]);
+			roots.barrier(slots[0]);
+			klang::heap::safepoint();
+		}
+		report("boxed   integer +", start, static_cast<klang::Int64>(*slots[0]));
+	}
+	{
+		Tagged acc = Tagged::fromInteger(0);
+		const Tagged one = Tagged::fromInteger(1);
+		const auto start = Clock::now();
+		for (int i = 0; i < Iterations; i++)
+			acc = klang_operatorPlus(acc, one);
+		report("tagged  integer +", start, static_cast<klang::Int64>(acc));
+	}
+	{
+		Value* slots[2] = { newDouble(0), newDouble(0.5) };
+		klang::heap::RootSet roots{ reinterpret_cast<void**>(slots), 2 };
+		roots.barrier(slots[0]);
+		const auto start = Clock::now();
+		for (int i = 0; i < Iterations; i++)
+		{
+			slots[0] = slots[0]->klang_operatorMultiply(slots[1])->klang_operatorPlus(slots[1]);
+			roots.barrier(slots[0]);
+			klang::heap::safepoint();
+		}
+		report("boxed   float *+", start, static_cast<double>(*slots[0]));
+	}
+	{
+		Tagged acc = Tagged::fromDouble(0);
+		const Tagged half = Tagged::fromDouble(0.5);
+		const auto start = Clock::now();
+		for (int i = 0; i < Iterations; i++)
+			acc = klang_operatorPlus(klang_operatorMultiply(acc, half), half);
+		report("tagged  float *+", start, static_cast<double>(acc));
+	}
+}
+
+/* Sums and filters packed arrays with the interpreted loops (boxed virtual operators,
+   then tagged operators) and with the builtins, at every simd level of this CPU. */
+static void BenchmarkArrays()
+{
+	constexpr int Elements = 1000000;
+	constexpr int Repeats = 10;
+	using Clock = std::chrono::steady_clock;
+	const auto report = [](const char* const name, const char* const level, const Clock::time_point start, const double result) {
+		const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (static_cast<double>(Elements) * Repeats);
+		std::cout << name << level << ": " << ns << " ns/element (" << result << ")" << std::endl;
+	};
+
+	Value* arrays[2] = { newArray(), newArray() };
+	klang::heap::RootSet roots{ reinterpret_cast<void**>(arrays), 2 };
+	Array& integers = *static_cast<Array*>(arrays[0]);
+	Array& doubles = *static_cast<Array*>(arrays[1]);
+	for (int i = 0; i < Elements; i++)
+	{
+		integers.push(Tagged::fromInteger(i % 1000));
+		doubles.push(Tagged::fromDouble(i * 0.25));
+	}
+	const Tagged threshold = Tagged::fromInteger(500);
+
+	{
+		Value* slots[1] = { newInteger(0) };
+		klang::heap::RootSet accumulator{ reinterpret_cast<void**>(slots), 1 };
+		const auto start = Clock::now();
+		for (int r = 0; r < Repeats; r++)
+		{
+			slots[0] = newInteger(0);
+			for (int i = 0; i < Elements; i++)
+			{
+				slots[0] = slots[0]->klang_operatorPlus(integers.klang_operatorArrayGet(newLongInteger(i)));
+				accumulator.barrier(slots[0]);
+				klang::heap::safepoint();
+			}
+		}
+		report("boxed   integer sum", "", start, static_cast<double>(*slots[0]));
+	}
+	{
+		Tagged acc;
+		const auto start = Clock::now();
+		for (int r = 0; r < Repeats; r++)
+		{
+			acc = Tagged::fromInteger(0);
+			for (int i = 0; i < Elements; i++)
+				acc = klang_operatorPlus(acc, klang_operatorArrayGet(Tagged{ arrays[0] }, Tagged::fromInteger(i)));
+		}
+		report("tagged  integer sum", "", start, static_cast<double>(acc));
+	}
+	{
+		size_t kept = 0;
+		const auto start = Clock::now();
+		for (int r = 0; r < Repeats; r++)
+		{
+			Array* const result = newArray();
+			for (int i = 0; i < Elements; i++)
+			{
+				const Tagged value = integers.get(i);
+				if (static_cast<bool>(klang_operatorGreater(value, threshold)))
+					result->push(value);
+			}
+			kept = result->size();
+			klang::heap::safepoint();
+		}
+		report("tagged  integer filter", "", start, static_cast<double>(kept));
+	}
+
+	const klang::simd::Level supported = klang::simd::supported();
+	for (int l = 0; l <= static_cast<int>(supported); l++)
+	{
+		const klang::simd::Level level = static_cast<klang::simd::Level>(l);
+		klang::simd::limit(level);
+		const std::string suffix = std::string{ " [" } + klang::simd::name(level) + "]";
+		{
+			Tagged acc;
+			const auto start = Clock::now();
+			for (int r = 0; r < Repeats; r++)
+				acc = klang::builtin::sum(integers);
+			report("builtin integer sum", suffix.c_str(), start, static_cast<double>(acc));
+		}
+		{
+			Tagged acc;
+			const auto start = Clock::now();
+			for (int r = 0; r < Repeats; r++)
+				acc = klang::builtin::sum(doubles);
+			report("builtin float sum", suffix.c_str(), start, static_cast<double>(acc));
+		}
+		{
+			size_t kept = 0;
+			const auto start = Clock::now();
+			for (int r = 0; r < Repeats; r++)
+			{
+				const Array* const mask = klang::builtin::compare(klang::simd::Comparison::Greater, integers, threshold);
+				kept = klang::builtin::filter(integers, *mask)->size();
+				klang::heap::safepoint();
+			}
+			report("builtin integer filter", suffix.c_str(), start, static_cast<double>(kept));
+		}
+	}
+	klang::simd::limit(supported);
+}
+
  
 int main(int argc, char** argv)
 {
+	klang::heap::s_seal();
+
+	if (argc > 1 && std::string{ argv[1] } == "--bench")
+	{
+		BenchmarkOperators();
+		BenchmarkArrays();
+		return 0;
+	}
+
 	Ref val;
 	
 	Ref a = 15, b = -7;
@@ -0,0 +1,492 @@
+#include "object.h"
+
+#include <algorithm>
+#include <atomic>
+
+// SHAPE TABLE //
+namespace klang::type
+{
+	ShapeTable::ShapeTable() :
+		Value{ Type::Internal },
+		_count{ 0 },
+		_capacity{ 0 },
+		_names{ nullptr },
+		_indexSize{ 0 },
+		_index{ nullptr }
+	{}
+	ShapeTable::ShapeTable(const ShapeTable* const table, const size_t count) :
+		ShapeTable{}
+	{
+		reserve(std::max<size_t>(count + 1, 4));
+		for (size_t slot = 0; slot < count; ++slot)
+		{
+			_names[slot] = table->_names[slot];
+			heap::incref(_names[slot]);
+			_count = slot + 1;
+			insert(slot);
+		}
+	}
+	ShapeTable::~ShapeTable()
+	{
+		for (size_t slot = 0; slot < _count; ++slot)
+			heap::decref(_names[slot]);
+		if (_names)
+		{
+			heap::decref(_names);
+			heap::free(_names);
+		}
+		if (_index)
+		{
+			heap::decref(_index);
+			heap::free(_index);
+		}
+	}
+
+	/* Power of two at least twice the capacity, for short linear probes. */
+	size_t ShapeTable::IndexSize(const size_t capacity)
+	{
+		size_t size = 16;
+		while (size < capacity * 2)
+			size *= 2;
+		return size;
+	}
+
+	void ShapeTable::reserve(const size_t capacity)
+	{
+		void* const names = heap::realloc(_names, capacity * sizeof(String*));
+		if (!names)
+			throw heap::HeapOverflowException{ capacity * sizeof(String*) };
+
+		if (!_names)
+			heap::incref(names);
+		_names = reinterpret_cast<String**>(names);
+		_capacity = capacity;
+		if (capacity > ScanMaxCount && IndexSize(capacity) != _indexSize)
+			buildIndex(IndexSize(capacity));
+	}
+
+	/* Open addressing on the string hash, which unlike the address survives compaction.
+	   Entries are slot + 1, zero is empty. */
+	void ShapeTable::buildIndex(const size_t size)
+	{
+		UInt32* const index = reinterpret_cast<UInt32*>(heap::malloc(size * sizeof(UInt32)));
+		if (!index)
+			throw heap::HeapOverflowException{ size * sizeof(UInt32) };
+
+		heap::incref(index);
+		std::fill_n(index, size, 0);
+		if (_index)
+		{
+			heap::decref(_index);
+			heap::free(_index);
+		}
+
+		_index = index;
+		_indexSize = size;
+		for (size_t slot = 0; slot < _count; ++slot)
+			insert(slot);
+	}
+
+	void ShapeTable::insert(const size_t slot)
+	{
+		if (!_index)
+			return;
+
+		size_t at = _names[slot]->hash() & (_indexSize - 1);
+		while (_index[at])
+			at = (at + 1) & (_indexSize - 1);
+		_index[at] = static_cast<UInt32>(slot + 1);
+	}
+
+	/* Names are unique within a table, so a match past count is a miss. */
+	size_t ShapeTable::find(const String* const name, const size_t count) const
+	{
+		if (!_index)
+		{
+			for (size_t slot = 0; slot < count; ++slot)
+				if (_names[slot] == name)
+					return slot;
+			return Shape::NotFound;
+		}
+
+		for (size_t at = name->hash() & (_indexSize - 1); _index[at]; at = (at + 1) & (_indexSize - 1))
+			if (_names[_index[at] - 1] == name)
+				return _index[at] - 1 < count ? _index[at] - 1 : Shape::NotFound;
+		return Shape::NotFound;
+	}
+
+	void ShapeTable::append(String* const name)
+	{
+		if (_count == _capacity)
+			reserve(std::max<size_t>(_capacity * 2, 4));
+
+		_names[_count] = name;
+		heap::incref(name);
+		insert(_count++);
+	}
+
+	ShapeTable::operator Int32() const { return static_cast<Int32>(_count); }
+	ShapeTable::operator Int64() const { return static_cast<Int64>(_count); }
+	ShapeTable::operator float() const { return static_cast<float>(_count); }
+	ShapeTable::operator double() const { return static_cast<double>(_count); }
+	ShapeTable::operator bool() const { return _count != 0; }
+
+	/* Pointers inside a buffer are visited before the buffer: compaction rewrites them
+	   while blocks are still in place. */
+	void ShapeTable::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		for (size_t slot = 0; slot < _count; ++slot)
+			visitor(reinterpret_cast<void**>(_names + slot), ctx);
+		if (_names)
+			visitor(reinterpret_cast<void**>(&_names), ctx);
+		if (_index)
+			visitor(reinterpret_cast<void**>(&_index), ctx);
+	}
+}
+
+
+
+// SHAPE //
+namespace klang::type
+{
+	static std::atomic<UInt32> NextShapeId{ 1 };
+
+	Shape::Shape() :
+		Value{ Type::Internal },
+		_id{ NextShapeId++ },
+		_count{ 0 },
+		_dictionary{ false },
+		_parent{ nullptr },
+		_table{ nullptr },
+		_transitionCount{ 0 },
+		_transitionCapacity{ 0 },
+		_transitions{ nullptr }
+	{}
+	Shape::Shape(Shape* const parent, String* const name) :
+		Value{ Type::Internal },
+		_id{ NextShapeId++ },
+		_count{ parent->_count },
+		_dictionary{ false },
+		_parent{ nullptr },
+		_table{ nullptr },
+		_transitionCount{ 0 },
+		_transitionCapacity{ 0 },
+		_transitions{ nullptr }
+	{
+		_table = TableFor(parent);
+		heap::incref(_table);
+		_table->append(name);
+		++_count;
+
+		_parent = parent;
+		heap::incref(parent);
+	}
+	Shape::Shape(const Shape* const shape) :
+		Value{ Type::Internal },
+		_id{ NextShapeId++ },
+		_count{ shape->_count },
+		_dictionary{ true },
+		_parent{ nullptr },
+		_table{ nullptr },
+		_transitionCount{ 0 },
+		_transitionCapacity{ 0 },
+		_transitions{ nullptr }
+	{
+		_table = heap::create<ShapeTable>(static_cast<const ShapeTable*>(shape->_table), shape->_count);
+		heap::incref(_table);
+	}
+	Shape::~Shape()
+	{
+		for (size_t i = 0; i < _transitionCount; ++i)
+		{
+			heap::decref(_transitions[i].name);
+			heap::decref(_transitions[i].shape);
+		}
+		if (_transitions)
+		{
+			heap::decref(_transitions);
+			heap::free(_transitions);
+		}
+
+		if (_table)
+			heap::decref(_table);
+		if (_parent)
+			heap::decref(_parent);
+	}
+
+	/* Table a shape extending the given one appends to: the same one while the given shape
+	   holds all of its names, otherwise a copy of its prefix. Dictionary shapes always copy,
+	   the names only they add die with them. */
+	ShapeTable* Shape::TableFor(const Shape* const shape)
+	{
+		if (shape->_table && shape->_table->size() == shape->_count)
+			return shape->_table;
+
+		const ShapeTable* const table = shape->_table;
+		return table ? heap::create<ShapeTable>(table, shape->_count) : heap::create<ShapeTable>();
+	}
+
+	/* Most shapes have a single transition, a scan beats hashing. */
+	Shape* Shape::with(String* const name)
+	{
+		if (_dictionary)
+		{
+			_table->append(name);
+			++_count;
+			return this;
+		}
+
+		for (size_t i = 0; i < _transitionCount; ++i)
+			if (_transitions[i].name == name)
+				return _transitions[i].shape;
+
+		if (_count >= DictionaryMinCount)
+			return heap::create<Shape>(static_cast<const Shape*>(this))->with(name);
+
+		Shape* const shape = heap::create<Shape>(this, name);
+		if (_transitionCount == _transitionCapacity)
+		{
+			const size_t capacity = std::max<size_t>(_transitionCapacity * 2, 2);
+			void* const transitions = heap::realloc(_transitions, capacity * sizeof(Transition));
+			if (!transitions)
+				throw heap::HeapOverflowException{ capacity * sizeof(Transition) };
+
+			if (!_transitions)
+				heap::incref(transitions);
+			_transitions = reinterpret_cast<Transition*>(transitions);
+			_transitionCapacity = capacity;
+		}
+
+		heap::incref(name);
+		heap::incref(shape);
+		_transitions[_transitionCount++] = { name, shape };
+		return shape;
+	}
+
+	/* Kept in the isolate state, which roots it and lets compaction move it. The shapes
+	   below it are owned through the transitions. */
+	Shape* Shape::root()
+	{
+		if (void* const shape = heap::root_shape())
+			return reinterpret_cast<Shape*>(shape);
+
+		Shape* const shape = heap::create<Shape>();
+		heap::set_root_shape(shape);
+		return shape;
+	}
+
+	Shape::operator Int32() const { return static_cast<Int32>(_count); }
+	Shape::operator Int64() const { return static_cast<Int64>(_count); }
+	Shape::operator float() const { return static_cast<float>(_count); }
+	Shape::operator double() const { return static_cast<double>(_count); }
+	Shape::operator bool() const { return _count != 0; }
+
+	void Shape::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		for (size_t i = 0; i < _transitionCount; ++i)
+		{
+			visitor(reinterpret_cast<void**>(&_transitions[i].name), ctx);
+			visitor(reinterpret_cast<void**>(&_transitions[i].shape), ctx);
+		}
+		if (_transitions)
+			visitor(reinterpret_cast<void**>(&_transitions), ctx);
+
+		if (_table)
+			visitor(reinterpret_cast<void**>(&_table), ctx);
+		if (_parent)
+			visitor(reinterpret_cast<void**>(&_parent), ctx);
+	}
+}
+
+
+
+// OBJECT //
+namespace klang::type
+{
+	static std::wstring WidenName(const std::string& name)
+	{
+		std::wstring result;
+		result.reserve(name.size());
+		for (const char c : name)
+			result.push_back(static_cast<wchar_t>(static_cast<UInt8>(c)));
+		return result;
+	}
+
+	Object::Object() :
+		Value{ Type::Object },
+		_writing{ false },
+		_shape{ Shape::root() },
+		_capacity{ 0 },
+		_overflow{ nullptr },
+		_inline{}
+	{
+		heap::incref(_shape);
+	}
+	Object::~Object()
+	{
+		for (size_t i = 0; i < _shape->size(); ++i)
+			if (Value* const pointer = slot(i)->pointer())
+				heap::decref(pointer);
+
+		if (_overflow)
+		{
+			heap::decref(_overflow);
+			heap::free(_overflow);
+		}
+		heap::decref(_shape);
+	}
+
+	void Object::retain(const Tagged value)
+	{
+		if (Value* const pointer = value.pointer())
+		{
+			heap::incref(pointer);
+			heap::write_barrier(this, pointer);
+		}
+	}
+
+	/* The slot is made room for before the shape grows, a dictionary shape takes the name
+	   in place. Nothing allocates between the shape change and the store, so the collector
+	   never traces an unset slot. */
+	size_t Object::store(String* const name, const Tagged value)
+	{
+		String* const key = name->intern();
+		const size_t index = _shape->find(key);
+		if (index != Shape::NotFound)
+		{
+			setSlot(index, value);
+			return index;
+		}
+
+		const size_t count = _shape->size();
+		if (count >= InlineSlots + _capacity)
+		{
+			const size_t capacity = std::max<size_t>(_capacity * 2, InlineSlots);
+			void* const overflow = heap::realloc(_overflow, capacity * sizeof(Tagged));
+			if (!overflow)
+				throw heap::HeapOverflowException{ capacity * sizeof(Tagged) };
+
+			if (!_overflow)
+				heap::incref(overflow);
+			_overflow = reinterpret_cast<Tagged*>(overflow);
+			std::fill(_overflow + _capacity, _overflow + capacity, Tagged::undefined());
+			_capacity = capacity;
+		}
+
+		Shape* const shape = _shape->with(key);
+		retain(value);
+		*slot(count) = value;
+		if (shape != _shape)
+		{
+			heap::incref(shape);
+			heap::decref(_shape);
+			_shape = shape;
+		}
+		return count;
+	}
+
+	Tagged Object::getMissed(const String* const name, PropertyCache& cache) const
+	{
+		const size_t index = _shape->find(name);
+		if (index == Shape::NotFound)
+			return Tagged::undefined();
+
+		cache.shape = _shape->id();
+		cache.slot = static_cast<UInt32>(index);
+		return *slot(index);
+	}
+
+	void Object::setSlot(const size_t index, const Tagged value)
+	{
+		Tagged* const target = slot(index);
+		const Tagged old = *target;
+		retain(value);
+		*target = value;
+		if (Value* const pointer = old.pointer())
+			heap::decref(pointer);
+	}
+
+	Tagged Object::get(const String* const name) const
+	{
+		const size_t index = _shape->find(name);
+		return index == Shape::NotFound ? Tagged::undefined() : *slot(index);
+	}
+
+	void Object::set(String* const name, const Tagged value) { store(name, value); }
+	void Object::set(String* const name, const Tagged value, PropertyCache& cache)
+	{
+		if (cache.shape == _shape->id())
+			return setSlot(cache.slot, value);
+
+		const size_t index = store(name, value);
+		cache.shape = _shape->id();
+		cache.slot = static_cast<UInt32>(index);
+	}
+
+	Object::operator Int32() const { return static_cast<Int32>(size()); }
+	Object::operator Int64() const { return static_cast<Int64>(size()); }
+	Object::operator float() const { return static_cast<float>(size()); }
+	Object::operator double() const { return static_cast<double>(size()); }
+	Object::operator bool() const { return size() != 0; }
+	Object::operator std::wstring() const
+	{
+		std::wstring text;
+		WStringSink sink{ text };
+		writeTo(sink);
+		return text;
+	}
+	Object::operator ValueMap() const
+	{
+		ValueMap result;
+		for (size_t i = 0; i < size(); ++i)
+		{
+			const std::wstring wide = static_cast<std::wstring>(*_shape->name(i));
+			std::string name;
+			name.reserve(wide.size());
+			for (const wchar_t c : wide)
+				name.push_back(static_cast<char>(c));
+			result.emplace(std::move(name), slot(i)->box());
+		}
+		return result;
+	}
+
+	/* An object reached again while it is being written shows as {...}. */
+	void Object::writeTo(TextSink& sink) const
+	{
+		if (_writing)
+			return sink.write("{...}", 5);
+
+		_writing = true;
+		sink.write("{", 1);
+		for (size_t i = 0; i < size(); ++i)
+		{
+			if (i)
+				sink.write(", ", 2);
+			_shape->name(i)->writeTo(sink);
+			sink.write(": ", 2);
+			slot(i)->writeTo(sink);
+		}
+		sink.write("}", 1);
+		_writing = false;
+	}
+
+	/* Names never interned cannot be property names, looking them up does not intern them. */
+	Value* Object::klang_operatorGetProperty(const std::string& name)
+	{
+		const String* const key = String::findInterned(WidenName(name));
+		return key ? get(key).box() : constant::Undefined;
+	}
+	void Object::klang_operatorGetProperty(const std::string& name, Value* value) { set(String::intern(WidenName(name)), Tagged{ value }); }
+
+	/* Slots first, then the overflow buffer and the shape: compaction rewrites pointers
+	   while blocks are still in place. */
+	void Object::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		for (size_t i = 0; i < _shape->size(); ++i)
+			if (slot(i)->isPointer())
+				visitor(reinterpret_cast<void**>(slot(i)), ctx);
+		if (_overflow)
+			visitor(reinterpret_cast<void**>(&_overflow), ctx);
+		visitor(reinterpret_cast<void**>(&_shape), ctx);
+	}
+}
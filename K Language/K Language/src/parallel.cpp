@@ -0,0 +1,132 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace klang::parallel
+{
+	static thread_local bool InsideTask = false;
+
+	/* Workers sleep until the job generation changes, then claim task indices from a
+	   shared counter until none are left. A job ends once every worker has seen it, so
+	   the next one never races with a late worker of the previous one. */
+	class Pool
+	{
+	private:
+		std::vector<std::thread> _threads;
+		std::mutex _busy;
+		std::mutex _lock;
+		std::condition_variable _wake;
+		std::condition_variable _done;
+		UInt64 _generation;
+		size_t _active;
+		bool _stopping;
+
+		Task _task;
+		void* _ctx;
+		size_t _count;
+		std::atomic<size_t> _next;
+
+	public:
+		Pool() :
+			_generation{ 0 },
+			_active{ 0 },
+			_stopping{ false },
+			_task{ nullptr },
+			_ctx{ nullptr },
+			_count{ 0 },
+			_next{ 0 }
+		{
+			const size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+			for (size_t i = 1; i < threads; ++i)
+				_threads.emplace_back(&Pool::work, this);
+		}
+		~Pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock{ _lock };
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (std::thread& thread : _threads)
+				thread.join();
+		}
+
+		inline size_t size() const { return _threads.size() + 1; }
+
+		bool run(const size_t count, Task task, void* const ctx)
+		{
+			std::unique_lock<std::mutex> busy{ _busy, std::try_to_lock };
+			if (!busy.owns_lock() || InsideTask)
+				return false;
+
+			{
+				std::lock_guard<std::mutex> lock{ _lock };
+				_task = task;
+				_ctx = ctx;
+				_count = count;
+				_next = 0;
+				_active = _threads.size();
+				++_generation;
+			}
+			_wake.notify_all();
+
+			InsideTask = true;
+			execute();
+			InsideTask = false;
+
+			std::unique_lock<std::mutex> lock{ _lock };
+			_done.wait(lock, [this] { return !_active; });
+			return true;
+		}
+
+	private:
+		void execute()
+		{
+			for (size_t index; (index = _next.fetch_add(1)) < _count;)
+				_task(index, _ctx);
+		}
+
+		void work()
+		{
+			InsideTask = true;
+			UInt64 seen = 0;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock{ _lock };
+					_wake.wait(lock, [this, seen] { return _stopping || _generation != seen; });
+					if (_stopping)
+						return;
+					seen = _generation;
+				}
+
+				execute();
+
+				std::lock_guard<std::mutex> lock{ _lock };
+				if (!--_active)
+					_done.notify_one();
+			}
+		}
+	};
+
+	static Pool& Shared()
+	{
+		static Pool pool;
+		return pool;
+	}
+
+	size_t concurrency() { return Shared().size(); }
+
+	void run(const size_t count, Task task, void* const ctx)
+	{
+		if (count > 1 && Shared().run(count, task, ctx))
+			return;
+		for (size_t i = 0; i < count; ++i)
+			task(i, ctx);
+	}
+}
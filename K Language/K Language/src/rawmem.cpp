@@ -1,9 +1,19 @@
 #include "rawmem.h"
 
+#include <vector>
+#include <unordered_map>
+
 #include "heap.h"
+#include "types.h"
 
-#define DEFAULT_HEAP_SIZE (64 * 1024 * 1024)
+#define DEFAULT_HEAP_SIZE (HEAP_CHUNK_SIZE)
+#define DEFAULT_HEAP_SOFT_LIMIT (64 * 1024 * 1024)
+#define DEFAULT_HEAP_LIMIT (sizeof(void*) >= 8 ? (static_cast<size_t>(16) << 30) : (static_cast<size_t>(1) << 30))
 #define DEFAULT_STATIC_HEAP_SIZE (8192)
+#define DEFAULT_STATIC_HEAP_LIMIT (16 * 1024 * 1024)
+#define DEFAULT_NURSERY_SIZE (256 * 1024)
+#define DEFAULT_CYCLE_THRESHOLD (4 * 1024 * 1024)
+#define DEFAULT_ZCT_BATCH (1024)
 
 namespace klang::heap
 {
@@ -15,7 +25,10 @@ namespace klang::heap
 		Heap(bool isStatic) :
 			mem{}
 		{
-			klangh_CreateHeap(&mem, (isStatic ? DEFAULT_STATIC_HEAP_SIZE : DEFAULT_HEAP_SIZE), isStatic);
+			if (isStatic)
+				klangh_CreateHeap(&mem, DEFAULT_STATIC_HEAP_SIZE, DEFAULT_STATIC_HEAP_LIMIT, true);
+			else if (klangh_CreateHeap(&mem, DEFAULT_HEAP_SIZE, DEFAULT_HEAP_LIMIT, false) == HS_OK)
+				klangh_SetLimits(&mem, DEFAULT_HEAP_SOFT_LIMIT, mem.limit);
 		}
 		~Heap()
 		{
@@ -24,13 +37,280 @@ namespace klang::heap
 
 		Heap(const Heap&) = delete;
 		Heap& operator= (const Heap&) = delete;
+	};
+
+
+
+	class Nursery
+	{
+	public:
+		__private_nursery mem;
+		bool full;
+
+		Nursery() :
+			mem{},
+			full{ false }
+		{
+			klangh_CreateNursery(&mem, DEFAULT_NURSERY_SIZE);
+		}
+		~Nursery()
+		{
+			klangh_DestroyNursery(&mem);
+		}
 
-		static Heap Default;
-		static Heap Static;
+		Nursery(const Nursery&) = delete;
+		Nursery& operator= (const Nursery&) = delete;
 	};
 
-	Heap Heap::Default{ false };
-	Heap Heap::Static{ true };
+
+
+	struct Isolate::State
+	{
+		Isolate* const Owner;
+
+		Heap Default;
+		Nursery Young;
+
+		RootSet Roots;
+		std::vector<RootSet*> RememberedRoots;
+		std::vector<void*> RememberedObjects;
+		std::vector<void*> ZeroCount;
+		std::vector<void*> Rooted;
+		std::unordered_multimap<size_t, void*> Interned;
+		void* RootShape;
+
+		size_t CycleThreshold;
+		size_t SoftLimit;
+		bool CyclesDue;
+		bool LimitReached;
+
+		State(Isolate* const owner) :
+			Owner{ owner },
+			Default{ false },
+			Young{},
+			Roots{},
+			RememberedRoots{},
+			RememberedObjects{},
+			ZeroCount{},
+			Rooted{},
+			Interned{},
+			RootShape{ nullptr },
+			CycleThreshold{ DEFAULT_CYCLE_THRESHOLD },
+			SoftLimit{ DEFAULT_HEAP_SOFT_LIMIT },
+			CyclesDue{ false },
+			LimitReached{ false }
+		{}
+	};
+
+	static thread_local Isolate::State* CurrentState = nullptr;
+
+	/* Immortal region shared by every isolate. Filled single threaded at startup (builtin
+	   constants, script constant pools), then sealed read-only. Never destroyed, like the
+	   main isolate, because constants outlive every other static object. */
+	static Heap& Immortal()
+	{
+		static Heap* const instance = new Heap(true);
+		return *instance;
+	}
+
+	static inline Isolate::State& Current() { return CurrentState ? *CurrentState : *Isolate::main().state(); }
+}
+
+
+
+namespace klang::heap
+{
+	HeapOverflowException::HeapOverflowException(const size_t size) noexcept :
+		KlangException{ "Klang heap cannot allocate " + std::to_string(size) + " bytes." }
+	{}
+}
+
+
+
+namespace klang::heap
+{
+	Isolate::Isolate() :
+		_state{ new State(this) }
+	{}
+	Isolate::~Isolate()
+	{
+		if (CurrentState == _state)
+			CurrentState = nullptr;
+		delete _state;
+	}
+
+	/* The main isolate owns the builtin constants and is intentionally never destroyed,
+	   so Refs with static storage duration can outlive every other static object. */
+	Isolate& Isolate::main()
+	{
+		static Isolate* const instance = new Isolate();
+		return *instance;
+	}
+
+	Isolate& Isolate::current()
+	{
+		return CurrentState ? *CurrentState->Owner : main();
+	}
+
+	Isolate::Scope::Scope(Isolate& isolate) noexcept :
+		_previous{ CurrentState }
+	{
+		CurrentState = isolate._state;
+	}
+	Isolate::Scope::~Scope()
+	{
+		CurrentState = _previous;
+	}
+}
+
+
+
+namespace klang::heap
+{
+	/* Sentinel of the circular root list, so root sets unlink without knowing their isolate. */
+	RootSet::RootSet() noexcept :
+		_prev{ this },
+		_next{ this },
+		_slots{ nullptr },
+		_count{ 0 },
+		_tagged{ false },
+		_remembered{ 0 }
+	{}
+
+	RootSet::RootSet(void** const slots, const size_t count) noexcept :
+		_prev{ &Current().Roots },
+		_next{ Current().Roots._next },
+		_slots{ slots },
+		_count{ count },
+		_tagged{ false },
+		_remembered{ 0 }
+	{
+		_next->_prev = this;
+		_prev->_next = this;
+	}
+	RootSet::RootSet(UInt64* const slots, const size_t count) noexcept :
+		_prev{ &Current().Roots },
+		_next{ Current().Roots._next },
+		_slots{ reinterpret_cast<void**>(slots) },
+		_count{ count },
+		_tagged{ true },
+		_remembered{ 0 }
+	{
+		_next->_prev = this;
+		_prev->_next = this;
+	}
+	RootSet::~RootSet()
+	{
+		_prev->_next = _next;
+		_next->_prev = _prev;
+		if (_remembered)
+			Current().RememberedRoots[_remembered - 1] = nullptr;
+	}
+
+	/* A tagged pointer sits in the low word of its slot, so the slot address doubles as
+	   a pointer slot on 32 bit targets too. */
+	void RootSet::visit(SlotVisitor visitor, void* const ctx)
+	{
+		if (_tagged)
+		{
+			UInt64* const slots = reinterpret_cast<UInt64*>(_slots);
+			for (size_t i = 0; i < _count; i++)
+				if (is_tagged_pointer(slots[i]))
+					visitor(reinterpret_cast<void**>(slots + i), ctx);
+		}
+		else
+		{
+			for (size_t i = 0; i < _count; i++)
+				if (_slots[i])
+					visitor(_slots + i, ctx);
+		}
+	}
+
+	void RootSet::remember()
+	{
+		std::vector<RootSet*>& remembered = Current().RememberedRoots;
+		remembered.push_back(this);
+		_remembered = remembered.size();
+	}
+
+	void RootSet::visitAll(SlotVisitor visitor, void* const ctx)
+	{
+		RootSet* const sentinel = &Current().Roots;
+		for (RootSet* roots = sentinel->_next; roots != sentinel; roots = roots->_next)
+			roots->visit(visitor, ctx);
+	}
+
+	void RootSet::visitRemembered(SlotVisitor visitor, void* const ctx)
+	{
+		for (RootSet* roots : Current().RememberedRoots)
+			if (roots)
+				roots->visit(visitor, ctx);
+	}
+
+	void RootSet::forgetRemembered()
+	{
+		std::vector<RootSet*>& remembered = Current().RememberedRoots;
+		for (RootSet* roots : remembered)
+			if (roots)
+				roots->_remembered = 0;
+		remembered.clear();
+	}
+}
+
+
+
+namespace klang::heap
+{
+	static void FinalizeObject(void* const ptr) { reinterpret_cast<type::Value*>(ptr)->~Value(); }
+	static void TraceObject(void* const ptr, klangh_SlotVisitor visitor, void* const ctx) { reinterpret_cast<type::Value*>(ptr)->trace(visitor, ctx); }
+	static void VisitRoots(klangh_SlotVisitor visitor, void* const ctx)
+	{
+		RootSet::visitAll(visitor, ctx);
+		for (void*& owner : Current().RememberedObjects)
+			visitor(&owner, ctx);
+		if (Current().RootShape)
+			visitor(&Current().RootShape, ctx);
+	}
+
+	/* Interned objects do not keep themselves alive, their finalizers drop the entries. */
+	static void VisitInterned(klangh_SlotVisitor visitor, void* const ctx)
+	{
+		for (std::pair<const size_t, void*>& interned : Current().Interned)
+			visitor(&interned.second, ctx);
+	}
+
+	/* Remembered owners may have been released since the barrier recorded them,
+	   only blocks that still hold a live object are traced. */
+	static void VisitRemembered(klangh_SlotVisitor visitor, void* const ctx)
+	{
+		RootSet::visitRemembered(visitor, ctx);
+		for (void* owner : Current().RememberedObjects)
+		{
+			__private_heap_header* header;
+			klangh_GetHeader(owner, &header);
+			if ((header->flags & HF_OBJECT) && !(header->flags & HF_FREE))
+				TraceObject(owner, visitor, ctx);
+		}
+	}
+
+	/* Flags every object a root points to, not only those waiting in the zero count table:
+	   finalizers may release rooted objects after the scan. The flagged objects are listed
+	   in the context so the flags can be cleared without scanning the roots again. */
+	static void MarkRooted(void** const slot, void* const ctx)
+	{
+		if (is_immortal(*slot) || is_young(*slot))
+			return;
+
+		__private_heap_header* header;
+		if (klangh_GetHeader(*slot, &header) != HS_OK || (header->flags & (HF_ROOTED | HF_FREE)))
+			return;
+
+		header->flags |= HF_ROOTED;
+		reinterpret_cast<std::vector<void*>*>(ctx)->push_back(*slot);
+	}
+
+	static const __private_heap_gc_hooks GCHooks{ &FinalizeObject, &TraceObject, &VisitRoots, &VisitInterned };
+	static const __private_heap_gc_hooks MinorGCHooks{ nullptr, &TraceObject, &VisitRemembered, nullptr };
 }
 
 
@@ -39,25 +319,252 @@ namespace klang::heap
 {
 	void* malloc(const size_t size)
 	{
+		Isolate::State& state = Current();
+		__private_heap& mem = state.Default.mem;
+		/* Nothing is freed here: the caller may still hold unrooted temporaries, which
+		   the cycle collector would take for garbage. The next safepoint collects. */
+		if (mem.used + mem.large_used >= state.CycleThreshold)
+			state.CyclesDue = true;
+
 		void* ptr;
-		if (klangh_Malloc(&Heap::Default.mem, size, &ptr) != HS_OK)
+		if (klangh_Malloc(&mem, size, &ptr) == HS_OK)
+			return ptr;
+
+		/* Soft limit reached: grow just enough for this block. Most of the heap may be
+		   unreclaimed zero count blocks, the next safepoint reclaims them before it
+		   decides whether the live heap needs a higher limit. */
+		state.CyclesDue = state.LimitReached = true;
+		if (klangh_Grow(&mem, size) != HS_OK || klangh_Malloc(&mem, size, &ptr) != HS_OK)
 			return nullptr;
 		return ptr;
 	}
-	void free(void* const ptr) { klangh_Free(&Heap::Default.mem, ptr); }
-	void gc() { klangh_RunGarbageCollector(&Heap::Default.mem); }
+	void free(void* const ptr)
+	{
+		if (!is_young(ptr))
+			klangh_Free(&Current().Default.mem, ptr);
+	}
+	void* realloc(void* const ptr, const size_t size)
+	{
+		if (!ptr)
+			return malloc(size);
+
+		void* moved = ptr;
+		if (is_young(ptr) || klangh_Realloc(&Current().Default.mem, &moved, size) != HS_OK)
+			return nullptr;
+		return moved;
+	}
+	void gc()
+	{
+		Isolate::State& state = Current();
+		minor_gc();
+		reclaim();
+		klangh_RunGarbageCollector(&state.Default.mem, &GCHooks);
+		klangh_SetLimits(&state.Default.mem, state.SoftLimit, state.Default.mem.limit);
+
+		/* Compaction moved blocks and cleared their zero count flags. Tracing from the
+		   roots freed the cycles too. */
+		state.ZeroCount.clear();
+		state.CyclesDue = state.LimitReached = false;
+	}
+	void gc_cycles()
+	{
+		Isolate::State& state = Current();
+		klangh_CollectCycles(&state.Default.mem, &GCHooks);
+		state.CyclesDue = false;
+
+		/* Back off while most of the heap is live to keep the collector amortized. */
+		const size_t used = state.Default.mem.used + state.Default.mem.large_used;
+		state.CycleThreshold = used * 2 > DEFAULT_CYCLE_THRESHOLD ? used * 2 : DEFAULT_CYCLE_THRESHOLD;
+	}
+
+	/* New objects start without references, they stay in the zero count table until
+	   an owner counts them or the next reclaim() finds them unrooted. */
+	void mark_object(void* const ptr)
+	{
+		klangh_MarkObject(ptr);
+		release(ptr);
+	}
+
+	void incref(void* const ptr)
+	{
+		if (!is_immortal(ptr))
+			klangh_IncreaseReferenceCounter(ptr);
+	}
+	void decref(void* const ptr)
+	{
+		if (is_immortal(ptr))
+			return;
+
+		klangh_DecreaseReferenceCounter(ptr);
+		release(ptr);
+	}
+
+	void release(const void* const ptr)
+	{
+		__private_heap_header* header;
+		if (!ptr || is_immortal(ptr) || klangh_GetHeader(ptr, &header) != HS_OK || header->refs)
+			return;
+		if ((header->flags & (HF_STATIC | HF_ZCT | HF_FREE)) || !(header->flags & HF_OBJECT) || is_young(ptr))
+			return;
+
+		header->flags |= HF_ZCT;
+		Current().ZeroCount.push_back(const_cast<void*>(ptr));
+	}
+
+	/* Roots are not counted, so zero count objects are only garbage once a root scan
+	   proves no Ref or stack register holds them. The roots are scanned once: finalizers
+	   cannot root anything, so the objects they release are handled in the same pass. */
+	void reclaim()
+	{
+		Isolate::State& state = Current();
+		std::vector<void*>& zct = state.ZeroCount;
+		if (zct.empty())
+			return;
+
+		std::vector<void*>& rooted = state.Rooted;
+		RootSet::visitAll(&MarkRooted, &rooted);
+		for (void*& owner : state.RememberedObjects)
+			MarkRooted(&owner, &rooted);
+		if (state.RootShape)
+			MarkRooted(&state.RootShape, &rooted);
 
-	void incref(void* const ptr) { klangh_IncreaseReferenceCounter(ptr); }
-	void decref(void* const ptr) { klangh_DecreaseReferenceCounter(ptr); }
+		for (size_t i = 0; i < zct.size(); i++)
+		{
+			void* const ptr = zct[i];
+			__private_heap_header* header;
+			klangh_GetHeader(ptr, &header);
+			if (!(header->flags & HF_ZCT))
+				continue;
+
+			header->flags &= ~HF_ZCT;
+			if (!(header->flags & HF_ROOTED) && !header->refs)
+			{
+				FinalizeObject(ptr);
+				klangh_Free(&state.Default.mem, ptr);
+			}
+		}
+
+		for (void* const ptr : rooted)
+		{
+			__private_heap_header* header;
+			klangh_GetHeader(ptr, &header);
+			header->flags &= ~HF_ROOTED;
+		}
+		rooted.clear();
+		zct.clear();
+	}
 
 	void* s_malloc(const size_t size)
 	{
 		void* ptr;
-		if (klangh_Malloc(&Heap::Static.mem, size, &ptr) != HS_OK)
+		if (klangh_Malloc(&Immortal().mem, size, &ptr) != HS_OK)
 			return nullptr;
 		return ptr;
 	}
+	bool s_reserve(const size_t size) { return klangh_Grow(&Immortal().mem, size) == HS_OK; }
+	bool s_seal() { return klangh_Seal(&Immortal().mem) == HS_OK; }
+	bool is_immortal(const void* const ptr) { return klangh_IsInHeap(&Immortal().mem, ptr); }
+
+	void* y_malloc(const size_t size)
+	{
+		Nursery& young = Current().Young;
+		void* ptr;
+		if (klangh_NurseryMalloc(&young.mem, size, &ptr) == HS_OK)
+			return ptr;
+
+		/* Nursery exhausted: promote directly until the next safepoint empties it. */
+		young.full = true;
+		return malloc(size);
+	}
+	bool is_young(const void* const ptr) { return klangh_IsInNursery(&Current().Young.mem, ptr); }
+	/* Owners are remembered once per minor collection, however many young values they
+	   receive, so minor_gc() traces each of them once. */
+	void write_barrier(const void* const owner, const void* const value)
+	{
+		if (!is_young(value) || is_young(owner))
+			return;
+
+		__private_heap_header* header;
+		klangh_GetHeader(owner, &header);
+		if (header->flags & HF_REMEMBERED)
+			return;
+
+		header->flags |= HF_REMEMBERED;
+		Current().RememberedObjects.push_back(const_cast<void*>(owner));
+	}
+
+	/* Moves young survivors into the default heap. Raw Value pointers held by native code
+	   are not rewritten, so this only runs at safepoints and from gc(). */
+	void minor_gc()
+	{
+		Isolate::State& state = Current();
+		if (klangh_MinorCollect(&state.Young.mem, &state.Default.mem, &MinorGCHooks) != HS_OK)
+			return;
+
+		RootSet::forgetRemembered();
+		for (void* const owner : state.RememberedObjects)
+		{
+			__private_heap_header* header;
+			klangh_GetHeader(owner, &header);
+			header->flags &= ~HF_REMEMBERED;
+		}
+		state.RememberedObjects.clear();
+		state.Young.full = false;
+	}
+	void safepoint()
+	{
+		Isolate::State& state = Current();
+		if (state.Young.full)
+			minor_gc();
+		if (state.ZeroCount.size() >= DEFAULT_ZCT_BATCH || state.LimitReached)
+			reclaim();
+		if (state.CyclesDue)
+			gc_cycles();
+
+		/* Past the soft limit with every dead block freed, let the heap grow up to twice
+		   its live size before the next collection. gc() restores the configured limit. */
+		if (state.LimitReached)
+		{
+			reclaim();
+
+			__private_heap& mem = state.Default.mem;
+			if (mem.soft_limit < mem.used * 2)
+				klangh_SetLimits(&mem, mem.used * 2, mem.limit);
+			state.LimitReached = false;
+		}
+	}
+
+	void* find_interned(const size_t hash, InternMatcher matches, const void* const key)
+	{
+		const auto range = Current().Interned.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+			if (matches(it->second, key))
+				return it->second;
+		return nullptr;
+	}
+	void add_interned(const size_t hash, void* const object) { Current().Interned.emplace(hash, object); }
+	void remove_interned(const size_t hash, const void* const object)
+	{
+		std::unordered_multimap<size_t, void*>& interned = Current().Interned;
+		const auto range = interned.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+			if (it->second == object)
+				return static_cast<void>(interned.erase(it));
+	}
+
+	void* root_shape() { return Current().RootShape; }
+	void set_root_shape(void* const shape) { Current().RootShape = shape; }
+
+	bool set_limits(const size_t softLimit, const size_t hardLimit)
+	{
+		Isolate::State& state = Current();
+		if (klangh_SetLimits(&state.Default.mem, softLimit, hardLimit) != HS_OK)
+			return false;
+
+		state.SoftLimit = softLimit;
+		return true;
+	}
 
-	size_t capacity() { return Heap::Default.mem.capacity; }
-	size_t used() { return Heap::Default.mem.used; }
+	size_t capacity() { return Current().Default.mem.capacity + Current().Default.mem.large_used; }
+	size_t used() { return Current().Default.mem.used + Current().Default.mem.large_used; }
 }
@@ -0,0 +1,1283 @@
+#include "simd.h"
+
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KLANG_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/* GCC and Clang only emit vector instructions in functions targeting them, MSVC always
+   accepts the intrinsics. */
+#if defined(__GNUC__) || defined(__clang__)
+#define KLANG_TARGET(_Features) __attribute__((target(_Features)))
+#else
+#define KLANG_TARGET(_Features)
+#endif
+
+
+// Scalar kernels //
+namespace klang::simd::scalar
+{
+	template<typename _UnitType>
+	static size_t Mismatch(const _UnitType* const left, const _UnitType* const right, const size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (left[i] != right[i])
+				return i;
+		return count;
+	}
+
+	template<typename _UnitType>
+	static size_t Find(const _UnitType* const haystack, const size_t count, const _UnitType unit)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (haystack[i] == unit)
+				return i;
+		return NotFound;
+	}
+
+	/* Needle of two units or more, not longer than the haystack. */
+	template<typename _UnitType>
+	static size_t Search(const _UnitType* const haystack, const size_t count, const _UnitType* const needle, const size_t needleCount)
+	{
+		for (size_t i = 0; i + needleCount <= count; ++i)
+			if (haystack[i] == needle[0] && !std::memcmp(haystack + i + 1, needle + 1, (needleCount - 1) * sizeof(_UnitType)))
+				return i;
+		return NotFound;
+	}
+
+	static size_t FindNonAscii(const UInt8* const units, const size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (units[i] >= 0x80)
+				return i;
+		return count;
+	}
+
+	static size_t FindOutside(const UInt8* const units, const size_t count, const UInt8 low, const UInt8 high)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (units[i] < low || units[i] > high)
+				return i;
+		return count;
+	}
+
+	static size_t FindAbove(const char16_t* const units, const size_t count, const char16_t limit)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (units[i] > limit)
+				return i;
+		return count;
+	}
+
+	template<typename _InType, typename _OutType>
+	static void Convert(const _InType* const in, const size_t count, _OutType* const out)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = static_cast<_OutType>(in[i]);
+	}
+
+	static size_t Mismatch8(const UInt8* const left, const UInt8* const right, const size_t count) { return Mismatch(left, right, count); }
+	static size_t Mismatch16(const char16_t* const left, const char16_t* const right, const size_t count) { return Mismatch(left, right, count); }
+	static size_t Find8(const UInt8* const haystack, const size_t count, const UInt8 unit) { return Find(haystack, count, unit); }
+	static size_t Find16(const char16_t* const haystack, const size_t count, const char16_t unit) { return Find(haystack, count, unit); }
+	static size_t Search8(const UInt8* const haystack, const size_t count, const UInt8* const needle, const size_t needleCount) { return Search(haystack, count, needle, needleCount); }
+	static size_t Search16(const char16_t* const haystack, const size_t count, const char16_t* const needle, const size_t needleCount) { return Search(haystack, count, needle, needleCount); }
+	static void Widen8To16(const UInt8* const in, const size_t count, char16_t* const out) { Convert(in, count, out); }
+	static void Widen8To32(const UInt8* const in, const size_t count, char32_t* const out) { Convert(in, count, out); }
+	static void Widen16To32(const char16_t* const in, const size_t count, char32_t* const out) { Convert(in, count, out); }
+	static void Narrow16To8(const char16_t* const in, const size_t count, UInt8* const out) { Convert(in, count, out); }
+
+	/* Vector kernels finish their tail here, offset by what they already covered. */
+	static inline size_t Offset(const size_t offset, const size_t result) { return result == NotFound ? NotFound : offset + result; }
+}
+
+
+
+/* Numeric kernels are templates on the operator and on the shape of the right operand
+   (array or single value). These macros define the entry point of a level, turning
+   both into template arguments once per call. */
+#define SELECT(_Kernel, _Op, ...) (broadcast ? _Kernel<_Op, true>(__VA_ARGS__) : _Kernel<_Op, false>(__VA_ARGS__))
+
+#define ARITHMETIC_KERNEL(_Name, _Kernel, _Result, _NumberType) \
+	static _Result _Name(const Arithmetic op, const _NumberType* const left, const _NumberType* const right, const bool broadcast, const size_t count, _NumberType* const out) \
+	{ \
+		switch (op) \
+		{ \
+			case Arithmetic::Add: return SELECT(_Kernel, Arithmetic::Add, left, right, count, out); \
+			case Arithmetic::Subtract: return SELECT(_Kernel, Arithmetic::Subtract, left, right, count, out); \
+			case Arithmetic::Multiply: return SELECT(_Kernel, Arithmetic::Multiply, left, right, count, out); \
+			default: return SELECT(_Kernel, Arithmetic::Divide, left, right, count, out); \
+		} \
+	}
+
+#define COMPARISON_KERNEL(_Name, _Kernel, _NumberType) \
+	static void _Name(const Comparison op, const _NumberType* const left, const _NumberType* const right, const bool broadcast, const size_t count, UInt8* const mask) \
+	{ \
+		switch (op) \
+		{ \
+			case Comparison::Equal: return SELECT(_Kernel, Comparison::Equal, left, right, count, mask); \
+			case Comparison::NotEqual: return SELECT(_Kernel, Comparison::NotEqual, left, right, count, mask); \
+			case Comparison::Less: return SELECT(_Kernel, Comparison::Less, left, right, count, mask); \
+			case Comparison::LessEqual: return SELECT(_Kernel, Comparison::LessEqual, left, right, count, mask); \
+			case Comparison::Greater: return SELECT(_Kernel, Comparison::Greater, left, right, count, mask); \
+			default: return SELECT(_Kernel, Comparison::GreaterEqual, left, right, count, mask); \
+		} \
+	}
+
+
+// Scalar numeric kernels //
+namespace klang::simd::scalar
+{
+	constexpr size_t Lanes = 8;
+
+	/* The fixed order in which every level adds up its partial sums. */
+	static inline double Combine(const double* const lanes)
+	{
+		return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+	}
+
+	/* Vector kernels cover whole groups of Lanes elements, the rest continues here. */
+	static inline double SumTail(double* const lanes, const double* const values, size_t i, const size_t count)
+	{
+		for (; i < count; ++i)
+			lanes[i % Lanes] += values[i];
+		return Combine(lanes);
+	}
+
+	static inline double DotTail(double* const lanes, const double* const left, const double* const right, size_t i, const size_t count)
+	{
+		for (; i < count; ++i)
+			lanes[i % Lanes] += left[i] * right[i];
+		return Combine(lanes);
+	}
+
+	static inline bool Accumulate(const Int64* const values, const size_t count, Int64 sum, Int64* const result)
+	{
+		for (size_t i = 0; i < count; ++i)
+			if (addOverflow(sum, values[i], &sum))
+				return false;
+		*result = sum;
+		return true;
+	}
+
+	static bool SumIntegers(const Int64* const values, const size_t count, Int64* const result) { return Accumulate(values, count, 0, result); }
+
+	static double SumDoubles(const double* const values, const size_t count)
+	{
+		double lanes[Lanes] = {};
+		return SumTail(lanes, values, 0, count);
+	}
+
+	static double Dot(const double* const left, const double* const right, const size_t count)
+	{
+		double lanes[Lanes] = {};
+		return DotTail(lanes, left, right, 0, count);
+	}
+
+	/* NaN compares unequal to itself, which never happens to integers. */
+	template<bool _Max, typename _NumberType>
+	static _NumberType Extreme(const _NumberType* const values, const size_t count)
+	{
+		_NumberType result = values[0];
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (values[i] != values[i])
+				return std::numeric_limits<_NumberType>::quiet_NaN();
+			if (_Max ? values[i] > result : values[i] < result)
+				result = values[i];
+		}
+		return result;
+	}
+
+	/* Extreme of the lanes of a vector kernel and of the elements it left. */
+	template<bool _Max, typename _NumberType>
+	static inline _NumberType ExtremeTail(const _NumberType* const lanes, const size_t laneCount, const _NumberType* const values, size_t i, const size_t count)
+	{
+		_NumberType result = Extreme<_Max>(lanes, laneCount);
+		for (; i < count; ++i)
+		{
+			if (values[i] != values[i])
+				return std::numeric_limits<_NumberType>::quiet_NaN();
+			if (_Max ? values[i] > result : values[i] < result)
+				result = values[i];
+		}
+		return result;
+	}
+
+	template<Arithmetic _Op, bool _Broadcast>
+	static bool IntegerArithmetic(const Int64* const left, const Int64* const right, const size_t count, Int64* const out)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Int64 rhs = _Broadcast ? *right : right[i];
+			bool overflow;
+			if constexpr (_Op == Arithmetic::Add) overflow = addOverflow(left[i], rhs, out + i);
+			else if constexpr (_Op == Arithmetic::Subtract) overflow = subOverflow(left[i], rhs, out + i);
+			else if constexpr (_Op == Arithmetic::Multiply) overflow = mulOverflow(left[i], rhs, out + i);
+			else overflow = true;
+
+			if (overflow)
+				return false;
+		}
+		return true;
+	}
+
+	template<Arithmetic _Op, bool _Broadcast>
+	static void DoubleArithmetic(const double* const left, const double* const right, const size_t count, double* const out)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const double rhs = _Broadcast ? *right : right[i];
+			if constexpr (_Op == Arithmetic::Add) out[i] = left[i] + rhs;
+			else if constexpr (_Op == Arithmetic::Subtract) out[i] = left[i] - rhs;
+			else if constexpr (_Op == Arithmetic::Multiply) out[i] = left[i] * rhs;
+			else out[i] = left[i] / rhs;
+		}
+	}
+
+	template<Comparison _Op, bool _Broadcast, typename _NumberType>
+	static void NumberComparison(const _NumberType* const left, const _NumberType* const right, const size_t count, UInt8* const mask)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const _NumberType rhs = _Broadcast ? *right : right[i];
+			if constexpr (_Op == Comparison::Equal) mask[i] = left[i] == rhs;
+			else if constexpr (_Op == Comparison::NotEqual) mask[i] = left[i] != rhs;
+			else if constexpr (_Op == Comparison::Less) mask[i] = left[i] < rhs;
+			else if constexpr (_Op == Comparison::LessEqual) mask[i] = left[i] <= rhs;
+			else if constexpr (_Op == Comparison::Greater) mask[i] = left[i] > rhs;
+			else mask[i] = left[i] >= rhs;
+		}
+	}
+
+	/* Every element is written, the output only advances past the kept ones. */
+	static size_t Compress(const UInt64* const values, const UInt8* const mask, const size_t count, UInt64* const out)
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			out[kept] = values[i];
+			kept += mask[i] != 0;
+		}
+		return kept;
+	}
+
+	static Int64 MinIntegers(const Int64* const values, const size_t count) { return Extreme<false>(values, count); }
+	static Int64 MaxIntegers(const Int64* const values, const size_t count) { return Extreme<true>(values, count); }
+	static double MinDoubles(const double* const values, const size_t count) { return Extreme<false>(values, count); }
+	static double MaxDoubles(const double* const values, const size_t count) { return Extreme<true>(values, count); }
+
+	ARITHMETIC_KERNEL(ApplyIntegers, IntegerArithmetic, bool, Int64)
+	ARITHMETIC_KERNEL(ApplyDoubles, DoubleArithmetic, void, double)
+	COMPARISON_KERNEL(CompareIntegers, NumberComparison, Int64)
+	COMPARISON_KERNEL(CompareDoubles, NumberComparison, double)
+}
+
+
+
+#if defined(KLANG_SIMD_X86)
+namespace klang::simd
+{
+	static inline unsigned LowestBit(const UInt32 mask)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<unsigned>(index);
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+
+	/* Low bits of a movemask as consecutive 0 or 1 bytes, in memory order. */
+	static constexpr UInt32 ByteMasks[16] = {
+		0x00000000, 0x00000001, 0x00000100, 0x00000101, 0x00010000, 0x00010001, 0x00010100, 0x00010101,
+		0x01000000, 0x01000001, 0x01000100, 0x01000101, 0x01010000, 0x01010001, 0x01010100, 0x01010101
+	};
+
+	template<typename _Ty>
+	static inline const __m128i* Load128(const _Ty* const ptr) { return reinterpret_cast<const __m128i*>(ptr); }
+	template<typename _Ty>
+	static inline __m128i* Store128(_Ty* const ptr) { return reinterpret_cast<__m128i*>(ptr); }
+	template<typename _Ty>
+	static inline const __m256i* Load256(const _Ty* const ptr) { return reinterpret_cast<const __m256i*>(ptr); }
+	template<typename _Ty>
+	static inline __m256i* Store256(_Ty* const ptr) { return reinterpret_cast<__m256i*>(ptr); }
+}
+
+
+
+// SSE2 kernels //
+namespace klang::simd::sse2
+{
+	KLANG_TARGET("sse2") static size_t Mismatch8(const UInt8* const left, const UInt8* const right, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(Load128(left + i)), _mm_loadu_si128(Load128(right + i)))));
+			if (mask != 0xFFFF)
+				return i + LowestBit(~mask);
+		}
+		return i + scalar::Mismatch(left + i, right + i, count - i);
+	}
+
+	KLANG_TARGET("sse2") static size_t Mismatch16(const char16_t* const left, const char16_t* const right, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128(Load128(left + i)), _mm_loadu_si128(Load128(right + i)))));
+			if (mask != 0xFFFF)
+				return i + LowestBit(~mask) / 2;
+		}
+		return i + scalar::Mismatch(left + i, right + i, count - i);
+	}
+
+	KLANG_TARGET("sse2") static size_t Find8(const UInt8* const haystack, const size_t count, const UInt8 unit)
+	{
+		const __m128i pattern = _mm_set1_epi8(static_cast<char>(unit));
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(Load128(haystack + i)), pattern)));
+			if (mask)
+				return i + LowestBit(mask);
+		}
+		return scalar::Offset(i, scalar::Find(haystack + i, count - i, unit));
+	}
+
+	KLANG_TARGET("sse2") static size_t Find16(const char16_t* const haystack, const size_t count, const char16_t unit)
+	{
+		const __m128i pattern = _mm_set1_epi16(static_cast<short>(unit));
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128(Load128(haystack + i)), pattern)));
+			if (mask)
+				return i + LowestBit(mask) / 2;
+		}
+		return scalar::Offset(i, scalar::Find(haystack + i, count - i, unit));
+	}
+
+	/* Candidates match both the first and the last needle unit, only they are compared
+	   in full. */
+	KLANG_TARGET("sse2") static size_t Search8(const UInt8* const haystack, const size_t count, const UInt8* const needle, const size_t needleCount)
+	{
+		const __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+		const __m128i last = _mm_set1_epi8(static_cast<char>(needle[needleCount - 1]));
+		size_t i = 0;
+		for (; i + needleCount - 1 + 16 <= count; i += 16)
+		{
+			const __m128i head = _mm_cmpeq_epi8(_mm_loadu_si128(Load128(haystack + i)), first);
+			const __m128i tail = _mm_cmpeq_epi8(_mm_loadu_si128(Load128(haystack + i + needleCount - 1)), last);
+			for (UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_and_si128(head, tail))); mask; mask &= mask - 1)
+			{
+				const size_t at = i + LowestBit(mask);
+				if (!std::memcmp(haystack + at + 1, needle + 1, needleCount - 1))
+					return at;
+			}
+		}
+		return scalar::Offset(i, scalar::Search(haystack + i, count - i, needle, needleCount));
+	}
+
+	KLANG_TARGET("sse2") static size_t Search16(const char16_t* const haystack, const size_t count, const char16_t* const needle, const size_t needleCount)
+	{
+		const __m128i first = _mm_set1_epi16(static_cast<short>(needle[0]));
+		const __m128i last = _mm_set1_epi16(static_cast<short>(needle[needleCount - 1]));
+		size_t i = 0;
+		for (; i + needleCount - 1 + 8 <= count; i += 8)
+		{
+			const __m128i head = _mm_cmpeq_epi16(_mm_loadu_si128(Load128(haystack + i)), first);
+			const __m128i tail = _mm_cmpeq_epi16(_mm_loadu_si128(Load128(haystack + i + needleCount - 1)), last);
+			for (UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_and_si128(head, tail))) & 0x5555; mask; mask &= mask - 1)
+			{
+				const size_t at = i + LowestBit(mask) / 2;
+				if (!std::memcmp(haystack + at + 1, needle + 1, (needleCount - 1) * sizeof(char16_t)))
+					return at;
+			}
+		}
+		return scalar::Offset(i, scalar::Search(haystack + i, count - i, needle, needleCount));
+	}
+
+	KLANG_TARGET("sse2") static size_t FindNonAscii(const UInt8* const units, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_loadu_si128(Load128(units + i))));
+			if (mask)
+				return i + LowestBit(mask);
+		}
+		return i + scalar::FindNonAscii(units + i, count - i);
+	}
+
+	/* Bytes are shifted down by low with wrap around, so the range starts at zero: those
+	   inside are left unchanged by an unsigned minimum with its width. */
+	KLANG_TARGET("sse2") static size_t FindOutside(const UInt8* const units, const size_t count, const UInt8 low, const UInt8 high)
+	{
+		const __m128i base = _mm_set1_epi8(static_cast<char>(low));
+		const __m128i width = _mm_set1_epi8(static_cast<char>(high - low));
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i shifted = _mm_sub_epi8(_mm_loadu_si128(Load128(units + i)), base);
+			const UInt32 mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(shifted, width), shifted)));
+			if (mask != 0xFFFF)
+				return i + LowestBit(~mask);
+		}
+		return i + scalar::FindOutside(units + i, count - i, low, high);
+	}
+
+	/* Units above the limit are the ones left non zero by an unsigned saturating subtract. */
+	KLANG_TARGET("sse2") static size_t FindAbove(const char16_t* const units, const size_t count, const char16_t limit)
+	{
+		const __m128i bound = _mm_set1_epi16(static_cast<short>(limit));
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i excess = _mm_subs_epu16(_mm_loadu_si128(Load128(units + i)), bound);
+			const UInt32 mask = ~static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi16(excess, zero))) & 0xFFFF;
+			if (mask)
+				return i + LowestBit(mask) / 2;
+		}
+		return i + scalar::FindAbove(units + i, count - i, limit);
+	}
+
+	KLANG_TARGET("sse2") static void Widen8To16(const UInt8* const in, const size_t count, char16_t* const out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(Load128(in + i));
+			_mm_storeu_si128(Store128(out + i), _mm_unpacklo_epi8(bytes, zero));
+			_mm_storeu_si128(Store128(out + i + 8), _mm_unpackhi_epi8(bytes, zero));
+		}
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	KLANG_TARGET("sse2") static void Widen8To32(const UInt8* const in, const size_t count, char32_t* const out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(Load128(in + i));
+			const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+			_mm_storeu_si128(Store128(out + i), _mm_unpacklo_epi16(low, zero));
+			_mm_storeu_si128(Store128(out + i + 4), _mm_unpackhi_epi16(low, zero));
+			_mm_storeu_si128(Store128(out + i + 8), _mm_unpacklo_epi16(high, zero));
+			_mm_storeu_si128(Store128(out + i + 12), _mm_unpackhi_epi16(high, zero));
+		}
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	KLANG_TARGET("sse2") static void Widen16To32(const char16_t* const in, const size_t count, char32_t* const out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i units = _mm_loadu_si128(Load128(in + i));
+			_mm_storeu_si128(Store128(out + i), _mm_unpacklo_epi16(units, zero));
+			_mm_storeu_si128(Store128(out + i + 4), _mm_unpackhi_epi16(units, zero));
+		}
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	KLANG_TARGET("sse2") static void Narrow16To8(const char16_t* const in, const size_t count, UInt8* const out)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm_storeu_si128(Store128(out + i), _mm_packus_epi16(_mm_loadu_si128(Load128(in + i)), _mm_loadu_si128(Load128(in + i + 8))));
+		scalar::Convert(in + i, count - i, out + i);
+	}
+}
+
+
+
+// AVX2 kernels //
+namespace klang::simd::avx2
+{
+	KLANG_TARGET("avx2") static size_t Mismatch8(const UInt8* const left, const UInt8* const right, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(Load256(left + i)), _mm256_loadu_si256(Load256(right + i)))));
+			if (mask != 0xFFFFFFFF)
+				return i + LowestBit(~mask);
+		}
+		return i + scalar::Mismatch(left + i, right + i, count - i);
+	}
+
+	KLANG_TARGET("avx2") static size_t Mismatch16(const char16_t* const left, const char16_t* const right, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256(Load256(left + i)), _mm256_loadu_si256(Load256(right + i)))));
+			if (mask != 0xFFFFFFFF)
+				return i + LowestBit(~mask) / 2;
+		}
+		return i + scalar::Mismatch(left + i, right + i, count - i);
+	}
+
+	KLANG_TARGET("avx2") static size_t Find8(const UInt8* const haystack, const size_t count, const UInt8 unit)
+	{
+		const __m256i pattern = _mm256_set1_epi8(static_cast<char>(unit));
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(Load256(haystack + i)), pattern)));
+			if (mask)
+				return i + LowestBit(mask);
+		}
+		return scalar::Offset(i, scalar::Find(haystack + i, count - i, unit));
+	}
+
+	KLANG_TARGET("avx2") static size_t Find16(const char16_t* const haystack, const size_t count, const char16_t unit)
+	{
+		const __m256i pattern = _mm256_set1_epi16(static_cast<short>(unit));
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256(Load256(haystack + i)), pattern)));
+			if (mask)
+				return i + LowestBit(mask) / 2;
+		}
+		return scalar::Offset(i, scalar::Find(haystack + i, count - i, unit));
+	}
+
+	KLANG_TARGET("avx2") static size_t Search8(const UInt8* const haystack, const size_t count, const UInt8* const needle, const size_t needleCount)
+	{
+		const __m256i first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+		const __m256i last = _mm256_set1_epi8(static_cast<char>(needle[needleCount - 1]));
+		size_t i = 0;
+		for (; i + needleCount - 1 + 32 <= count; i += 32)
+		{
+			const __m256i head = _mm256_cmpeq_epi8(_mm256_loadu_si256(Load256(haystack + i)), first);
+			const __m256i tail = _mm256_cmpeq_epi8(_mm256_loadu_si256(Load256(haystack + i + needleCount - 1)), last);
+			for (UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_and_si256(head, tail))); mask; mask &= mask - 1)
+			{
+				const size_t at = i + LowestBit(mask);
+				if (!std::memcmp(haystack + at + 1, needle + 1, needleCount - 1))
+					return at;
+			}
+		}
+		return scalar::Offset(i, scalar::Search(haystack + i, count - i, needle, needleCount));
+	}
+
+	KLANG_TARGET("avx2") static size_t Search16(const char16_t* const haystack, const size_t count, const char16_t* const needle, const size_t needleCount)
+	{
+		const __m256i first = _mm256_set1_epi16(static_cast<short>(needle[0]));
+		const __m256i last = _mm256_set1_epi16(static_cast<short>(needle[needleCount - 1]));
+		size_t i = 0;
+		for (; i + needleCount - 1 + 16 <= count; i += 16)
+		{
+			const __m256i head = _mm256_cmpeq_epi16(_mm256_loadu_si256(Load256(haystack + i)), first);
+			const __m256i tail = _mm256_cmpeq_epi16(_mm256_loadu_si256(Load256(haystack + i + needleCount - 1)), last);
+			for (UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_and_si256(head, tail))) & 0x55555555; mask; mask &= mask - 1)
+			{
+				const size_t at = i + LowestBit(mask) / 2;
+				if (!std::memcmp(haystack + at + 1, needle + 1, (needleCount - 1) * sizeof(char16_t)))
+					return at;
+			}
+		}
+		return scalar::Offset(i, scalar::Search(haystack + i, count - i, needle, needleCount));
+	}
+
+	KLANG_TARGET("avx2") static size_t FindNonAscii(const UInt8* const units, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_loadu_si256(Load256(units + i))));
+			if (mask)
+				return i + LowestBit(mask);
+		}
+		return i + scalar::FindNonAscii(units + i, count - i);
+	}
+
+	KLANG_TARGET("avx2") static size_t FindOutside(const UInt8* const units, const size_t count, const UInt8 low, const UInt8 high)
+	{
+		const __m256i base = _mm256_set1_epi8(static_cast<char>(low));
+		const __m256i width = _mm256_set1_epi8(static_cast<char>(high - low));
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256i shifted = _mm256_sub_epi8(_mm256_loadu_si256(Load256(units + i)), base);
+			const UInt32 mask = static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(shifted, width), shifted)));
+			if (mask != 0xFFFFFFFF)
+				return i + LowestBit(~mask);
+		}
+		return i + scalar::FindOutside(units + i, count - i, low, high);
+	}
+
+	KLANG_TARGET("avx2") static size_t FindAbove(const char16_t* const units, const size_t count, const char16_t limit)
+	{
+		const __m256i bound = _mm256_set1_epi16(static_cast<short>(limit));
+		const __m256i zero = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m256i excess = _mm256_subs_epu16(_mm256_loadu_si256(Load256(units + i)), bound);
+			const UInt32 mask = ~static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(excess, zero)));
+			if (mask)
+				return i + LowestBit(mask) / 2;
+		}
+		return i + scalar::FindAbove(units + i, count - i, limit);
+	}
+
+	KLANG_TARGET("avx2") static void Widen8To16(const UInt8* const in, const size_t count, char16_t* const out)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm256_storeu_si256(Store256(out + i), _mm256_cvtepu8_epi16(_mm_loadu_si128(Load128(in + i))));
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	KLANG_TARGET("avx2") static void Widen8To32(const UInt8* const in, const size_t count, char32_t* const out)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_si256(Store256(out + i), _mm256_cvtepu8_epi32(_mm_loadl_epi64(Load128(in + i))));
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	KLANG_TARGET("avx2") static void Widen16To32(const char16_t* const in, const size_t count, char32_t* const out)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_si256(Store256(out + i), _mm256_cvtepu16_epi32(_mm_loadu_si128(Load128(in + i))));
+		scalar::Convert(in + i, count - i, out + i);
+	}
+
+	/* Packing works per 128 bit lane, the permute puts both halves back in order. */
+	KLANG_TARGET("avx2") static void Narrow16To8(const char16_t* const in, const size_t count, UInt8* const out)
+	{
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256i packed = _mm256_packus_epi16(_mm256_loadu_si256(Load256(in + i)), _mm256_loadu_si256(Load256(in + i + 16)));
+			_mm256_storeu_si256(Store256(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+		}
+		scalar::Convert(in + i, count - i, out + i);
+	}
+}
+
+
+// SSE2 numeric kernels //
+namespace klang::simd::sse2
+{
+	/* SSE2 has no 64 bit compare, integer comparisons stay scalar. */
+	using scalar::MinIntegers;
+	using scalar::MaxIntegers;
+	using scalar::CompareIntegers;
+	using scalar::Compress;
+
+	/* Overflowing lanes get their sign bit set in overflow. */
+	template<Arithmetic _Op>
+	KLANG_TARGET("sse2") static inline __m128i Integers128(const __m128i left, const __m128i right, __m128i& overflow)
+	{
+		if constexpr (_Op == Arithmetic::Add)
+		{
+			const __m128i result = _mm_add_epi64(left, right);
+			overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(left, result), _mm_xor_si128(right, result)));
+			return result;
+		}
+		else
+		{
+			const __m128i result = _mm_sub_epi64(left, right);
+			overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(left, right), _mm_xor_si128(left, result)));
+			return result;
+		}
+	}
+
+	template<Arithmetic _Op>
+	KLANG_TARGET("sse2") static inline __m128d Doubles128(const __m128d left, const __m128d right)
+	{
+		if constexpr (_Op == Arithmetic::Add) return _mm_add_pd(left, right);
+		else if constexpr (_Op == Arithmetic::Subtract) return _mm_sub_pd(left, right);
+		else if constexpr (_Op == Arithmetic::Multiply) return _mm_mul_pd(left, right);
+		else return _mm_div_pd(left, right);
+	}
+
+	template<Comparison _Op>
+	KLANG_TARGET("sse2") static inline __m128d Compare128(const __m128d left, const __m128d right)
+	{
+		if constexpr (_Op == Comparison::Equal) return _mm_cmpeq_pd(left, right);
+		else if constexpr (_Op == Comparison::NotEqual) return _mm_cmpneq_pd(left, right);
+		else if constexpr (_Op == Comparison::Less) return _mm_cmplt_pd(left, right);
+		else if constexpr (_Op == Comparison::LessEqual) return _mm_cmple_pd(left, right);
+		else if constexpr (_Op == Comparison::Greater) return _mm_cmpgt_pd(left, right);
+		else return _mm_cmpge_pd(left, right);
+	}
+
+	KLANG_TARGET("sse2") static bool SumIntegers(const Int64* const values, const size_t count, Int64* const result)
+	{
+		__m128i sum = _mm_setzero_si128();
+		__m128i overflow = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+			sum = Integers128<Arithmetic::Add>(sum, _mm_loadu_si128(Load128(values + i)), overflow);
+		if (_mm_movemask_pd(_mm_castsi128_pd(overflow)))
+			return false;
+
+		Int64 lanes[2];
+		_mm_storeu_si128(Store128(lanes), sum);
+		Int64 total;
+		return scalar::Accumulate(lanes, 2, 0, &total) && scalar::Accumulate(values + i, count - i, total, result);
+	}
+
+	KLANG_TARGET("sse2") static double SumDoubles(const double* const values, const size_t count)
+	{
+		__m128d sums[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+		size_t i = 0;
+		for (; i + scalar::Lanes <= count; i += scalar::Lanes)
+			for (size_t j = 0; j < 4; ++j)
+				sums[j] = _mm_add_pd(sums[j], _mm_loadu_pd(values + i + 2 * j));
+
+		double lanes[scalar::Lanes];
+		for (size_t j = 0; j < 4; ++j)
+			_mm_storeu_pd(lanes + 2 * j, sums[j]);
+		return scalar::SumTail(lanes, values, i, count);
+	}
+
+	KLANG_TARGET("sse2") static double Dot(const double* const left, const double* const right, const size_t count)
+	{
+		__m128d sums[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+		size_t i = 0;
+		for (; i + scalar::Lanes <= count; i += scalar::Lanes)
+			for (size_t j = 0; j < 4; ++j)
+				sums[j] = _mm_add_pd(sums[j], _mm_mul_pd(_mm_loadu_pd(left + i + 2 * j), _mm_loadu_pd(right + i + 2 * j)));
+
+		double lanes[scalar::Lanes];
+		for (size_t j = 0; j < 4; ++j)
+			_mm_storeu_pd(lanes + 2 * j, sums[j]);
+		return scalar::DotTail(lanes, left, right, i, count);
+	}
+
+	template<bool _Max>
+	KLANG_TARGET("sse2") static double ExtremeDoubles(const double* const values, const size_t count)
+	{
+		if (count < 2)
+			return scalar::Extreme<_Max>(values, count);
+
+		__m128d extreme = _mm_loadu_pd(values);
+		__m128d nan = _mm_cmpunord_pd(extreme, extreme);
+		size_t i = 2;
+		for (; i + 2 <= count; i += 2)
+		{
+			const __m128d block = _mm_loadu_pd(values + i);
+			extreme = _Max ? _mm_max_pd(extreme, block) : _mm_min_pd(extreme, block);
+			nan = _mm_or_pd(nan, _mm_cmpunord_pd(block, block));
+		}
+		if (_mm_movemask_pd(nan))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		double lanes[2];
+		_mm_storeu_pd(lanes, extreme);
+		return scalar::ExtremeTail<_Max>(lanes, 2, values, i, count);
+	}
+
+	static double MinDoubles(const double* const values, const size_t count) { return ExtremeDoubles<false>(values, count); }
+	static double MaxDoubles(const double* const values, const size_t count) { return ExtremeDoubles<true>(values, count); }
+
+	/* No 64 bit multiply either, products are checked one by one. */
+	template<Arithmetic _Op, bool _Broadcast>
+	KLANG_TARGET("sse2") static bool IntegerArithmetic(const Int64* const left, const Int64* const right, const size_t count, Int64* const out)
+	{
+		if constexpr (_Op == Arithmetic::Add || _Op == Arithmetic::Subtract)
+		{
+			const __m128i operand = _Broadcast ? _mm_set1_epi64x(*right) : _mm_setzero_si128();
+			__m128i overflow = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				const __m128i rhs = _Broadcast ? operand : _mm_loadu_si128(Load128(right + i));
+				_mm_storeu_si128(Store128(out + i), Integers128<_Op>(_mm_loadu_si128(Load128(left + i)), rhs, overflow));
+			}
+			if (_mm_movemask_pd(_mm_castsi128_pd(overflow)))
+				return false;
+			return scalar::IntegerArithmetic<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, out + i);
+		}
+		else return scalar::IntegerArithmetic<_Op, _Broadcast>(left, right, count, out);
+	}
+
+	template<Arithmetic _Op, bool _Broadcast>
+	KLANG_TARGET("sse2") static void DoubleArithmetic(const double* const left, const double* const right, const size_t count, double* const out)
+	{
+		const __m128d operand = _Broadcast ? _mm_set1_pd(*right) : _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+			_mm_storeu_pd(out + i, Doubles128<_Op>(_mm_loadu_pd(left + i), _Broadcast ? operand : _mm_loadu_pd(right + i)));
+		scalar::DoubleArithmetic<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, out + i);
+	}
+
+	template<Comparison _Op, bool _Broadcast>
+	KLANG_TARGET("sse2") static void DoubleComparison(const double* const left, const double* const right, const size_t count, UInt8* const mask)
+	{
+		const __m128d operand = _Broadcast ? _mm_set1_pd(*right) : _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+			std::memcpy(mask + i, &ByteMasks[_mm_movemask_pd(Compare128<_Op>(_mm_loadu_pd(left + i), _Broadcast ? operand : _mm_loadu_pd(right + i)))], 2);
+		scalar::NumberComparison<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, mask + i);
+	}
+
+	ARITHMETIC_KERNEL(ApplyIntegers, IntegerArithmetic, bool, Int64)
+	ARITHMETIC_KERNEL(ApplyDoubles, DoubleArithmetic, void, double)
+	COMPARISON_KERNEL(CompareDoubles, DoubleComparison, double)
+}
+
+
+
+// AVX2 numeric kernels //
+namespace klang::simd::avx2
+{
+	template<Arithmetic _Op>
+	KLANG_TARGET("avx2") static inline __m256i Integers256(const __m256i left, const __m256i right, __m256i& overflow)
+	{
+		if constexpr (_Op == Arithmetic::Add)
+		{
+			const __m256i result = _mm256_add_epi64(left, right);
+			overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(left, result), _mm256_xor_si256(right, result)));
+			return result;
+		}
+		else
+		{
+			const __m256i result = _mm256_sub_epi64(left, right);
+			overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(left, right), _mm256_xor_si256(left, result)));
+			return result;
+		}
+	}
+
+	template<Arithmetic _Op>
+	KLANG_TARGET("avx2") static inline __m256d Doubles256(const __m256d left, const __m256d right)
+	{
+		if constexpr (_Op == Arithmetic::Add) return _mm256_add_pd(left, right);
+		else if constexpr (_Op == Arithmetic::Subtract) return _mm256_sub_pd(left, right);
+		else if constexpr (_Op == Arithmetic::Multiply) return _mm256_mul_pd(left, right);
+		else return _mm256_div_pd(left, right);
+	}
+
+	/* Ordered predicates, except not equal which holds for NaN as in C++. */
+	template<Comparison _Op>
+	constexpr int Predicate =
+		_Op == Comparison::Equal ? _CMP_EQ_OQ :
+		_Op == Comparison::NotEqual ? _CMP_NEQ_UQ :
+		_Op == Comparison::Less ? _CMP_LT_OQ :
+		_Op == Comparison::LessEqual ? _CMP_LE_OQ :
+		_Op == Comparison::Greater ? _CMP_GT_OQ : _CMP_GE_OQ;
+
+	/* Only equal and greater exist for 64 bit integers, the others swap or negate them. */
+	template<Comparison _Op>
+	KLANG_TARGET("avx2") static inline UInt32 Compare256(const __m256i left, const __m256i right)
+	{
+		constexpr bool Negate = _Op == Comparison::NotEqual || _Op == Comparison::LessEqual || _Op == Comparison::GreaterEqual;
+		__m256i result;
+		if constexpr (_Op == Comparison::Equal || _Op == Comparison::NotEqual) result = _mm256_cmpeq_epi64(left, right);
+		else if constexpr (_Op == Comparison::Greater || _Op == Comparison::LessEqual) result = _mm256_cmpgt_epi64(left, right);
+		else result = _mm256_cmpgt_epi64(right, left);
+
+		const UInt32 bits = static_cast<UInt32>(_mm256_movemask_pd(_mm256_castsi256_pd(result)));
+		return Negate ? bits ^ 0xF : bits;
+	}
+
+	KLANG_TARGET("avx2") static bool SumIntegers(const Int64* const values, const size_t count, Int64* const result)
+	{
+		__m256i sum = _mm256_setzero_si256();
+		__m256i overflow = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			sum = Integers256<Arithmetic::Add>(sum, _mm256_loadu_si256(Load256(values + i)), overflow);
+		if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+			return false;
+
+		Int64 lanes[4];
+		_mm256_storeu_si256(Store256(lanes), sum);
+		Int64 total;
+		return scalar::Accumulate(lanes, 4, 0, &total) && scalar::Accumulate(values + i, count - i, total, result);
+	}
+
+	KLANG_TARGET("avx2") static double SumDoubles(const double* const values, const size_t count)
+	{
+		__m256d low = _mm256_setzero_pd();
+		__m256d high = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + scalar::Lanes <= count; i += scalar::Lanes)
+		{
+			low = _mm256_add_pd(low, _mm256_loadu_pd(values + i));
+			high = _mm256_add_pd(high, _mm256_loadu_pd(values + i + 4));
+		}
+
+		double lanes[scalar::Lanes];
+		_mm256_storeu_pd(lanes, low);
+		_mm256_storeu_pd(lanes + 4, high);
+		return scalar::SumTail(lanes, values, i, count);
+	}
+
+	KLANG_TARGET("avx2") static double Dot(const double* const left, const double* const right, const size_t count)
+	{
+		__m256d low = _mm256_setzero_pd();
+		__m256d high = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + scalar::Lanes <= count; i += scalar::Lanes)
+		{
+			low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+			high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_loadu_pd(left + i + 4), _mm256_loadu_pd(right + i + 4)));
+		}
+
+		double lanes[scalar::Lanes];
+		_mm256_storeu_pd(lanes, low);
+		_mm256_storeu_pd(lanes + 4, high);
+		return scalar::DotTail(lanes, left, right, i, count);
+	}
+
+	template<bool _Max>
+	KLANG_TARGET("avx2") static Int64 ExtremeIntegers(const Int64* const values, const size_t count)
+	{
+		if (count < 4)
+			return scalar::Extreme<_Max>(values, count);
+
+		__m256i extreme = _mm256_loadu_si256(Load256(values));
+		size_t i = 4;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m256i block = _mm256_loadu_si256(Load256(values + i));
+			extreme = _mm256_blendv_epi8(extreme, block, _Max ? _mm256_cmpgt_epi64(block, extreme) : _mm256_cmpgt_epi64(extreme, block));
+		}
+
+		Int64 lanes[4];
+		_mm256_storeu_si256(Store256(lanes), extreme);
+		return scalar::ExtremeTail<_Max>(lanes, 4, values, i, count);
+	}
+
+	template<bool _Max>
+	KLANG_TARGET("avx2") static double ExtremeDoubles(const double* const values, const size_t count)
+	{
+		if (count < 4)
+			return scalar::Extreme<_Max>(values, count);
+
+		__m256d extreme = _mm256_loadu_pd(values);
+		__m256d nan = _mm256_cmp_pd(extreme, extreme, _CMP_UNORD_Q);
+		size_t i = 4;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m256d block = _mm256_loadu_pd(values + i);
+			extreme = _Max ? _mm256_max_pd(extreme, block) : _mm256_min_pd(extreme, block);
+			nan = _mm256_or_pd(nan, _mm256_cmp_pd(block, block, _CMP_UNORD_Q));
+		}
+		if (_mm256_movemask_pd(nan))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		double lanes[4];
+		_mm256_storeu_pd(lanes, extreme);
+		return scalar::ExtremeTail<_Max>(lanes, 4, values, i, count);
+	}
+
+	static Int64 MinIntegers(const Int64* const values, const size_t count) { return ExtremeIntegers<false>(values, count); }
+	static Int64 MaxIntegers(const Int64* const values, const size_t count) { return ExtremeIntegers<true>(values, count); }
+	static double MinDoubles(const double* const values, const size_t count) { return ExtremeDoubles<false>(values, count); }
+	static double MaxDoubles(const double* const values, const size_t count) { return ExtremeDoubles<true>(values, count); }
+
+	/* AVX2 has no 64 bit multiply, products are checked one by one. */
+	template<Arithmetic _Op, bool _Broadcast>
+	KLANG_TARGET("avx2") static bool IntegerArithmetic(const Int64* const left, const Int64* const right, const size_t count, Int64* const out)
+	{
+		if constexpr (_Op == Arithmetic::Add || _Op == Arithmetic::Subtract)
+		{
+			const __m256i operand = _Broadcast ? _mm256_set1_epi64x(*right) : _mm256_setzero_si256();
+			__m256i overflow = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m256i rhs = _Broadcast ? operand : _mm256_loadu_si256(Load256(right + i));
+				_mm256_storeu_si256(Store256(out + i), Integers256<_Op>(_mm256_loadu_si256(Load256(left + i)), rhs, overflow));
+			}
+			if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+				return false;
+			return scalar::IntegerArithmetic<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, out + i);
+		}
+		else return scalar::IntegerArithmetic<_Op, _Broadcast>(left, right, count, out);
+	}
+
+	template<Arithmetic _Op, bool _Broadcast>
+	KLANG_TARGET("avx2") static void DoubleArithmetic(const double* const left, const double* const right, const size_t count, double* const out)
+	{
+		const __m256d operand = _Broadcast ? _mm256_set1_pd(*right) : _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm256_storeu_pd(out + i, Doubles256<_Op>(_mm256_loadu_pd(left + i), _Broadcast ? operand : _mm256_loadu_pd(right + i)));
+		scalar::DoubleArithmetic<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, out + i);
+	}
+
+	template<Comparison _Op, bool _Broadcast>
+	KLANG_TARGET("avx2") static void IntegerComparison(const Int64* const left, const Int64* const right, const size_t count, UInt8* const mask)
+	{
+		const __m256i operand = _Broadcast ? _mm256_set1_epi64x(*right) : _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			std::memcpy(mask + i, &ByteMasks[Compare256<_Op>(_mm256_loadu_si256(Load256(left + i)), _Broadcast ? operand : _mm256_loadu_si256(Load256(right + i)))], 4);
+		scalar::NumberComparison<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, mask + i);
+	}
+
+	template<Comparison _Op, bool _Broadcast>
+	KLANG_TARGET("avx2") static void DoubleComparison(const double* const left, const double* const right, const size_t count, UInt8* const mask)
+	{
+		const __m256d operand = _Broadcast ? _mm256_set1_pd(*right) : _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m256d result = _mm256_cmp_pd(_mm256_loadu_pd(left + i), _Broadcast ? operand : _mm256_loadu_pd(right + i), Predicate<_Op>);
+			std::memcpy(mask + i, &ByteMasks[_mm256_movemask_pd(result)], 4);
+		}
+		scalar::NumberComparison<_Op, _Broadcast>(left + i, _Broadcast ? right : right + i, count - i, mask + i);
+	}
+
+	/* Dword indices moving the kept elements of a group of four to its front. */
+	struct CompressTable
+	{
+		Int32 indices[16][8];
+		UInt8 counts[16];
+	};
+
+	static constexpr CompressTable MakeCompressTable()
+	{
+		CompressTable table{};
+		for (int bits = 0; bits < 16; ++bits)
+		{
+			int kept = 0;
+			for (int j = 0; j < 4; ++j)
+			{
+				if (!(bits & (1 << j)))
+					continue;
+				table.indices[bits][2 * kept] = 2 * j;
+				table.indices[bits][2 * kept + 1] = 2 * j + 1;
+				++kept;
+			}
+			table.counts[bits] = static_cast<UInt8>(kept);
+		}
+		return table;
+	}
+
+	static constexpr CompressTable CompressIndices = MakeCompressTable();
+
+	/* Each group is stored whole at the output position, which never passes the input
+	   one: the lanes past the kept ones are overwritten by the next group. */
+	KLANG_TARGET("avx2") static size_t Compress(const UInt64* const values, const UInt8* const mask, const size_t count, UInt64* const out)
+	{
+		size_t kept = 0;
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const UInt32 bits = static_cast<UInt32>((mask[i] != 0) | (mask[i + 1] != 0) << 1 | (mask[i + 2] != 0) << 2 | (mask[i + 3] != 0) << 3);
+			const __m256i indices = _mm256_loadu_si256(Load256(CompressIndices.indices[bits]));
+			_mm256_storeu_si256(Store256(out + kept), _mm256_permutevar8x32_epi32(_mm256_loadu_si256(Load256(values + i)), indices));
+			kept += CompressIndices.counts[bits];
+		}
+		return kept + scalar::Compress(values + i, mask + i, count - i, out + kept);
+	}
+
+	ARITHMETIC_KERNEL(ApplyIntegers, IntegerArithmetic, bool, Int64)
+	ARITHMETIC_KERNEL(ApplyDoubles, DoubleArithmetic, void, double)
+	COMPARISON_KERNEL(CompareIntegers, IntegerComparison, Int64)
+	COMPARISON_KERNEL(CompareDoubles, DoubleComparison, double)
+}
+#endif
+
+
+
+// Dispatch //
+namespace klang::simd
+{
+	struct Kernels
+	{
+		size_t (*mismatch8)(const UInt8* const, const UInt8* const, const size_t);
+		size_t (*mismatch16)(const char16_t* const, const char16_t* const, const size_t);
+		size_t (*find8)(const UInt8* const, const size_t, const UInt8);
+		size_t (*find16)(const char16_t* const, const size_t, const char16_t);
+		size_t (*search8)(const UInt8* const, const size_t, const UInt8* const, const size_t);
+		size_t (*search16)(const char16_t* const, const size_t, const char16_t* const, const size_t);
+		size_t (*findNonAscii)(const UInt8* const, const size_t);
+		size_t (*findOutside)(const UInt8* const, const size_t, const UInt8, const UInt8);
+		size_t (*findAbove)(const char16_t* const, const size_t, const char16_t);
+		void (*widen8To16)(const UInt8* const, const size_t, char16_t* const);
+		void (*widen8To32)(const UInt8* const, const size_t, char32_t* const);
+		void (*widen16To32)(const char16_t* const, const size_t, char32_t* const);
+		void (*narrow16To8)(const char16_t* const, const size_t, UInt8* const);
+
+		bool (*sumIntegers)(const Int64* const, const size_t, Int64* const);
+		double (*sumDoubles)(const double* const, const size_t);
+		double (*dot)(const double* const, const double* const, const size_t);
+		Int64 (*minIntegers)(const Int64* const, const size_t);
+		Int64 (*maxIntegers)(const Int64* const, const size_t);
+		double (*minDoubles)(const double* const, const size_t);
+		double (*maxDoubles)(const double* const, const size_t);
+		bool (*applyIntegers)(const Arithmetic, const Int64* const, const Int64* const, const bool, const size_t, Int64* const);
+		void (*applyDoubles)(const Arithmetic, const double* const, const double* const, const bool, const size_t, double* const);
+		void (*compareIntegers)(const Comparison, const Int64* const, const Int64* const, const bool, const size_t, UInt8* const);
+		void (*compareDoubles)(const Comparison, const double* const, const double* const, const bool, const size_t, UInt8* const);
+		size_t (*compress)(const UInt64* const, const UInt8* const, const size_t, UInt64* const);
+	};
+
+	#define KERNELS(_Namespace) { \
+		&_Namespace::Mismatch8, &_Namespace::Mismatch16, &_Namespace::Find8, &_Namespace::Find16, \
+		&_Namespace::Search8, &_Namespace::Search16, &_Namespace::FindNonAscii, &_Namespace::FindOutside, &_Namespace::FindAbove, \
+		&_Namespace::Widen8To16, &_Namespace::Widen8To32, &_Namespace::Widen16To32, &_Namespace::Narrow16To8, \
+		&_Namespace::SumIntegers, &_Namespace::SumDoubles, &_Namespace::Dot, \
+		&_Namespace::MinIntegers, &_Namespace::MaxIntegers, &_Namespace::MinDoubles, &_Namespace::MaxDoubles, \
+		&_Namespace::ApplyIntegers, &_Namespace::ApplyDoubles, &_Namespace::CompareIntegers, &_Namespace::CompareDoubles, \
+		&_Namespace::Compress }
+
+	static const Kernels ScalarKernels KERNELS(scalar);
+#if defined(KLANG_SIMD_X86)
+	static const Kernels SSE2Kernels KERNELS(sse2);
+	static const Kernels AVX2Kernels KERNELS(avx2);
+#endif
+
+	#undef KERNELS
+	#undef COMPARISON_KERNEL
+	#undef ARITHMETIC_KERNEL
+	#undef SELECT
+
+	static Level Detect()
+	{
+#if defined(KLANG_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		const int leaves = info[0];
+
+		__cpuid(info, 1);
+		const bool sse2 = info[3] & (1 << 26);
+		const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		if (avx && leaves >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return Level::AVX2;
+		}
+		return sse2 ? Level::SSE2 : Level::Scalar;
+#elif defined(KLANG_SIMD_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return Level::AVX2;
+		return __builtin_cpu_supports("sse2") ? Level::SSE2 : Level::Scalar;
+#else
+		return Level::Scalar;
+#endif
+	}
+
+	static const Kernels& KernelsOf(const Level level)
+	{
+		switch (level)
+		{
+#if defined(KLANG_SIMD_X86)
+			case Level::AVX2: return AVX2Kernels;
+			case Level::SSE2: return SSE2Kernels;
+#endif
+			default: return ScalarKernels;
+		}
+	}
+
+	static Level& Current()
+	{
+		static Level level = supported();
+		return level;
+	}
+
+	static const Kernels*& Active()
+	{
+		static const Kernels* kernels = &KernelsOf(Current());
+		return kernels;
+	}
+
+	Level supported()
+	{
+		static const Level level = Detect();
+		return level;
+	}
+	Level level() { return Current(); }
+
+	void limit(const Level level)
+	{
+		Current() = level < supported() ? level : supported();
+		Active() = &KernelsOf(Current());
+	}
+
+	const char* name(const Level level)
+	{
+		switch (level)
+		{
+			case Level::SSE2: return "SSE2";
+			case Level::AVX2: return "AVX2";
+			default: return "scalar";
+		}
+	}
+}
+
+
+
+// Kernels //
+namespace klang::simd
+{
+	size_t mismatch(const UInt8* const left, const UInt8* const right, const size_t count) { return Active()->mismatch8(left, right, count); }
+	size_t mismatch(const char16_t* const left, const char16_t* const right, const size_t count) { return Active()->mismatch16(left, right, count); }
+
+	size_t find(const UInt8* const haystack, const size_t count, const UInt8 unit) { return Active()->find8(haystack, count, unit); }
+	size_t find(const char16_t* const haystack, const size_t count, const char16_t unit) { return Active()->find16(haystack, count, unit); }
+
+	size_t find(const UInt8* const haystack, const size_t count, const UInt8* const needle, const size_t needleCount)
+	{
+		if (needleCount <= 1)
+			return needleCount ? find(haystack, count, needle[0]) : 0;
+		return needleCount > count ? NotFound : Active()->search8(haystack, count, needle, needleCount);
+	}
+	size_t find(const char16_t* const haystack, const size_t count, const char16_t* const needle, const size_t needleCount)
+	{
+		if (needleCount <= 1)
+			return needleCount ? find(haystack, count, needle[0]) : 0;
+		return needleCount > count ? NotFound : Active()->search16(haystack, count, needle, needleCount);
+	}
+
+	size_t findNonAscii(const UInt8* const units, const size_t count) { return Active()->findNonAscii(units, count); }
+	size_t findOutside(const UInt8* const units, const size_t count, const UInt8 low, const UInt8 high) { return Active()->findOutside(units, count, low, high); }
+	size_t findAbove(const char16_t* const units, const size_t count, const char16_t limit) { return Active()->findAbove(units, count, limit); }
+
+	void widen(const UInt8* const in, const size_t count, char16_t* const out) { Active()->widen8To16(in, count, out); }
+	void widen(const UInt8* const in, const size_t count, char32_t* const out) { Active()->widen8To32(in, count, out); }
+	void widen(const char16_t* const in, const size_t count, char32_t* const out) { Active()->widen16To32(in, count, out); }
+	void narrow(const char16_t* const in, const size_t count, UInt8* const out) { Active()->narrow16To8(in, count, out); }
+
+
+
+	bool sum(const Int64* const values, const size_t count, Int64* const result) { return Active()->sumIntegers(values, count, result); }
+	double sum(const double* const values, const size_t count) { return Active()->sumDoubles(values, count); }
+	double dot(const double* const left, const double* const right, const size_t count) { return Active()->dot(left, right, count); }
+
+	Int64 min(const Int64* const values, const size_t count) { return Active()->minIntegers(values, count); }
+	Int64 max(const Int64* const values, const size_t count) { return Active()->maxIntegers(values, count); }
+	double min(const double* const values, const size_t count) { return Active()->minDoubles(values, count); }
+	double max(const double* const values, const size_t count) { return Active()->maxDoubles(values, count); }
+
+	bool apply(const Arithmetic op, const Int64* const left, const Int64* const right, const size_t count, Int64* const out) { return Active()->applyIntegers(op, left, right, false, count, out); }
+	bool apply(const Arithmetic op, const Int64* const left, const Int64 right, const size_t count, Int64* const out) { return Active()->applyIntegers(op, left, &right, true, count, out); }
+	void apply(const Arithmetic op, const double* const left, const double* const right, const size_t count, double* const out) { Active()->applyDoubles(op, left, right, false, count, out); }
+	void apply(const Arithmetic op, const double* const left, const double right, const size_t count, double* const out) { Active()->applyDoubles(op, left, &right, true, count, out); }
+
+	void compare(const Comparison op, const Int64* const left, const Int64* const right, const size_t count, UInt8* const mask) { Active()->compareIntegers(op, left, right, false, count, mask); }
+	void compare(const Comparison op, const Int64* const left, const Int64 right, const size_t count, UInt8* const mask) { Active()->compareIntegers(op, left, &right, true, count, mask); }
+	void compare(const Comparison op, const double* const left, const double* const right, const size_t count, UInt8* const mask) { Active()->compareDoubles(op, left, right, false, count, mask); }
+	void compare(const Comparison op, const double* const left, const double right, const size_t count, UInt8* const mask) { Active()->compareDoubles(op, left, &right, true, count, mask); }
+
+	size_t compress(const UInt64* const values, const UInt8* const mask, const size_t count, UInt64* const out) { return Active()->compress(values, mask, count, out); }
+}
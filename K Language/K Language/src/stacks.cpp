@@ -1,7 +1,5 @@
 #include "stacks.h"
 
-#include <cstring>
-
 #include "ref.h"
 
 namespace klang::stack
@@ -11,57 +9,65 @@ namespace klang::stack
 	Stack::Stack(const Byte capacity) :
 		regs{ new Register[capacity] },
 		capacity{ capacity },
-		size{}
-	{
-		std::memset(regs, 0, sizeof(Register) * capacity);
-	}
+		size{},
+		roots{ reinterpret_cast<UInt64*>(regs), capacity }
+	{}
 	Stack::~Stack()
 	{
-		Reference* reg = regs;
+		Register* reg = regs;
 		for (int i = 0; i < static_cast<int>(capacity); i++, reg++)
-			if (*reg)
-				heap::decref(*reg);
+			heap::release(reg->pointer());
 		delete[] regs;
 	}
 
-	void Stack::push_value(type::Value* const value)
+	void Stack::push_value(const type::Tagged value)
 	{
 		if (size < capacity)
 		{
+			type::Value* const old = regs[size].pointer();
 			regs[size++] = value;
-			heap::incref(value);
+			roots.barrier(value.pointer());
+			heap::release(old);
+			heap::safepoint();
 		}
 	}
 
-	void Stack::push_value(const klang::Ref& value)
-	{
-		if (size < capacity)
-		{
-			regs[size++] = const_cast<klang::type::Value*>(static_cast<const klang::type::Value*>(value));
-			heap::incref(regs[size - 1]);
-		}
-	}
+	void Stack::push_value(type::Value* const value) { push_value(type::Tagged{ value }); }
+
+	void Stack::push_value(const klang::Ref& value) { push_value(value.tagged()); }
 
 
-	klang::type::Value* Stack::pop_value()
+	klang::type::Value* Stack::pop_value() { return pop_tagged().box(); }
+
+	type::Tagged Stack::pop_tagged()
 	{
 		if (size > 0)
 			return regs[--size];
-		return klang::type::constant::Undefined;
+		return type::Tagged::undefined();
 	}
 
 
-	klang::type::Value* Stack::get(const Byte index) const
+	klang::type::Value* Stack::get(const Byte index) const { return get_tagged(index).box(); }
+
+	type::Tagged Stack::get_tagged(const Byte index) const
 	{
 		return index >= capacity
-			? type::constant::Undefined
-			: regs[index] ? regs[index] : type::constant::Undefined;
+			? type::Tagged::undefined()
+			: regs[index];
 	}
 
-	void Stack::set(const Byte index, klang::type::Value* value)
+	void Stack::set(const Byte index, const type::Tagged value)
 	{
 		if (index < capacity)
-			regs[index] = value ? value : type::constant::Undefined;
+		{
+			type::Value* const old = regs[index].pointer();
+			regs[index] = value;
+			roots.barrier(value.pointer());
+			heap::release(old);
+			heap::safepoint();
+		}
 	}
 
+	void Stack::set(const Byte index, klang::type::Value* value) { set(index, type::Tagged{ value }); }
+
 }
@@ -0,0 +1,1145 @@
+#include "types.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#define BOOL_TEST(_Expr) (static_cast<bool>((_Expr)) ? klang::type::constant::True : klang::type::constant::False)
+
+
+// Encoding helpers //
+namespace klang::type
+{
+	typedef String::Encoding Encoding;
+
+	static inline UInt32 CodeOf(const wchar_t c) { return static_cast<UInt32>(static_cast<std::make_unsigned<wchar_t>::type>(c)); }
+
+	static inline size_t Utf8Width(const UInt32 code) { return code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4; }
+	static inline size_t Utf8SequenceLength(const UInt8 lead) { return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4; }
+
+	static inline UInt8* EncodeUtf8(UInt8* out, const UInt32 code)
+	{
+		if (code < 0x80)
+			*out++ = static_cast<UInt8>(code);
+		else if (code < 0x800)
+		{
+			*out++ = static_cast<UInt8>(0xC0 | (code >> 6));
+			*out++ = static_cast<UInt8>(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			*out++ = static_cast<UInt8>(0xE0 | (code >> 12));
+			*out++ = static_cast<UInt8>(0x80 | ((code >> 6) & 0x3F));
+			*out++ = static_cast<UInt8>(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			*out++ = static_cast<UInt8>(0xF0 | (code >> 18));
+			*out++ = static_cast<UInt8>(0x80 | ((code >> 12) & 0x3F));
+			*out++ = static_cast<UInt8>(0x80 | ((code >> 6) & 0x3F));
+			*out++ = static_cast<UInt8>(0x80 | (code & 0x3F));
+		}
+		return out;
+	}
+
+	static inline UInt32 DecodeUtf8(const UInt8*& in)
+	{
+		const UInt32 lead = *in++;
+		if (lead < 0x80)
+			return lead;
+		if (lead < 0xE0)
+			return ((lead & 0x1F) << 6) | (*in++ & 0x3F);
+
+		UInt32 code = lead < 0xF0 ? lead & 0x0F : lead & 0x07;
+		for (size_t i = Utf8SequenceLength(static_cast<UInt8>(lead)) - 1; i > 0; --i)
+			code = (code << 6) | (*in++ & 0x3F);
+		return code;
+	}
+
+	/* UTF-8 strings keep, after their bytes, the byte offset of every UTF8IndexStep-th
+	   character. */
+	static inline size_t IndexOffset(const size_t bytes) { return (bytes + 3) & ~static_cast<size_t>(3); }
+	static inline size_t IndexEntries(const size_t length) { return (length + String::UTF8IndexStep - 1) / String::UTF8IndexStep; }
+
+	static inline size_t BufferSize(const Encoding encoding, const size_t length, const size_t bytes)
+	{
+		const size_t size = encoding == Encoding::UTF8 ? IndexOffset(bytes) + sizeof(UInt32) * IndexEntries(length) : bytes;
+		return size ? size : 1;
+	}
+
+	static Encoding EncodingOf(const std::wstring& value)
+	{
+		if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+			return simd::findAbove(reinterpret_cast<const char16_t*>(value.data()), value.size(), 0xFF) == value.size() ? Encoding::Latin1 : Encoding::UCS2;
+
+		UInt32 widest = 0;
+		for (const wchar_t c : value)
+			widest |= CodeOf(c);
+		return widest <= 0xFF ? Encoding::Latin1 : widest <= 0xFFFF ? Encoding::UCS2 : Encoding::UTF8;
+	}
+
+	static size_t EncodedBytes(const std::wstring& value, const Encoding encoding)
+	{
+		switch (encoding)
+		{
+			case Encoding::Latin1: return value.size();
+			case Encoding::UCS2: return value.size() * sizeof(char16_t);
+			default: break;
+		}
+
+		size_t bytes = 0;
+		for (const wchar_t c : value)
+			bytes += Utf8Width(CodeOf(c));
+		return bytes;
+	}
+
+	/* FNV-1a over whole character codes, so it does not depend on the encoding. Zero is
+	   kept to mark a hash not computed yet. */
+	static constexpr size_t HashSeed = sizeof(size_t) == 8 ? static_cast<size_t>(14695981039346656037ULL) : static_cast<size_t>(2166136261U);
+	static constexpr size_t HashPrime = sizeof(size_t) == 8 ? static_cast<size_t>(1099511628211ULL) : static_cast<size_t>(16777619U);
+
+	static inline size_t HashStep(const size_t hash, const UInt32 code) { return (hash ^ code) * HashPrime; }
+	static inline size_t HashFinish(const size_t hash) { return hash ? hash : 1; }
+
+	static size_t HashOf(const std::wstring& value)
+	{
+		size_t hash = HashSeed;
+		for (const wchar_t c : value)
+			hash = HashStep(hash, CodeOf(c));
+		return HashFinish(hash);
+	}
+
+	/* Sequential reader over any encoding, for operations mixing two encodings. */
+	class CharReader
+	{
+	private:
+		const String& _string;
+		size_t _offset;
+
+	public:
+		CharReader(const String& string, const size_t offset = 0) : _string{ string }, _offset{ offset } {}
+
+		inline UInt32 next()
+		{
+			switch (_string.encoding())
+			{
+				case Encoding::Latin1: return _string.latin1()[_offset++];
+				case Encoding::UCS2: return _string.ucs2()[_offset++];
+				default: {
+					const UInt8* ptr = _string.utf8() + _offset;
+					const UInt32 code = DecodeUtf8(ptr);
+					_offset = static_cast<size_t>(ptr - _string.utf8());
+					return code;
+				}
+			}
+		}
+	};
+
+	/* Reader offset of a character: its unit for Latin-1 and UCS-2, its byte for UTF-8. */
+	static size_t UnitOffset(const String& string, const size_t index)
+	{
+		if (string.encoding() != Encoding::UTF8)
+			return index;
+
+		const UInt8* const chars = string.utf8();
+		const UInt32* const entries = reinterpret_cast<const UInt32*>(chars + IndexOffset(string.bytes()));
+		size_t offset = entries[index / String::UTF8IndexStep];
+		for (size_t skip = index % String::UTF8IndexStep; skip; --skip)
+			offset += Utf8SequenceLength(chars[offset]);
+		return offset;
+	}
+
+	static size_t Utf8Bytes(const String& string)
+	{
+		if (string.encoding() == Encoding::UTF8)
+			return string.bytes();
+
+		size_t bytes = 0;
+		if (string.encoding() == Encoding::Latin1)
+		{
+			const UInt8* const chars = string.latin1();
+			for (size_t i = simd::findNonAscii(chars, string.size()); i < string.size(); i += 1 + simd::findNonAscii(chars + i + 1, string.size() - i - 1))
+				++bytes;
+			return string.size() + bytes;
+		}
+
+		CharReader reader{ string };
+		for (size_t i = 0; i < string.size(); ++i)
+			bytes += Utf8Width(reader.next());
+		return bytes;
+	}
+
+	/* ASCII runs are copied, or narrowed, as they are. */
+	static UInt8* WriteUtf8(const String& string, UInt8* out)
+	{
+		const size_t size = string.size();
+		switch (string.encoding())
+		{
+			case Encoding::Latin1: {
+				const UInt8* const chars = string.latin1();
+				for (size_t i = 0; i < size;)
+				{
+					const size_t run = simd::findNonAscii(chars + i, size - i);
+					std::memcpy(out, chars + i, run);
+					out += run;
+					if ((i += run) < size)
+						out = EncodeUtf8(out, chars[i++]);
+				}
+			} break;
+
+			case Encoding::UCS2: {
+				const char16_t* const chars = string.ucs2();
+				for (size_t i = 0; i < size;)
+				{
+					const size_t run = simd::findAbove(chars + i, size - i, 0x7F);
+					simd::narrow(chars + i, run, out);
+					out += run;
+					if ((i += run) < size)
+						out = EncodeUtf8(out, chars[i++]);
+				}
+			} break;
+
+			case Encoding::UTF8:
+				std::memcpy(out, string.utf8(), string.bytes());
+				out += string.bytes();
+				break;
+		}
+		return out;
+	}
+
+	/* Latin-1 or UCS-2 source. */
+	static char16_t* WriteUcs2(const String& string, char16_t* out)
+	{
+		if (string.encoding() == Encoding::UCS2)
+		{
+			std::memcpy(out, string.ucs2(), string.bytes());
+			return out + string.size();
+		}
+
+		simd::widen(string.latin1(), string.size(), out);
+		return out + string.size();
+	}
+
+	template<typename _CharType>
+	static int CompareUnits(const _CharType* const left, const size_t leftSize, const _CharType* const right, const size_t rightSize)
+	{
+		const size_t size = std::min(leftSize, rightSize);
+		const size_t at = simd::mismatch(left, right, size);
+		if (at < size)
+			return left[at] < right[at] ? -1 : 1;
+		return leftSize == rightSize ? 0 : leftSize < rightSize ? -1 : 1;
+	}
+}
+
+
+
+// Number parsing //
+namespace klang::type
+{
+	typedef String::Numeric Numeric;
+
+	static inline bool IsBlank(const char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+	/* Eight ASCII digits combined pairwise in one register, on little endian targets. */
+	static inline UInt64 EightDigits(const char* const digits)
+	{
+		UInt64 value;
+		std::memcpy(&value, digits, sizeof(value));
+		value -= 0x3030303030303030ULL;
+		value = value * 10 + (value >> 8);
+		return (((value & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) + (((value >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	}
+
+	/* std::from_chars leaves the value alone when out of range: overflow by the sign of
+	   the number, underflow by the sign of the exponent. */
+	static double OutOfRange(const char* const begin, const char* const end)
+	{
+		const bool negative = *begin == '-';
+		for (const char* c = begin; c < end; ++c)
+			if ((*c == 'e' || *c == 'E') && c + 1 < end && c[1] == '-')
+				return negative ? -0.0 : 0.0;
+		return negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+	}
+
+	/* Integers of up to 18 digits are read directly, eight digits at a time past the
+	   digit run found by the kernels. Longer integers, fractions, exponents, inf and nan
+	   go through std::from_chars, integers out of Int64 range become reals. */
+	static Numeric ParseNumber(const char* begin, const char* const end, Int64* const integer, double* const real)
+	{
+		while (begin < end && IsBlank(*begin))
+			++begin;
+
+		const char* const sign = begin;
+		const bool negative = begin < end && *begin == '-';
+		if (begin < end && (*begin == '-' || *begin == '+'))
+			++begin;
+		if (begin < end && (*begin == '-' || *begin == '+'))
+			return Numeric::None;
+
+		const char* const number = negative ? sign : begin;
+		const size_t count = simd::findOutside(reinterpret_cast<const UInt8*>(begin), static_cast<size_t>(end - begin), '0', '9');
+		const char* const after = begin + count;
+		const bool fraction = after < end && (*after == '.' || *after == 'e' || *after == 'E');
+
+		if (count && !fraction)
+		{
+			if (count <= 18)
+			{
+				UInt64 value = 0;
+				size_t i = 0;
+				for (; i + 8 <= count; i += 8)
+					value = value * 100000000 + EightDigits(begin + i);
+				for (; i < count; ++i)
+					value = value * 10 + static_cast<UInt64>(begin[i] - '0');
+
+				*integer = negative ? -static_cast<Int64>(value) : static_cast<Int64>(value);
+				return Numeric::Integer;
+			}
+
+			if (std::from_chars(number, after, *integer).ec == std::errc{})
+				return Numeric::Integer;
+		}
+
+		const std::from_chars_result result = std::from_chars(number, end, *real, std::chars_format::general);
+		if (result.ec == std::errc::invalid_argument)
+			return Numeric::None;
+		if (result.ec == std::errc::result_out_of_range)
+			*real = OutOfRange(number, result.ptr);
+		return Numeric::Real;
+	}
+}
+
+
+
+// String //
+namespace klang::type
+{
+	String::String(const std::wstring& value) :
+		Value{ Type::String },
+		_encoding{ EncodingOf(value) },
+		_interned{ false },
+		_kind{ Kind::Flat },
+		_numeric{ Numeric::Unparsed },
+		_length{ value.size() },
+		_bytes{ EncodedBytes(value, _encoding) },
+		_hash{ 0 },
+		_data{ heap::malloc(BufferSize(_encoding, _length, _bytes)) },
+		_right{ nullptr }
+	{
+		if (!_data)
+			throw heap::HeapOverflowException{ BufferSize(_encoding, _length, _bytes) };
+
+		heap::incref(_data);
+		switch (_encoding)
+		{
+			case Encoding::Latin1: {
+				UInt8* const chars = reinterpret_cast<UInt8*>(_data);
+				if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+					simd::narrow(reinterpret_cast<const char16_t*>(value.data()), _length, chars);
+				else
+				{
+					for (size_t i = 0; i < _length; ++i)
+						chars[i] = static_cast<UInt8>(value[i]);
+				}
+			} break;
+
+			case Encoding::UCS2: {
+				char16_t* const chars = reinterpret_cast<char16_t*>(_data);
+				if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+					std::memcpy(chars, value.data(), _bytes);
+				else
+				{
+					for (size_t i = 0; i < _length; ++i)
+						chars[i] = static_cast<char16_t>(value[i]);
+				}
+			} break;
+
+			case Encoding::UTF8: {
+				UInt8* out = reinterpret_cast<UInt8*>(_data);
+				for (const wchar_t c : value)
+					out = EncodeUtf8(out, CodeOf(c));
+				buildIndex();
+			} break;
+		}
+	}
+	String::String(const Encoding encoding, const size_t length, const size_t bytes) :
+		Value{ Type::String },
+		_encoding{ encoding },
+		_interned{ false },
+		_kind{ Kind::Flat },
+		_numeric{ Numeric::Unparsed },
+		_length{ length },
+		_bytes{ bytes },
+		_hash{ 0 },
+		_data{ heap::malloc(BufferSize(encoding, length, bytes)) },
+		_right{ nullptr }
+	{
+		if (!_data)
+			throw heap::HeapOverflowException{ BufferSize(encoding, length, bytes) };
+
+		heap::incref(_data);
+	}
+	/* Both parts keep the narrowest encoding of their characters, so the wider one is
+	   the narrowest of the whole. UTF-8 byte counts are only known once flat. */
+	String::String(String* const left, String* const right) :
+		Value{ Type::String },
+		_encoding{ std::max(left->_encoding, right->_encoding) },
+		_interned{ false },
+		_kind{ Kind::Rope },
+		_numeric{ Numeric::Unparsed },
+		_length{ left->_length + right->_length },
+		_bytes{ _encoding == Encoding::Latin1 ? _length : _encoding == Encoding::UCS2 ? _length * sizeof(char16_t) : 0 },
+		_hash{ 0 },
+		_data{ left },
+		_right{ right }
+	{
+		heap::incref(left);
+		heap::incref(right);
+	}
+	String::String(String* const parent, const size_t offset, const size_t length) :
+		Value{ Type::String },
+		_encoding{ parent->_encoding },
+		_interned{ false },
+		_kind{ Kind::Slice },
+		_numeric{ Numeric::Unparsed },
+		_length{ length },
+		_bytes{ _encoding == Encoding::UCS2 ? length * sizeof(char16_t) : length },
+		_hash{ 0 },
+		_data{ parent },
+		_offset{ offset }
+	{
+		heap::incref(parent);
+	}
+	String::String(void* const buffer, const UInt8 ascii) :
+		Value{ Type::String },
+		_encoding{ Encoding::Latin1 },
+		_interned{ true },
+		_kind{ Kind::Flat },
+		_numeric{ ascii >= '0' && ascii <= '9' ? Numeric::Integer : Numeric::None },
+		_length{ 1 },
+		_bytes{ 1 },
+		_hash{ HashFinish(HashStep(HashSeed, ascii)) },
+		_integer{ ascii - '0' },
+		_data{ buffer },
+		_right{ nullptr }
+	{
+		*reinterpret_cast<UInt8*>(_data) = ascii;
+	}
+	String::~String()
+	{
+		if (_interned)
+			heap::remove_interned(_hash, this);
+		heap::decref(_data);
+		switch (_kind)
+		{
+			case Kind::Flat: heap::free(_data); break;
+			case Kind::Rope: heap::decref(_right); break;
+			default: break;
+		}
+	}
+
+	String* String::allocate(const Encoding encoding, const size_t length, const size_t bytes)
+	{
+		String* const ptr = reinterpret_cast<String*>(heap::malloc(sizeof(String)));
+		if (!ptr)
+			throw heap::HeapOverflowException{ sizeof(String) };
+
+		::new(ptr) String(encoding, length, bytes);
+		return heap::created(ptr);
+	}
+
+	/* Immortal strings are never written: they are created interned with their hash, and
+	   their buffer lives in the immortal region as well since compaction skips them. */
+	String* const* String::createAsciiCharacters()
+	{
+		static String* characters[0x80];
+		for (UInt8 code = 0; code < 0x80; ++code)
+		{
+			void* const buffer = heap::s_malloc(1);
+			String* const ptr = reinterpret_cast<String*>(heap::s_malloc(sizeof(String)));
+			if (!buffer || !ptr)
+				throw heap::HeapOverflowException{ sizeof(String) + 1 };
+
+			characters[code] = ::new(ptr) String(buffer, code);
+		}
+		return characters;
+	}
+
+	String* const* const String::AsciiCharacters = String::createAsciiCharacters();
+
+	/* Appends build left deep ropes, far too deep to recurse over: the leaves are
+	   gathered left to right with an explicit stack. Shared parts are read, not
+	   flattened themselves. */
+	void String::flatten() const
+	{
+		std::vector<const String*> leaves;
+		std::vector<const String*> pending{ this };
+		while (!pending.empty())
+		{
+			const String* const node = pending.back();
+			pending.pop_back();
+			if (node->_kind == Kind::Rope)
+			{
+				pending.push_back(node->_right);
+				pending.push_back(reinterpret_cast<const String*>(node->_data));
+			}
+			else leaves.push_back(node);
+		}
+
+		size_t bytes = _bytes;
+		if (_encoding == Encoding::UTF8)
+		{
+			for (const String* const leaf : leaves)
+				bytes += Utf8Bytes(*leaf);
+		}
+
+		const size_t size = BufferSize(_encoding, _length, bytes);
+		void* const data = heap::malloc(size);
+		if (!data)
+			throw heap::HeapOverflowException{ size };
+		heap::incref(data);
+
+		switch (_encoding)
+		{
+			case Encoding::Latin1: {
+				UInt8* out = reinterpret_cast<UInt8*>(data);
+				for (const String* const leaf : leaves)
+				{
+					std::memcpy(out, leaf->latin1(), leaf->_bytes);
+					out += leaf->_bytes;
+				}
+			} break;
+
+			case Encoding::UCS2: {
+				char16_t* out = reinterpret_cast<char16_t*>(data);
+				for (const String* const leaf : leaves)
+					out = WriteUcs2(*leaf, out);
+			} break;
+
+			case Encoding::UTF8: {
+				UInt8* out = reinterpret_cast<UInt8*>(data);
+				for (const String* const leaf : leaves)
+					out = WriteUtf8(*leaf, out);
+			} break;
+		}
+
+		String* const left = reinterpret_cast<String*>(_data);
+		String* const right = _right;
+		_data = data;
+		_right = nullptr;
+		_kind = Kind::Flat;
+		_bytes = bytes;
+		if (_encoding == Encoding::UTF8)
+			const_cast<String*>(this)->buildIndex();
+
+		heap::decref(left);
+		heap::decref(right);
+	}
+
+	void* String::resolve() const
+	{
+		if (_kind == Kind::Rope)
+		{
+			flatten();
+			return _data;
+		}
+		return reinterpret_cast<UInt8*>(reinterpret_cast<String*>(_data)->_data) + _offset;
+	}
+
+	void String::buildIndex()
+	{
+		const UInt8* const chars = utf8();
+		UInt32* const index = reinterpret_cast<UInt32*>(reinterpret_cast<UInt8*>(_data) + IndexOffset(_bytes));
+
+		size_t offset = 0;
+		for (size_t i = 0; i < _length; ++i)
+		{
+			if (!(i % UTF8IndexStep))
+				index[i / UTF8IndexStep] = static_cast<UInt32>(offset);
+			offset += Utf8SequenceLength(chars[offset]);
+		}
+	}
+
+	UInt32 String::at(const size_t index) const
+	{
+		switch (_encoding)
+		{
+			case Encoding::Latin1: return latin1()[index];
+			case Encoding::UCS2: return ucs2()[index];
+			default: break;
+		}
+
+		const UInt8* ptr = utf8() + UnitOffset(*this, index);
+		return DecodeUtf8(ptr);
+	}
+
+	size_t String::hash() const
+	{
+		if (_hash)
+			return _hash;
+
+		size_t hash = HashSeed;
+		switch (_encoding)
+		{
+			case Encoding::Latin1: {
+				const UInt8* const chars = latin1();
+				for (size_t i = 0; i < _length; ++i)
+					hash = HashStep(hash, chars[i]);
+			} break;
+
+			case Encoding::UCS2: {
+				const char16_t* const chars = ucs2();
+				for (size_t i = 0; i < _length; ++i)
+					hash = HashStep(hash, chars[i]);
+			} break;
+
+			case Encoding::UTF8: {
+				CharReader reader{ *this };
+				for (size_t i = 0; i < _length; ++i)
+					hash = HashStep(hash, reader.next());
+			} break;
+		}
+		return _hash = HashFinish(hash);
+	}
+
+	/* UTF-8 byte order is code point order, so every same encoding pair compares its
+	   units directly. */
+	int String::compare(const String& other) const
+	{
+		if (_encoding == other._encoding)
+		{
+			switch (_encoding)
+			{
+				case Encoding::Latin1: return CompareUnits(latin1(), _length, other.latin1(), other._length);
+				case Encoding::UCS2: return CompareUnits(ucs2(), _length, other.ucs2(), other._length);
+				default: return CompareUnits(utf8(), bytes(), other.utf8(), other.bytes());
+			}
+		}
+
+		CharReader left{ *this };
+		CharReader right{ other };
+		for (size_t i = std::min(_length, other._length); i > 0; --i)
+		{
+			const UInt32 lhs = left.next();
+			const UInt32 rhs = right.next();
+			if (lhs != rhs)
+				return lhs < rhs ? -1 : 1;
+		}
+		return _length == other._length ? 0 : _length < other._length ? -1 : 1;
+	}
+
+	int String::compare(const std::wstring& other) const
+	{
+		CharReader reader{ *this };
+		const size_t size = std::min(_length, other.size());
+		for (size_t i = 0; i < size; ++i)
+		{
+			const UInt32 lhs = reader.next();
+			const UInt32 rhs = CodeOf(other[i]);
+			if (lhs != rhs)
+				return lhs < rhs ? -1 : 1;
+		}
+		return _length == other.size() ? 0 : _length < other.size() ? -1 : 1;
+	}
+
+	bool String::equals(const String& other) const
+	{
+		if (this == &other)
+			return true;
+		if ((_interned && other._interned) || _encoding != other._encoding || _length != other._length)
+			return false;
+		return hash() == other.hash() && bytes() == other.bytes() && simd::equal(chars(), other.chars(), _bytes);
+	}
+
+	static bool MatchString(const void* const object, const void* const key) { return reinterpret_cast<const String*>(object)->equals(*reinterpret_cast<const String*>(key)); }
+	static bool MatchWString(const void* const object, const void* const key) { return !reinterpret_cast<const String*>(object)->compare(*reinterpret_cast<const std::wstring*>(key)); }
+
+	String* String::intern()
+	{
+		if (_interned)
+			return this;
+		if (_length == 1 && at(0) < 0x80)
+			return AsciiCharacters[at(0)];
+
+		String* const found = reinterpret_cast<String*>(heap::find_interned(hash(), &MatchString, this));
+		if (found)
+			return found;
+
+		_interned = true;
+		heap::add_interned(_hash, this);
+		return this;
+	}
+
+	String* String::intern(const std::wstring& value)
+	{
+		if (value.size() == 1 && CodeOf(value[0]) < 0x80)
+			return AsciiCharacters[CodeOf(value[0])];
+
+		const size_t hash = HashOf(value);
+		String* const found = reinterpret_cast<String*>(heap::find_interned(hash, &MatchWString, &value));
+		if (found)
+			return found;
+
+		String* const string = newString(value);
+		string->_hash = hash;
+		string->_interned = true;
+		heap::add_interned(hash, string);
+		return string;
+	}
+
+	String* String::findInterned(const std::wstring& value)
+	{
+		if (value.size() == 1 && CodeOf(value[0]) < 0x80)
+			return AsciiCharacters[CodeOf(value[0])];
+		return reinterpret_cast<String*>(heap::find_interned(HashOf(value), &MatchWString, &value));
+	}
+
+	/* The result takes the wider encoding of both sides, same width parts are copied as is. */
+	String* String::concat(const String& other) const
+	{
+		if (!other._length)
+			return const_cast<String*>(this);
+		if (!_length)
+			return const_cast<String*>(&other);
+
+		const Encoding encoding = std::max(_encoding, other._encoding);
+		const size_t length = _length + other._length;
+		if (length >= RopeMinLength)
+		{
+			String* const ptr = reinterpret_cast<String*>(heap::malloc(sizeof(String)));
+			if (!ptr)
+				throw heap::HeapOverflowException{ sizeof(String) };
+
+			::new(ptr) String(const_cast<String*>(this), const_cast<String*>(&other));
+			return heap::created(ptr);
+		}
+
+		String* result;
+		switch (encoding)
+		{
+			case Encoding::Latin1:
+				result = allocate(encoding, length, length);
+				std::memcpy(result->_data, latin1(), _bytes);
+				std::memcpy(reinterpret_cast<UInt8*>(result->_data) + _bytes, other.latin1(), other._bytes);
+				break;
+
+			case Encoding::UCS2:
+				result = allocate(encoding, length, length * sizeof(char16_t));
+				WriteUcs2(other, WriteUcs2(*this, reinterpret_cast<char16_t*>(result->_data)));
+				break;
+
+			default:
+				result = allocate(encoding, length, Utf8Bytes(*this) + Utf8Bytes(other));
+				WriteUtf8(other, WriteUtf8(*this, reinterpret_cast<UInt8*>(result->_data)));
+				result->buildIndex();
+				break;
+		}
+		return result;
+	}
+
+	/* Slices point at a flat parent: slicing a slice shares the same parent, ropes are
+	   flattened first. A narrower substring of a UCS-2 string is copied to keep every
+	   string in its narrowest encoding. UTF-8 substrings are always copied, their
+	   character index belongs to the whole buffer. */
+	String* String::slice(const size_t start, const size_t length) const
+	{
+		if (!start && length == _length)
+			return const_cast<String*>(this);
+		if (length == 1)
+			return character(at(start));
+		if (length < SliceMinLength || _encoding == Encoding::UTF8)
+			return copy(start, length);
+
+		size_t offset = start;
+		if (_encoding == Encoding::UCS2)
+		{
+			if (simd::findAbove(ucs2() + start, length, 0xFF) == length)
+				return copy(start, length);
+			offset *= sizeof(char16_t);
+		}
+
+		String* parent = const_cast<String*>(this);
+		chars();
+		if (_kind == Kind::Slice)
+		{
+			parent = reinterpret_cast<String*>(_data);
+			offset += _offset;
+		}
+
+		String* const ptr = reinterpret_cast<String*>(heap::malloc(sizeof(String)));
+		if (!ptr)
+			throw heap::HeapOverflowException{ sizeof(String) };
+
+		::new(ptr) String(parent, offset, length);
+		return heap::created(ptr);
+	}
+
+	String* String::copy(const size_t start, const size_t length) const
+	{
+		if (_encoding == Encoding::Latin1)
+		{
+			String* const result = allocate(Encoding::Latin1, length, length);
+			std::memcpy(result->_data, latin1() + start, length);
+			return result;
+		}
+		if (_encoding == Encoding::UCS2)
+		{
+			const char16_t* const units = ucs2() + start;
+			if (simd::findAbove(units, length, 0xFF) == length)
+			{
+				String* const result = allocate(Encoding::Latin1, length, length);
+				simd::narrow(units, length, reinterpret_cast<UInt8*>(result->_data));
+				return result;
+			}
+
+			String* const result = allocate(Encoding::UCS2, length, length * sizeof(char16_t));
+			std::memcpy(result->_data, units, length * sizeof(char16_t));
+			return result;
+		}
+
+		const size_t offset = length ? UnitOffset(*this, start) : 0;
+
+		UInt32 widest = 0;
+		size_t utf8Bytes = 0;
+		CharReader scan{ *this, offset };
+		for (size_t i = 0; i < length; ++i)
+		{
+			const UInt32 code = scan.next();
+			widest |= code;
+			utf8Bytes += Utf8Width(code);
+		}
+
+		CharReader reader{ *this, offset };
+		String* result;
+		if (widest <= 0xFF)
+		{
+			result = allocate(Encoding::Latin1, length, length);
+			UInt8* const out = reinterpret_cast<UInt8*>(result->_data);
+			for (size_t i = 0; i < length; ++i)
+				out[i] = static_cast<UInt8>(reader.next());
+		}
+		else if (widest <= 0xFFFF)
+		{
+			result = allocate(Encoding::UCS2, length, length * sizeof(char16_t));
+			char16_t* const out = reinterpret_cast<char16_t*>(result->_data);
+			for (size_t i = 0; i < length; ++i)
+				out[i] = static_cast<char16_t>(reader.next());
+		}
+		else
+		{
+			result = allocate(Encoding::UTF8, length, utf8Bytes);
+			UInt8* out = reinterpret_cast<UInt8*>(result->_data);
+			for (size_t i = 0; i < length; ++i)
+				out = EncodeUtf8(out, reader.next());
+			result->buildIndex();
+		}
+		return result;
+	}
+
+	/* A needle wider than this string holds a character it cannot contain. UTF-8 is
+	   searched bytewise, a match of whole sequences is a match of characters. */
+	size_t String::indexOf(const String& needle, const size_t from) const
+	{
+		static_assert(NotFound == simd::NotFound, "String::NotFound must match the kernels");
+
+		if (from > _length || needle._encoding > _encoding || needle._length > _length - from)
+			return NotFound;
+		if (!needle._length)
+			return from;
+
+		size_t found;
+		switch (_encoding)
+		{
+			case Encoding::Latin1:
+				found = simd::find(latin1() + from, _length - from, needle.latin1(), needle._length);
+				break;
+
+			case Encoding::UCS2:
+				if (needle._encoding == Encoding::UCS2)
+					found = simd::find(ucs2() + from, _length - from, needle.ucs2(), needle._length);
+				else
+				{
+					std::u16string wide(needle._length, 0);
+					simd::widen(needle.latin1(), needle._length, &wide[0]);
+					found = simd::find(ucs2() + from, _length - from, wide.data(), wide.size());
+				}
+				break;
+
+			default: {
+				std::vector<UInt8> encoded;
+				const UInt8* pattern = needle.utf8();
+				size_t patternBytes = needle.bytes();
+				if (needle._encoding != Encoding::UTF8)
+				{
+					encoded.resize(Utf8Bytes(needle));
+					pattern = encoded.data();
+					patternBytes = static_cast<size_t>(WriteUtf8(needle, encoded.data()) - encoded.data());
+				}
+
+				const UInt8* const chars = utf8();
+				const size_t start = from < _length ? UnitOffset(*this, from) : _bytes;
+				const size_t at = simd::find(chars + start, _bytes - start, pattern, patternBytes);
+				if (at == simd::NotFound)
+					return NotFound;
+
+				found = 0;
+				for (size_t i = start; i < start + at; ++i)
+					found += (chars[i] & 0xC0) != 0x80;
+			} break;
+		}
+		return found == simd::NotFound ? NotFound : from + found;
+	}
+
+	String* String::character(const UInt32 code)
+	{
+		if (code < 0x80)
+			return AsciiCharacters[code];
+
+		String* result;
+		if (code <= 0xFF)
+		{
+			result = allocate(Encoding::Latin1, 1, 1);
+			*reinterpret_cast<UInt8*>(result->_data) = static_cast<UInt8>(code);
+		}
+		else if (code <= 0xFFFF)
+		{
+			result = allocate(Encoding::UCS2, 1, sizeof(char16_t));
+			*reinterpret_cast<char16_t*>(result->_data) = static_cast<char16_t>(code);
+		}
+		else
+		{
+			result = allocate(Encoding::UTF8, 1, Utf8Width(code));
+			EncodeUtf8(reinterpret_cast<UInt8*>(result->_data), code);
+			result->buildIndex();
+		}
+		return result;
+	}
+
+	/* Numbers are ASCII: a UTF-8 buffer is parsed as is, a UCS-2 one from its narrowed
+	   ASCII prefix. */
+	Numeric String::numeric() const
+	{
+		if (_numeric != Numeric::Unparsed)
+			return _numeric;
+
+		switch (_encoding)
+		{
+			case Encoding::UCS2: {
+				const size_t size = simd::findAbove(ucs2(), _length, 0x7F);
+				std::string ascii(size, '\0');
+				simd::narrow(ucs2(), size, reinterpret_cast<UInt8*>(&ascii[0]));
+				_numeric = ParseNumber(ascii.data(), ascii.data() + size, &_integer, &_real);
+			} break;
+
+			default: {
+				const char* const text = reinterpret_cast<const char*>(chars());
+				_numeric = ParseNumber(text, text + _bytes, &_integer, &_real);
+			} break;
+		}
+		return _numeric;
+	}
+
+	/* Reals are truncated toward zero and saturated. */
+	bool String::toInteger(Int64* const value) const
+	{
+		switch (numeric())
+		{
+			case Numeric::Integer:
+				*value = _integer;
+				return true;
+
+			case Numeric::Real:
+				if (_real != _real)
+					return false;
+				if (_real <= -9223372036854775808.0)
+					*value = std::numeric_limits<Int64>::min();
+				else if (_real >= 9223372036854775808.0)
+					*value = std::numeric_limits<Int64>::max();
+				else *value = static_cast<Int64>(_real);
+				return true;
+
+			default: return false;
+		}
+	}
+
+	bool String::toReal(double* const value) const
+	{
+		switch (numeric())
+		{
+			case Numeric::Integer:
+				*value = static_cast<double>(_integer);
+				return true;
+
+			case Numeric::Real:
+				*value = _real;
+				return true;
+
+			default: return false;
+		}
+	}
+
+	/* Strings without a number convert to 0, or NaN for reals. */
+	String::operator Int32() const
+	{
+		const Int64 value = static_cast<Int64>(*this);
+		return static_cast<Int32>(std::clamp<Int64>(value, std::numeric_limits<Int32>::min(), std::numeric_limits<Int32>::max()));
+	}
+	String::operator Int64() const
+	{
+		Int64 value;
+		return toInteger(&value) ? value : 0;
+	}
+	String::operator float() const { return static_cast<float>(static_cast<double>(*this)); }
+	String::operator double() const
+	{
+		double value;
+		return toReal(&value) ? value : std::numeric_limits<double>::quiet_NaN();
+	}
+	String::operator bool() const { return _length > 1; }
+	String::operator std::wstring() const
+	{
+		typedef std::conditional<sizeof(wchar_t) == sizeof(char16_t), char16_t, char32_t>::type WideUnit;
+
+		std::wstring result;
+		switch (_encoding)
+		{
+			case Encoding::Latin1:
+				result.resize(_length);
+				simd::widen(latin1(), _length, reinterpret_cast<WideUnit*>(&result[0]));
+				return result;
+
+			case Encoding::UCS2:
+				result.resize(_length);
+				if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+					std::memcpy(&result[0], ucs2(), _bytes);
+				else simd::widen(ucs2(), _length, reinterpret_cast<char32_t*>(&result[0]));
+				return result;
+
+			default: break;
+		}
+
+		result.reserve(_length);
+		const UInt8* ptr = utf8();
+		const UInt8* const end = ptr + _bytes;
+		while (ptr < end)
+		{
+			const size_t run = simd::findNonAscii(ptr, static_cast<size_t>(end - ptr));
+			const size_t size = result.size();
+			result.resize(size + run);
+			simd::widen(ptr, run, reinterpret_cast<WideUnit*>(&result[size]));
+			if ((ptr += run) == end)
+				break;
+
+			const UInt32 code = DecodeUtf8(ptr);
+			if (sizeof(wchar_t) == 2 && code > 0xFFFF)
+			{
+				result.push_back(static_cast<wchar_t>(0xD800 + ((code - 0x10000) >> 10)));
+				result.push_back(static_cast<wchar_t>(0xDC00 + ((code - 0x10000) & 0x3FF)));
+			}
+			else result.push_back(static_cast<wchar_t>(code));
+		}
+		return result;
+	}
+
+	/* Units that are not wchar_t already go through a stack buffer. */
+	void String::writeTo(TextSink& sink) const
+	{
+		wchar_t buffer[256];
+		constexpr size_t BufferLength = sizeof(buffer) / sizeof(wchar_t);
+		switch (_encoding)
+		{
+			case Encoding::Latin1:
+				sink.write(reinterpret_cast<const char*>(latin1()), _length);
+				break;
+
+			case Encoding::UCS2:
+				if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+					sink.write(reinterpret_cast<const wchar_t*>(ucs2()), _length);
+				else
+				{
+					for (size_t done = 0; done < _length;)
+					{
+						const size_t count = std::min(_length - done, BufferLength);
+						simd::widen(ucs2() + done, count, reinterpret_cast<char32_t*>(buffer));
+						sink.write(buffer, count);
+						done += count;
+					}
+				}
+				break;
+
+			case Encoding::UTF8: {
+				const UInt8* ptr = utf8();
+				const UInt8* const end = ptr + _bytes;
+				size_t count = 0;
+				while (ptr < end)
+				{
+					const UInt32 code = DecodeUtf8(ptr);
+					if (sizeof(wchar_t) == 2 && code > 0xFFFF)
+					{
+						buffer[count++] = static_cast<wchar_t>(0xD800 + ((code - 0x10000) >> 10));
+						buffer[count++] = static_cast<wchar_t>(0xDC00 + ((code - 0x10000) & 0x3FF));
+					}
+					else buffer[count++] = static_cast<wchar_t>(code);
+
+					if (count >= BufferLength - 1)
+					{
+						sink.write(buffer, count);
+						count = 0;
+					}
+				}
+				sink.write(buffer, count);
+			} break;
+		}
+	}
+
+	#define STRING_COMPARE(_Value) ((_Value)->type == Type::String ? compare((_Value)->as<String>()) : compare(static_cast<std::wstring>(*(_Value))))
+
+	Value* String::klang_operatorEquals(Value* value)
+	{
+		if (value->type == Type::String)
+			return BOOL_TEST(equals(value->as<String>()));
+		return BOOL_TEST(compare(static_cast<std::wstring>(*value)) == 0);
+	}
+	Value* String::klang_operatorNotEquals(Value* value)
+	{
+		if (value->type == Type::String)
+			return BOOL_TEST(!equals(value->as<String>()));
+		return BOOL_TEST(compare(static_cast<std::wstring>(*value)) != 0);
+	}
+	Value* String::klang_operatorGreater(Value* value) { return BOOL_TEST(STRING_COMPARE(value) > 0); }
+	Value* String::klang_operatorLess(Value* value) { return BOOL_TEST(STRING_COMPARE(value) < 0); }
+	Value* String::klang_operatorGreaterEquals(Value* value) { return BOOL_TEST(STRING_COMPARE(value) >= 0); }
+	Value* String::klang_operatorLessEquals(Value* value) { return BOOL_TEST(STRING_COMPARE(value) <= 0); }
+	Value* String::klang_operatorNot() { return BOOL_TEST(_length <= 1); }
+
+	#undef STRING_COMPARE
+
+	Value* String::klang_operatorPlus(Value* value)
+	{
+		if (value->type == Type::String)
+			return concat(value->as<String>());
+		return newString(static_cast<std::wstring>(*this) + static_cast<std::wstring>(*value));
+	}
+
+	Value* String::klang_operatorArrayGet(Value* index)
+	{
+		size_t idx = static_cast<size_t>(static_cast<Int64>(*index));
+		if (idx >= _length)
+			return constant::Undefined;
+		return character(at(idx));
+	}
+
+	void String::trace(heap::SlotVisitor visitor, void* const ctx)
+	{
+		visitor(&_data, ctx);
+		if (_kind == Kind::Rope)
+			visitor(reinterpret_cast<void**>(&_right), ctx);
+	}
+
+	void* String::operator new(size_t, const std::wstring& str) { return newString(str); }
+	void String::operator delete(void* p) { heap::destroy(reinterpret_cast<String*>(p)); }
+}
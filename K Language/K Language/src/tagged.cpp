@@ -0,0 +1,536 @@
+#include "tagged.h"
+#include "bigint.h"
+#include "array.h"
+#include "list.h"
+
+#include <cstring>
+
+namespace klang::type
+{
+	/* Heap numbers are unboxed on the way in, so values coming back from the virtual
+	   operator API stop holding heap memory as soon as they are stored. */
+	Tagged::Tagged(Value* const value) noexcept :
+		_bits{ UndefinedBits }
+	{
+		if (!value)
+			return;
+
+		switch (value->type)
+		{
+			case Value::Type::Integer: {
+				if (isBigInt(value))
+					break;
+				const Int64 integer = static_cast<Int64>(*value);
+				if (integer >= MinInteger && integer <= MaxInteger)
+				{
+					_bits = IntegerTag | (static_cast<UInt64>(integer) & ~IntegerTag);
+					return;
+				}
+			} break;
+
+			case Value::Type::Float:
+				*this = fromDouble(static_cast<double>(*value));
+				return;
+
+			case Value::Type::Boolean:
+				_bits = static_cast<bool>(*value) ? TrueBits : FalseBits;
+				return;
+
+			case Value::Type::Undefined:
+				return;
+
+			default: break;
+		}
+		_bits = static_cast<UInt64>(reinterpret_cast<uintptr_t>(value));
+	}
+
+	Tagged Tagged::fromInteger(const Int64 value)
+	{
+		if (value >= MinInteger && value <= MaxInteger)
+			return Tagged{ IntegerTag | (static_cast<UInt64>(value) & ~IntegerTag), 0 };
+		return Tagged{ static_cast<UInt64>(reinterpret_cast<uintptr_t>(newLongInteger(value))), 0 };
+	}
+
+	Tagged Tagged::fromDouble(const double value) noexcept
+	{
+		UInt64 bits;
+		if (value != value)
+			bits = 0x7FF8000000000000ULL;
+		else std::memcpy(&bits, &value, sizeof(double));
+		return Tagged{ bits + DoubleOffset, 0 };
+	}
+
+	double Tagged::number() const
+	{
+		if (isInteger())
+			return static_cast<double>(integer());
+
+		const UInt64 bits = _bits - DoubleOffset;
+		double value;
+		std::memcpy(&value, &bits, sizeof(double));
+		return value;
+	}
+
+	Value::Type Tagged::type() const
+	{
+		if (isPointer())
+			return pointer()->type;
+		if (isInteger())
+			return Value::Type::Integer;
+		if (isDouble())
+			return Value::Type::Float;
+		if (isBoolean())
+			return Value::Type::Boolean;
+		return Value::Type::Undefined;
+	}
+
+	Tagged::operator Int32() const
+	{
+		if (isPointer())
+			return static_cast<Int32>(*pointer());
+		if (isInteger())
+			return static_cast<Int32>(integer());
+		if (isDouble())
+			return static_cast<Int32>(number());
+		return boolean();
+	}
+	Tagged::operator Int64() const
+	{
+		if (isPointer())
+			return static_cast<Int64>(*pointer());
+		if (isInteger())
+			return integer();
+		if (isDouble())
+			return static_cast<Int64>(number());
+		return boolean();
+	}
+	Tagged::operator float() const { return static_cast<float>(static_cast<double>(*this)); }
+	Tagged::operator double() const
+	{
+		if (isPointer())
+			return static_cast<double>(*pointer());
+		if (isNumber())
+			return number();
+		return boolean();
+	}
+	Tagged::operator bool() const
+	{
+		if (isPointer())
+			return static_cast<bool>(*pointer());
+		if (isInteger())
+			return integer() != 0;
+		if (isDouble())
+			return number() != 0;
+		return boolean();
+	}
+	Tagged::operator std::wstring() const
+	{
+		if (isPointer())
+			return static_cast<std::wstring>(*pointer());
+		if (isInteger())
+			return numberToWString(integer());
+		if (isDouble())
+			return numberToWString(number());
+		if (isBoolean())
+			return boolean() ? L"true" : L"false";
+		return L"undefined";
+	}
+	void Tagged::writeTo(TextSink& sink) const
+	{
+		if (isPointer())
+			return pointer()->writeTo(sink);
+
+		char buffer[NumberTextSize];
+		if (isInteger())
+			sink.write(buffer, formatNumber(integer(), buffer));
+		else if (isDouble())
+			sink.write(buffer, formatNumber(number(), buffer));
+		else if (isBoolean() && boolean())
+			sink.write("true", 4);
+		else if (isBoolean())
+			sink.write("false", 5);
+		else sink.write("undefined", 9);
+	}
+
+	Value* Tagged::box() const
+	{
+		if (isPointer())
+			return pointer();
+		if (isInteger())
+			return newLongInteger(integer());
+		if (isDouble())
+			return newDouble(number());
+		if (isBoolean())
+			return boolean() ? constant::True : constant::False;
+		return constant::Undefined;
+	}
+}
+
+
+
+/* Shifts wrap to 64 bits, every other integer result is exact. */
+#define WRAP(_Expr) static_cast<klang::Int64>(_Expr)
+#define UWIDE(_Value) static_cast<klang::UInt64>(_Value)
+
+#define BOXED_UNARY(_Operator, _Value) Tagged{ (_Value).box()->_Operator() }
+
+/* Binary operators are dispatched through a table indexed by operator and by the types of
+   both operands. Kernels are plain functions specialized for the numeric, boolean and
+   string pairs; empty entries box the operands and call the virtual Value operators,
+   which stay the fallback for every other type. */
+namespace klang::type
+{
+	enum BinaryOperator
+	{
+		OpEquals,
+		OpNotEquals,
+		OpGreater,
+		OpLess,
+		OpGreaterEquals,
+		OpLessEquals,
+
+		OpPlus,
+		OpMinus,
+		OpMultiply,
+		OpDivide,
+		OpModule,
+
+		OpBitwiseLeft,
+		OpBitwiseRight,
+		OpBitwiseAnd,
+		OpBitwiseOr,
+		OpBitwiseXor,
+
+		BinaryOperatorCount
+	};
+
+	static constexpr size_t TypeCount = static_cast<size_t>(Value::Type::Internal) + 1;
+
+	typedef Tagged (*BinaryKernel)(const Tagged left, const Tagged right);
+
+	static Tagged Boxed(const BinaryOperator op, const Tagged left, const Tagged right)
+	{
+		Value* const lhs = left.box();
+		Value* const rhs = right.box();
+		switch (op)
+		{
+			case OpEquals: return lhs->klang_operatorEquals(rhs);
+			case OpNotEquals: return lhs->klang_operatorNotEquals(rhs);
+			case OpGreater: return lhs->klang_operatorGreater(rhs);
+			case OpLess: return lhs->klang_operatorLess(rhs);
+			case OpGreaterEquals: return lhs->klang_operatorGreaterEquals(rhs);
+			case OpLessEquals: return lhs->klang_operatorLessEquals(rhs);
+			case OpPlus: return lhs->klang_operatorPlus(rhs);
+			case OpMinus: return lhs->klang_operatorMinus(rhs);
+			case OpMultiply: return lhs->klang_operatorMultiply(rhs);
+			case OpDivide: return lhs->klang_operatorDivide(rhs);
+			case OpModule: return lhs->klang_operatorModule(rhs);
+			case OpBitwiseLeft: return lhs->klang_operatorBitwiseLeft(rhs);
+			case OpBitwiseRight: return lhs->klang_operatorBitwiseRight(rhs);
+			case OpBitwiseAnd: return lhs->klang_operatorBitwiseAnd(rhs);
+			case OpBitwiseOr: return lhs->klang_operatorBitwiseOr(rhs);
+			case OpBitwiseXor: return lhs->klang_operatorBitwiseXor(rhs);
+			default: return Tagged::undefined();
+		}
+	}
+
+	/* Boxed integers may be BigInts, which only their virtual operators handle exactly. */
+	static inline bool HasBigInt(const Tagged left, const Tagged right)
+	{
+		return (left.isPointer() && isBigInt(left.pointer())) || (right.isPointer() && isBigInt(right.pointer()));
+	}
+
+	/* Int64 module and bitwise kernels shared by every numeric pair. The result keeps the
+	   kind of the left operand, as the boxed numbers do. */
+	template<BinaryOperator _Op>
+	static Tagged IntegerBits(const Tagged left, const Tagged right, const bool floatResult)
+	{
+		if (HasBigInt(left, right))
+			return Boxed(_Op, left, right);
+
+		const Int64 lhs = static_cast<Int64>(left);
+		const Int64 rhs = static_cast<Int64>(right);
+		Int64 result;
+
+		if constexpr (_Op == OpModule)
+		{
+			if (!rhs)
+				return Boxed(_Op, left, right);
+			result = rhs == -1 ? 0 : lhs % rhs;
+		}
+		else if constexpr (_Op == OpBitwiseLeft || _Op == OpBitwiseRight)
+		{
+			if (rhs < 0 || rhs >= 64)
+				return Boxed(_Op, left, right);
+			result = _Op == OpBitwiseLeft ? WRAP(UWIDE(lhs) << rhs) : lhs >> rhs;
+		}
+		else if constexpr (_Op == OpBitwiseAnd) result = lhs & rhs;
+		else if constexpr (_Op == OpBitwiseOr) result = lhs | rhs;
+		else result = lhs ^ rhs;
+
+		return floatResult ? Tagged::fromDouble(static_cast<double>(result)) : Tagged::fromInteger(result);
+	}
+
+	/* Inline integers keep 48 bits, so only boxed operands can overflow Int64 on plus and
+	   minus; overflowing results are promoted to BigInt. */
+	template<BinaryOperator _Op>
+	static Tagged IntegerKernel(const Tagged left, const Tagged right)
+	{
+		if (HasBigInt(left, right))
+			return Boxed(_Op, left, right);
+
+		const Int64 lhs = static_cast<Int64>(left);
+		const Int64 rhs = static_cast<Int64>(right);
+		Int64 result;
+
+		if constexpr (_Op == OpEquals) return Tagged::fromBoolean(lhs == rhs);
+		else if constexpr (_Op == OpNotEquals) return Tagged::fromBoolean(lhs != rhs);
+		else if constexpr (_Op == OpGreater) return Tagged::fromBoolean(lhs > rhs);
+		else if constexpr (_Op == OpLess) return Tagged::fromBoolean(lhs < rhs);
+		else if constexpr (_Op == OpGreaterEquals) return Tagged::fromBoolean(lhs >= rhs);
+		else if constexpr (_Op == OpLessEquals) return Tagged::fromBoolean(lhs <= rhs);
+		else if constexpr (_Op == OpPlus) return addOverflow(lhs, rhs, &result) ? Tagged{ integralPlus(lhs, rhs) } : Tagged::fromInteger(result);
+		else if constexpr (_Op == OpMinus) return subOverflow(lhs, rhs, &result) ? Tagged{ integralMinus(lhs, rhs) } : Tagged::fromInteger(result);
+		else if constexpr (_Op == OpMultiply) return mulOverflow(lhs, rhs, &result) ? Boxed(_Op, left, right) : Tagged::fromInteger(result);
+		else if constexpr (_Op == OpDivide) return rhs && rhs != -1 ? Tagged::fromInteger(lhs / rhs) : Boxed(_Op, left, right);
+		else return IntegerBits<_Op>(left, right, false);
+	}
+
+	/* Any number mixed with a float or a boolean works on doubles. */
+	template<BinaryOperator _Op>
+	static Tagged DoubleKernel(const Tagged left, const Tagged right)
+	{
+		if constexpr (_Op >= OpModule)
+			return IntegerBits<_Op>(left, right, left.type() == Value::Type::Float);
+		else
+		{
+			const double lhs = static_cast<double>(left);
+			const double rhs = static_cast<double>(right);
+
+			if constexpr (_Op == OpEquals) return Tagged::fromBoolean(lhs == rhs);
+			else if constexpr (_Op == OpNotEquals) return Tagged::fromBoolean(lhs != rhs);
+			else if constexpr (_Op == OpGreater) return Tagged::fromBoolean(lhs > rhs);
+			else if constexpr (_Op == OpLess) return Tagged::fromBoolean(lhs < rhs);
+			else if constexpr (_Op == OpGreaterEquals) return Tagged::fromBoolean(lhs >= rhs);
+			else if constexpr (_Op == OpLessEquals) return Tagged::fromBoolean(lhs <= rhs);
+			else if constexpr (_Op == OpPlus) return Tagged::fromDouble(lhs + rhs);
+			else if constexpr (_Op == OpMinus) return Tagged::fromDouble(lhs - rhs);
+			else if constexpr (_Op == OpMultiply) return Tagged::fromDouble(lhs * rhs);
+			else return Tagged::fromDouble(lhs / rhs);
+		}
+	}
+
+	/* Booleans compare as booleans (ordered as 0/1) and compute as doubles. */
+	template<BinaryOperator _Op>
+	static Tagged BooleanKernel(const Tagged left, const Tagged right)
+	{
+		const bool lhs = static_cast<bool>(left);
+		const bool rhs = static_cast<bool>(right);
+
+		if constexpr (_Op == OpEquals) return Tagged::fromBoolean(lhs == rhs);
+		else if constexpr (_Op == OpNotEquals) return Tagged::fromBoolean(lhs != rhs);
+		else if constexpr (_Op == OpGreater) return Tagged::fromBoolean(lhs > rhs);
+		else if constexpr (_Op == OpLess) return Tagged::fromBoolean(lhs < rhs);
+		else if constexpr (_Op == OpGreaterEquals) return Tagged::fromBoolean(lhs >= rhs);
+		else if constexpr (_Op == OpLessEquals) return Tagged::fromBoolean(lhs <= rhs);
+		else if constexpr (_Op >= OpModule) return IntegerBits<_Op>(left, right, false);
+		else return DoubleKernel<_Op>(left, right);
+	}
+
+	static int CompareStrings(const Tagged left, const Tagged right)
+	{
+		const String& lhs = left.pointer()->as<String>();
+		if (right.type() == Value::Type::String)
+			return lhs.compare(right.pointer()->as<String>());
+		return lhs.compare(static_cast<std::wstring>(right));
+	}
+
+	static bool EqualStrings(const Tagged left, const Tagged right)
+	{
+		if (right.type() == Value::Type::String)
+			return left.pointer()->as<String>().equals(right.pointer()->as<String>());
+		return !CompareStrings(left, right);
+	}
+
+	/* Strings compare by contents against the string form of the right operand and
+	   concatenate on plus. */
+	template<BinaryOperator _Op>
+	static Tagged StringKernel(const Tagged left, const Tagged right)
+	{
+		if constexpr (_Op == OpEquals) return Tagged::fromBoolean(EqualStrings(left, right));
+		else if constexpr (_Op == OpNotEquals) return Tagged::fromBoolean(!EqualStrings(left, right));
+		else if constexpr (_Op == OpGreater) return Tagged::fromBoolean(CompareStrings(left, right) > 0);
+		else if constexpr (_Op == OpLess) return Tagged::fromBoolean(CompareStrings(left, right) < 0);
+		else if constexpr (_Op == OpGreaterEquals) return Tagged::fromBoolean(CompareStrings(left, right) >= 0);
+		else if constexpr (_Op == OpLessEquals) return Tagged::fromBoolean(CompareStrings(left, right) <= 0);
+		else if (right.type() == Value::Type::String) return Tagged{ left.pointer()->as<String>().concat(right.pointer()->as<String>()) };
+		else return Tagged{ newString(static_cast<std::wstring>(left) + static_cast<std::wstring>(right)) };
+	}
+
+
+
+	struct BinaryKernelTable
+	{
+		BinaryKernel kernels[BinaryOperatorCount][TypeCount][TypeCount];
+	};
+
+	template<BinaryOperator _Op>
+	static constexpr void RegisterKernels(BinaryKernelTable& table)
+	{
+		constexpr size_t Undefined = static_cast<size_t>(Value::Type::Undefined);
+		constexpr size_t Integer = static_cast<size_t>(Value::Type::Integer);
+		constexpr size_t Float = static_cast<size_t>(Value::Type::Float);
+		constexpr size_t Boolean = static_cast<size_t>(Value::Type::Boolean);
+		constexpr size_t String = static_cast<size_t>(Value::Type::String);
+
+		BinaryKernel (&kernels)[TypeCount][TypeCount] = table.kernels[_Op];
+
+		kernels[Integer][Integer] = &IntegerKernel<_Op>;
+		kernels[Integer][Float] = &DoubleKernel<_Op>;
+		kernels[Integer][Boolean] = &DoubleKernel<_Op>;
+		kernels[Float][Integer] = &DoubleKernel<_Op>;
+		kernels[Float][Float] = &DoubleKernel<_Op>;
+		kernels[Float][Boolean] = &DoubleKernel<_Op>;
+		kernels[Boolean][Integer] = &BooleanKernel<_Op>;
+		kernels[Boolean][Float] = &BooleanKernel<_Op>;
+		kernels[Boolean][Boolean] = &BooleanKernel<_Op>;
+
+		if constexpr (_Op <= OpPlus)
+		{
+			kernels[String][Undefined] = &StringKernel<_Op>;
+			kernels[String][Integer] = &StringKernel<_Op>;
+			kernels[String][Float] = &StringKernel<_Op>;
+			kernels[String][Boolean] = &StringKernel<_Op>;
+			kernels[String][String] = &StringKernel<_Op>;
+		}
+	}
+
+	static constexpr BinaryKernelTable MakeBinaryKernels()
+	{
+		BinaryKernelTable table{};
+		RegisterKernels<OpEquals>(table);
+		RegisterKernels<OpNotEquals>(table);
+		RegisterKernels<OpGreater>(table);
+		RegisterKernels<OpLess>(table);
+		RegisterKernels<OpGreaterEquals>(table);
+		RegisterKernels<OpLessEquals>(table);
+		RegisterKernels<OpPlus>(table);
+		RegisterKernels<OpMinus>(table);
+		RegisterKernels<OpMultiply>(table);
+		RegisterKernels<OpDivide>(table);
+		RegisterKernels<OpModule>(table);
+		RegisterKernels<OpBitwiseLeft>(table);
+		RegisterKernels<OpBitwiseRight>(table);
+		RegisterKernels<OpBitwiseAnd>(table);
+		RegisterKernels<OpBitwiseOr>(table);
+		RegisterKernels<OpBitwiseXor>(table);
+		return table;
+	}
+
+	static constexpr BinaryKernelTable BinaryKernels = MakeBinaryKernels();
+
+	static inline Tagged Dispatch(const BinaryOperator op, const Tagged left, const Tagged right)
+	{
+		const BinaryKernel kernel = BinaryKernels.kernels[op][static_cast<size_t>(left.type())][static_cast<size_t>(right.type())];
+		return kernel ? kernel(left, right) : Boxed(op, left, right);
+	}
+}
+
+namespace klang::type
+{
+	Tagged klang_operatorEquals(const Tagged left, const Tagged right) { return Dispatch(OpEquals, left, right); }
+	Tagged klang_operatorNotEquals(const Tagged left, const Tagged right) { return Dispatch(OpNotEquals, left, right); }
+	Tagged klang_operatorGreater(const Tagged left, const Tagged right) { return Dispatch(OpGreater, left, right); }
+	Tagged klang_operatorLess(const Tagged left, const Tagged right) { return Dispatch(OpLess, left, right); }
+	Tagged klang_operatorGreaterEquals(const Tagged left, const Tagged right) { return Dispatch(OpGreaterEquals, left, right); }
+	Tagged klang_operatorLessEquals(const Tagged left, const Tagged right) { return Dispatch(OpLessEquals, left, right); }
+	Tagged klang_operatorNot(const Tagged value)
+	{
+		if (value.isInteger())
+			return Tagged::fromInteger(!value.integer());
+		if (value.isDouble())
+			return Tagged::fromDouble(!value.number());
+		return BOXED_UNARY(klang_operatorNot, value);
+	}
+
+
+
+	Tagged klang_operatorPlus(const Tagged left, const Tagged right) { return Dispatch(OpPlus, left, right); }
+	Tagged klang_operatorMinus(const Tagged left, const Tagged right) { return Dispatch(OpMinus, left, right); }
+	Tagged klang_operatorMultiply(const Tagged left, const Tagged right) { return Dispatch(OpMultiply, left, right); }
+	Tagged klang_operatorDivide(const Tagged left, const Tagged right) { return Dispatch(OpDivide, left, right); }
+	Tagged klang_operatorModule(const Tagged left, const Tagged right) { return Dispatch(OpModule, left, right); }
+	Tagged klang_operatorIncrease(const Tagged value)
+	{
+		if (value.isInteger())
+			return Tagged::fromInteger(value.integer() + 1);
+		if (value.isDouble())
+			return Tagged::fromDouble(value.number() + 1);
+		return BOXED_UNARY(klang_operatorIncrease, value);
+	}
+	Tagged klang_operatorDecrease(const Tagged value)
+	{
+		if (value.isInteger())
+			return Tagged::fromInteger(value.integer() - 1);
+		if (value.isDouble())
+			return Tagged::fromDouble(value.number() - 1);
+		return BOXED_UNARY(klang_operatorDecrease, value);
+	}
+	Tagged klang_operatorNegative(const Tagged value)
+	{
+		if (value.isInteger())
+			return Tagged::fromInteger(-value.integer());
+		if (value.isDouble())
+			return Tagged::fromDouble(-value.number());
+		return BOXED_UNARY(klang_operatorNegative, value);
+	}
+
+
+
+	Tagged klang_operatorBitwiseLeft(const Tagged left, const Tagged right) { return Dispatch(OpBitwiseLeft, left, right); }
+	Tagged klang_operatorBitwiseRight(const Tagged left, const Tagged right) { return Dispatch(OpBitwiseRight, left, right); }
+	Tagged klang_operatorBitwiseAnd(const Tagged left, const Tagged right) { return Dispatch(OpBitwiseAnd, left, right); }
+	Tagged klang_operatorBitwiseOr(const Tagged left, const Tagged right) { return Dispatch(OpBitwiseOr, left, right); }
+	Tagged klang_operatorBitwiseXor(const Tagged left, const Tagged right) { return Dispatch(OpBitwiseXor, left, right); }
+	Tagged klang_operatorBitwiseNot(const Tagged value)
+	{
+		if (value.isInteger())
+			return Tagged::fromInteger(~value.integer());
+		if (value.isDouble())
+			return Tagged::fromDouble(static_cast<double>(~static_cast<Int64>(value.number())));
+		return BOXED_UNARY(klang_operatorBitwiseNot, value);
+	}
+
+
+
+	Tagged klang_operatorArrayGet(const Tagged container, const Tagged index)
+	{
+		if (container.isPointer() && index.isInteger())
+		{
+			Value* const value = container.pointer();
+			const Int64 idx = index.integer();
+			if (value->type == Value::Type::Array)
+				return idx < 0 ? Tagged::undefined() : value->as<Array>().get(static_cast<size_t>(idx));
+			if (value->type == Value::Type::List)
+				return idx < 0 ? Tagged::undefined() : value->as<List>().get(static_cast<size_t>(idx));
+			if (value->type == Value::Type::String)
+			{
+				const String& string = value->as<String>();
+				return idx < 0 || static_cast<size_t>(idx) >= string.size() ? Tagged::undefined() : Tagged{ String::character(string.at(static_cast<size_t>(idx))) };
+			}
+		}
+		return container.box()->klang_operatorArrayGet(index.box());
+	}
+	void klang_operatorArraySet(const Tagged container, const Tagged index, const Tagged value)
+	{
+		if (container.isPointer() && index.isInteger() && index.integer() >= 0)
+		{
+			Value* const target = container.pointer();
+			if (target->type == Value::Type::Array)
+				return target->as<Array>().set(static_cast<size_t>(index.integer()), value);
+			if (target->type == Value::Type::List)
+				return target->as<List>().set(static_cast<size_t>(index.integer()), value);
+		}
+		container.box()->klang_operatorArraySet(index.box(), value.box());
+	}
+}
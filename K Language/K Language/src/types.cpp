@@ -1,5 +1,7 @@
 #include "types.h"
+#include "simd.h"
 
+#include <algorithm>
 #include <sstream>
 
 
@@ -32,6 +34,7 @@ namespace klang::type
 			case Type::Array: return L"array";
 			case Type::List: return L"list";
 			case Type::Object: return L"object";
+			case Type::Internal: return L"internal";
 		}
 		return L"";
 	}
@@ -51,6 +54,7 @@ namespace klang::type
 			case Type::Array: return "array";
 			case Type::List: return "list";
 			case Type::Object: return "object";
+			case Type::Internal: return "internal";
 		}
 		return "";
 	}
@@ -70,6 +74,11 @@ namespace klang::type
 		ss << GetTypeWName(klangType()) << "::" << this;
 		return ss.str();
 	}
+	void Value::writeTo(TextSink& sink) const
+	{
+		const std::wstring text = static_cast<std::wstring>(*this);
+		sink.write(text.data(), text.size());
+	}
 	Value::operator ValueVector() const { return { const_cast<Value*>(this) }; };
 	Value::operator ValueMap() const { return { { "scalar", const_cast<Value*>(this) } }; }
 	 
@@ -120,6 +129,9 @@ namespace klang::type
 	Value* Value::klang_operatorIterator() { throw UnsupportedException{ *this, "klang_operatorIterator" }; }
 	Value* Value::klang_operatorHasNext() { throw UnsupportedException{ *this, "klang_operatorHasNext" }; }
 	Value* Value::klang_operatorNext() { throw UnsupportedException{ *this, "klang_operatorNext" }; }
+
+//Heap hooks
+	void Value::trace(heap::SlotVisitor, void* const) {}
 }
 
 
@@ -179,6 +191,7 @@ namespace klang::type
 	Undefined::operator double() const { return 0; }
 	Undefined::operator bool() const { return false; }
 	Undefined::operator std::wstring() const { return L"undefined"; }
+	void Undefined::writeTo(TextSink& sink) const { sink.write("undefined", 9); }
 
 	Value* Undefined::klang_operatorNot() { return constant::True; }
 
@@ -207,6 +220,12 @@ namespace klang::type
 	Boolean::operator double() const { return _value; }
 	Boolean::operator bool() const { return _value; }
 	Boolean::operator std::wstring() const { return _value ? L"true" : L"false"; }
+	void Boolean::writeTo(TextSink& sink) const
+	{
+		if (_value)
+			sink.write("true", 4);
+		else sink.write("false", 5);
+	}
 
 	Value* Boolean::klang_operatorEquals(Value* value) { return BOOL_TEST(_value == BOOL(*value)); }
 	Value* Boolean::klang_operatorNotEquals(Value* value) { return BOOL_TEST(_value != BOOL(*value)); }
@@ -243,67 +262,42 @@ namespace klang::type
 
 
 
-// String //
+namespace klang::type::constant
+{
+	extern Value* const Undefined = Undefined::Instance;
+	extern Value* const True = Boolean::True;
+	extern Value* const False = Boolean::False;
+}
+
 namespace klang::type
 {
-	String::String(const std::wstring& value) :
-		Value{ Type::String },
-		_size{ value.size() },
-		_value{ reinterpret_cast<wchar_t*>(heap::malloc(sizeof(wchar_t) * (value.size() + 1))) }
-	{
-		heap::incref(_value);
-		std::wmemcpy(_value, value.data(), _size);
-		_value[_size] = L'\0';
-	}
-	String::~String()
+	/* Latin-1 text is widened through a stack buffer. */
+	void WStreamSink::write(const char* const text, const size_t size)
 	{
-		heap::decref(_value);
-		heap::free(_value);
-	}
-
-	String::operator Int32() const { return std::stol(_value); }
-	String::operator Int64() const { return std::stoll(_value); }
-	String::operator float() const { return std::stof(_value); }
-	String::operator double() const { return std::stod(_value); }
-	String::operator bool() const { return _size > 1; }
-	String::operator std::wstring() const { return _value; }
-
-	Value* String::klang_operatorEquals(Value* value) { return BOOL_TEST(_value == static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorNotEquals(Value* value) { return BOOL_TEST(_value != static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorGreater(Value* value) { return BOOL_TEST(_value > static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorLess(Value* value) { return BOOL_TEST(_value < static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorGreaterEquals(Value* value) { return BOOL_TEST(_value >= static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorLessEquals(Value* value) { return BOOL_TEST(_value <= static_cast<std::wstring>(*value)); }
-	Value* String::klang_operatorNot() { return BOOL_TEST(_size <= 1); }
+		typedef std::conditional<sizeof(wchar_t) == sizeof(char16_t), char16_t, char32_t>::type WideUnit;
 
-	Value* String::klang_operatorPlus(Value* value) { return newString(_value + static_cast<std::wstring>(*value)); }
+		wchar_t buffer[256];
+		for (size_t done = 0; done < size;)
+		{
+			const size_t count = std::min(size - done, sizeof(buffer) / sizeof(wchar_t));
+			simd::widen(reinterpret_cast<const UInt8*>(text) + done, count, reinterpret_cast<WideUnit*>(buffer));
+			_stream.write(buffer, static_cast<std::streamsize>(count));
+			done += count;
+		}
+	}
+	void WStreamSink::write(const wchar_t* const text, const size_t size) { _stream.write(text, static_cast<std::streamsize>(size)); }
 
-	Value* String::klang_operatorArrayGet(Value* index)
+	void WStringSink::write(const char* const text, const size_t size)
 	{
-		size_t idx = static_cast<size_t>(INT64(*index));
-		if (idx >= _size)
-			return constant::Undefined;
-		return newString(std::wstring(_value + idx, 1));
+		for (size_t i = 0; i < size; ++i)
+			_text.push_back(static_cast<wchar_t>(static_cast<UInt8>(text[i])));
 	}
-
-	void* String::operator new(size_t size, const std::wstring& str) { return newString(str); }
-	void String::operator delete(void* p) { heap::destroy(reinterpret_cast<String*>(p)); }
-}
-
-
-
-
-
-
-
-namespace klang::type::constant
-{
-	extern Value* const Undefined = Undefined::Instance;
-	extern Value* const True = Boolean::True;
-	extern Value* const False = Boolean::False;
+	void WStringSink::write(const wchar_t* const text, const size_t size) { _text.append(text, size); }
 }
 
 std::wostream& operator<< (std::wostream& os, const klang::type::Value& value)
 {
-	return os << static_cast<std::wstring>(value);
+	klang::type::WStreamSink sink{ os };
+	value.writeTo(sink);
+	return os;
 }
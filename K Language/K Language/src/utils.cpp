@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <charconv>
+
 namespace klang
 {
 	KlangException::KlangException() noexcept :
@@ -12,3 +14,17 @@ namespace klang
 		exception(message.c_str())
 	{}
 }
+
+namespace klang
+{
+	template<typename _NumberType>
+	static inline size_t FormatNumber(const _NumberType value, char* const buffer)
+	{
+		return static_cast<size_t>(std::to_chars(buffer, buffer + NumberTextSize, value).ptr - buffer);
+	}
+
+	size_t formatNumber(const Int32 value, char* const buffer) { return FormatNumber(value, buffer); }
+	size_t formatNumber(const Int64 value, char* const buffer) { return FormatNumber(value, buffer); }
+	size_t formatNumber(const float value, char* const buffer) { return FormatNumber(value, buffer); }
+	size_t formatNumber(const double value, char* const buffer) { return FormatNumber(value, buffer); }
+}